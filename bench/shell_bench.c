@@ -0,0 +1,317 @@
+// Micro-benchmarks of the shell hot paths in shell.c
+//
+//   parse        parse_line() alone on short, typical interactive command lines
+//   parser       parse_line() alone over a large generated script (lexing + AST building only)
+//   launch       run_command() launching an external command
+//   spawn_*      raw fork()+execvp() versus spawn_command() (posix_spawn), with a small
+//                and with a large (page-table heavy) shell address space
+//   pipeline     bytes per second through handle_pipeline()
+//   redirection  run_command() with an output redirection, handled by handle_redirection()
+//   builtin      an in-shell builtin with a redirection against the same program from $PATH
+//
+// Results are printed as CSV (default) or JSON, one record per metric:
+//   ./bench/shell_bench [-f csv|json] [-n launches]
+
+#include "../shell.h"
+#include "../histogram.h"
+
+#include <time.h>
+
+// Lines parsed by the parse benchmark
+#define PARSE_LINES 200000
+
+// Size of the generated script for the parser benchmark and how often it is parsed
+#define PARSER_SCRIPT_LINES 100000
+#define PARSER_ROUNDS 5
+
+// Bytes pushed through the pipeline benchmark
+#define PIPE_BYTES (256LL * 1024 * 1024)
+
+// Extra memory mapped into the shell for the large-address-space launch benchmark
+#define LARGE_HEAP (512UL * 1024 * 1024)
+
+// One measured value
+typedef struct {
+    const char *bench;      // Benchmark name
+    const char *metric;     // What was measured
+    double value;           // Measured value
+    const char *unit;       // Unit of 'value'
+} BenchResult;
+
+static BenchResult results[64];
+static int result_count = 0;
+
+// Returns a monotonic timestamp in nanoseconds
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void add_result(const char *bench, const char *metric, double value, const char *unit)
+{
+    if (result_count < (int)(sizeof(results) / sizeof(results[0])))
+    {
+        results[result_count++] = (BenchResult){ bench, metric, value, unit };
+    }
+}
+
+// Records mean and tail percentiles of a latency histogram (values in ns, reported in us)
+static void add_latency(const char *bench, const Histogram *h)
+{
+    add_result(bench, "mean", hist_mean(h) / 1e3, "us");
+    add_result(bench, "p50", hist_percentile(h, 50) / 1e3, "us");
+    add_result(bench, "p99", hist_percentile(h, 99) / 1e3, "us");
+    add_result(bench, "max", h->max / 1e3, "us");
+}
+
+// Runs one command line 'iterations' times through process_line() and records the latency
+static void bench_command(const char *bench, const char *line, int iterations, Histogram *h)
+{
+    char command[MAX_LINE];
+
+    hist_init(h);
+    for (int i = 0; i < iterations; i++)
+    {
+        strcpy(command, line);
+        uint64_t t0 = now_ns();
+        process_line(command, -1, 0);
+        hist_record(h, now_ns() - t0);
+    }
+}
+
+// Parse cost of typical interactive lines: parse_line() into the arena and nothing else, so
+// no builtin or program runs inside the timed loop
+static void bench_parse(void)
+{
+    static const char *lines[] = {
+        "ls -la\n",
+        "cd /tmp/build ; make -j8 > build.log # rebuild\n",
+        "grep -n 'TODO' *.c | sort | uniq -c | head -n 5\n",
+        "echo \"hello $USER\" > greeting.txt ; cat < greeting.txt\n",
+    };
+    const int count = sizeof(lines) / sizeof(lines[0]);
+    size_t lens[sizeof(lines) / sizeof(lines[0])];
+    size_t bytes = 0;
+    Arena arena;
+    Pipeline *pipeline;
+    int pipelines = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        lens[i] = strlen(lines[i]);
+    }
+    arena_init(&arena);
+
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < PARSE_LINES; i++)
+    {
+        int k = i % count;
+        if (parse_line(&arena, lines[k], lens[k], &pipeline) == 0)
+        {
+            for (; pipeline; pipeline = pipeline->next)
+            {
+                pipelines++;
+            }
+        }
+        arena_reset(&arena);
+        bytes += lens[k];
+    }
+    double sec = (now_ns() - t0) / 1e9;
+
+    add_result("parse", "lines_per_sec", PARSE_LINES / sec, "lines/s");
+    add_result("parse", "throughput", bytes / sec / 1e6, "MB/s");
+    add_result("parse", "per_line", sec / PARSE_LINES * 1e9, "ns");
+    add_result("parse", "pipelines", pipelines, "count");
+
+    arena_free(&arena);
+}
+
+// Parser throughput on a generated script mixing quoting, pipelines, redirections and comments
+static void bench_parser(void)
+{
+    static const char *templates[] = {
+        "ls -la /usr/lib/%d | grep -v '\\.so' | sort -r | head -n 20 > /tmp/out_%d.txt\n",
+        "echo \"line %d with \\\"quotes\\\" and $HOME\" ; cat < /etc/hostname # note %d\n",
+        "printf '%%s\\n' arg%d another\\ word ; true ; false ; cd /tmp/dir%d\n",
+        "cat input_%d.log | tr a-z A-Z | sed -e 's/ERROR/error/g' | wc -l > count_%d\n",
+    };
+    size_t cap = PARSER_SCRIPT_LINES * 128;
+    char *script = malloc(cap);
+    size_t len = 0;
+
+    for (int i = 0; i < PARSER_SCRIPT_LINES; i++)
+    {
+        len += snprintf(script + len, cap - len, templates[i % 4], i, i);
+    }
+
+    Arena arena;
+    Pipeline *pipeline;
+    int pipelines = 0;
+    arena_init(&arena);
+
+    uint64_t t0 = now_ns();
+    for (int round = 0; round < PARSER_ROUNDS; round++)
+    {
+        // One parse per line, the arena is reset afterwards exactly like the interactive shell does
+        const char *p = script;
+        const char *end = script + len;
+        while (p < end)
+        {
+            const char *nl = memchr(p, '\n', end - p);
+            size_t line_len = nl ? (size_t)(nl - p) : (size_t)(end - p);
+            if (parse_line(&arena, p, line_len, &pipeline) == 0)
+            {
+                for (; pipeline; pipeline = pipeline->next)
+                {
+                    pipelines++;
+                }
+            }
+            arena_reset(&arena);
+            p += line_len + 1;
+        }
+    }
+    double sec = (now_ns() - t0) / 1e9;
+
+    add_result("parser", "throughput", (double)len * PARSER_ROUNDS / sec / 1e6, "MB/s");
+    add_result("parser", "lines_per_sec", (double)PARSER_SCRIPT_LINES * PARSER_ROUNDS / sec, "lines/s");
+    add_result("parser", "pipelines", pipelines / PARSER_ROUNDS, "count");
+
+    arena_free(&arena);
+    free(script);
+}
+
+// Old launch path kept as the baseline: fork() copies the page tables, then execvp()
+static void fork_exec_wait(char **argv)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+// Per-command launch latency of fork()+execvp() against posix_spawn()
+static void bench_spawn(const char *label_fork, const char *label_spawn, int iterations, Histogram *h)
+{
+    char *argv[] = { "true", NULL };
+
+    hist_init(h);
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t t0 = now_ns();
+        fork_exec_wait(argv);
+        hist_record(h, now_ns() - t0);
+    }
+    add_latency(label_fork, h);
+
+    hist_init(h);
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t t0 = now_ns();
+        pid_t pid = spawn_command(argv, NULL);
+        waitpid(pid, NULL, 0);
+        hist_record(h, now_ns() - t0);
+    }
+    add_latency(label_spawn, h);
+}
+
+// Pipe throughput: one large stream through a two-stage pipeline
+static void bench_pipeline(void)
+{
+    char command[MAX_LINE];
+
+    snprintf(command, sizeof(command), "head -c %lld /dev/zero | cat > /dev/null", PIPE_BYTES);
+    uint64_t t0 = now_ns();
+    process_line(command, -1, 0);
+    double sec = (now_ns() - t0) / 1e9;
+
+    add_result("pipeline", "throughput", PIPE_BYTES / sec / 1e6, "MB/s");
+    add_result("pipeline", "elapsed", sec * 1e3, "ms");
+}
+
+static void print_csv(void)
+{
+    printf("benchmark,metric,value,unit\n");
+    for (int i = 0; i < result_count; i++)
+    {
+        printf("%s,%s,%.3f,%s\n", results[i].bench, results[i].metric, results[i].value, results[i].unit);
+    }
+}
+
+static void print_json(void)
+{
+    printf("[\n");
+    for (int i = 0; i < result_count; i++)
+    {
+        printf("  {\"benchmark\": \"%s\", \"metric\": \"%s\", \"value\": %.3f, \"unit\": \"%s\"}%s\n",
+               results[i].bench, results[i].metric, results[i].value, results[i].unit,
+               i < result_count - 1 ? "," : "");
+    }
+    printf("]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int json = 0;
+    int launches = 2000;
+    Histogram *h = malloc(sizeof(Histogram));
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            json = strcmp(argv[++i], "json") == 0;
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            launches = atoi(argv[++i]);
+        }
+    }
+
+    bench_parse();
+    bench_parser();
+
+    bench_command("launch", "/bin/true", launches, h);  // Not the builtin "true"
+    add_latency("launch", h);
+    double plain_mean = hist_mean(h);
+
+    bench_command("redirection", "/bin/true > /dev/null", launches, h);
+    add_latency("redirection", h);
+    add_result("redirection", "overhead", (hist_mean(h) - plain_mean) / 1e3, "us");
+
+    // echo as an in-shell builtin (descriptor swap) against /bin/echo (spawn + wait)
+    bench_command("builtin_echo", "echo x > /dev/null", launches, h);
+    add_latency("builtin_echo", h);
+    double builtin_mean = hist_mean(h);
+    bench_command("external_echo", "/bin/echo x > /dev/null", launches, h);
+    add_latency("external_echo", h);
+    add_result("builtin_echo", "speedup", hist_mean(h) / builtin_mean, "x");
+
+    bench_pipeline();
+
+    // Launch cost with a small shell, then again after the shell grew by LARGE_HEAP bytes
+    bench_spawn("spawn_fork_small", "spawn_posix_small", launches, h);
+    char *heap = malloc(LARGE_HEAP);
+    if (heap)
+    {
+        memset(heap, 1, LARGE_HEAP);  // Touch every page so it is really mapped
+        bench_spawn("spawn_fork_large", "spawn_posix_large", launches, h);
+        free(heap);
+    }
+
+    if (json)
+    {
+        print_json();
+    }
+    else
+    {
+        print_csv();
+    }
+
+    free(h);
+    return 0;
+}
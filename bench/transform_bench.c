@@ -0,0 +1,108 @@
+// Micro-benchmark of the upper-case kernels in transform.c
+// Prints the throughput of every variant on 64 B, 4 KiB and 1 MiB buffers,
+// after checking each one against the scalar reference
+
+#include "../transform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Amount of data each measurement pushes through a kernel
+#define BENCH_TOTAL_BYTES (512UL * 1024 * 1024)
+
+// Returns a monotonic timestamp in seconds
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills a buffer with printable mixed-case text plus some bytes outside ASCII
+static void fill_input(char *buf, size_t len)
+{
+    const char sample[] = "Hello World, the quick brown fox jumps over 13 lazy dogs! \xc3\xa1\x7f{}`@[";
+    for (size_t i = 0; i < len; i++)
+    {
+        buf[i] = sample[i % (sizeof(sample) - 1)];
+    }
+}
+
+// Compares a kernel with the scalar reference on every length up to 'max' and every misalignment
+static int verify(transform_fn fn, size_t max)
+{
+    char *ref = malloc(max + 64);
+    char *got = malloc(max + 64);
+
+    for (size_t len = 0; len <= max; len++)
+    {
+        for (size_t off = 0; off < 4; off++)
+        {
+            fill_input(ref, len + off);
+            memcpy(got, ref, len + off);
+            transform_upper_scalar(ref + off, len);
+            fn(got + off, len);
+            if (memcmp(ref, got, len + off) != 0)
+            {
+                free(ref);
+                free(got);
+                return 0;
+            }
+        }
+    }
+
+    free(ref);
+    free(got);
+    return 1;
+}
+
+int main(void)
+{
+    const size_t sizes[] = { 64, 4096, 1024 * 1024 };
+    TransformVariant variants[8];
+    int n = transform_list_variants(variants, 8);
+    char *buf = malloc(sizes[2]);
+
+    printf("dispatch selects: %s\n", transform_variant());
+    printf("%-8s %10s %12s\n", "variant", "size", "GB/s");
+
+    for (int v = 0; v < n; v++)
+    {
+        if (!variants[v].supported)
+        {
+            printf("%-8s %10s %12s\n", variants[v].name, "-", "unsupported");
+            continue;
+        }
+        if (!verify(variants[v].fn, 300))
+        {
+            printf("%-8s %10s %12s\n", variants[v].name, "-", "MISMATCH");
+            free(buf);
+            return 1;
+        }
+
+        for (int s = 0; s < 3; s++)
+        {
+            size_t size = sizes[s];
+            size_t iters = BENCH_TOTAL_BYTES / size;
+
+            fill_input(buf, size);
+            variants[v].fn(buf, size);  // Warm up caches and page in the buffer
+
+            double start = now_sec();
+            for (size_t i = 0; i < iters; i++)
+            {
+                variants[v].fn(buf, size);
+                // Keep the compiler from merging iterations
+                __asm__ volatile("" : : "r"(buf) : "memory");
+            }
+            double elapsed = now_sec() - start;
+
+            printf("%-8s %10zu %12.2f\n", variants[v].name, size, (double)iters * size / elapsed / 1e9);
+        }
+    }
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,400 @@
+#include "bench_client.h"
+#include "client_utils.h"
+#include "server_utils.h"
+#include "protocol.h"
+#include "histogram.h"
+
+#include <errno.h>          // errno, EAGAIN, EINTR
+#include <time.h>           // clock_gettime()
+#include <sys/epoll.h>      // epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/uio.h>        // writev()
+
+// Size of the buffer used to drain replies
+#define BENCH_READ_CHUNK 65536
+
+// Maximum number of events handled per epoll_wait() call
+#define BENCH_MAX_EVENTS 256
+
+// Parameters of one benchmark run
+typedef struct {
+    int connections;        // Number of concurrent connections
+    size_t size;            // Payload bytes per request
+    int depth;              // Requests in flight per connection
+    uint64_t requests;      // Requests sent by each connection
+} BenchConfig;
+
+// State of one benchmark connection
+typedef struct {
+    ClientConnection *client;   // Transport settings and the connected socket
+    uint64_t sent;              // Requests fully written
+    uint64_t done;              // Requests whose reply fully arrived
+    size_t msg_off;             // Bytes of the request being written (0 = none in progress)
+    unsigned char hdr[FRAME_HEADER_LEN];  // Header of the request being written (framed mode)
+    uint64_t *start_ns;         // Send timestamps of the requests in flight, indexed modulo depth
+    uint32_t *slot_id;          // Request id occupying each slot of 'start_ns', 0 when it is free
+    uint64_t oldest;            // Lowest request number still waiting for its reply
+    uint64_t out_of_order;      // Framed mode: replies that overtook an older request
+    uint64_t unmatched;         // Framed mode: replies whose id names no request in flight
+    size_t banner_left;         // Raw mode: banner bytes still to skip
+    uint64_t rx_bytes;          // Raw mode: reply bytes received after the banner
+    FrameDecoder dec;           // Framed mode: reply decoder
+} BenchConn;
+
+// Shared state the reply callbacks need
+typedef struct {
+    BenchConn *conn;
+    const BenchConfig *cfg;
+    Histogram *latency;
+} ReplyContext;
+
+// Returns a monotonic timestamp in nanoseconds
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Marks request number 'seq' (id seq + 1) as answered and frees its slot
+static void complete_request(BenchConn *c, const BenchConfig *cfg, Histogram *latency, uint64_t seq)
+{
+    size_t slot = seq % cfg->depth;
+    hist_record(latency, now_ns() - c->start_ns[slot]);
+    c->slot_id[slot] = 0;
+    c->done++;
+
+    // Move past every request answered so far, replies may have completed newer ones first
+    while (c->oldest < c->sent && c->slot_id[c->oldest % cfg->depth] != (uint32_t)(c->oldest + 1))
+    {
+        c->oldest++;
+    }
+}
+
+// Framed replies carry the request id, id 0 is the server banner
+// A reply is charged to the request with its id; one that names no request in flight is only
+// counted, so a confused server shows up in the report instead of in the latencies
+static int reply_end(void *ctx, const FrameHeader *h)
+{
+    ReplyContext *rc = ctx;
+    BenchConn *c = rc->conn;
+    if (h->id == 0)
+    {
+        return 0;
+    }
+
+    uint64_t seq = h->id - 1;
+    if (c->slot_id[seq % rc->cfg->depth] != h->id)
+    {
+        c->unmatched++;
+        return 0;
+    }
+    if (seq != c->oldest)
+    {
+        c->out_of_order++;
+    }
+    complete_request(c, rc->cfg, rc->latency, seq);
+    return 0;
+}
+
+// Reads every available reply byte and completes the matching requests
+// Returns 0 on success, -1 when the connection failed
+static int bench_receive(BenchConn *c, const BenchConfig *cfg, Histogram *latency, char *buf)
+{
+    static const FrameHandler handler = { NULL, NULL, reply_end };
+    ReplyContext rc = { c, cfg, latency };
+
+    while (1)
+    {
+        ssize_t r = read(c->client->socket, buf, BENCH_READ_CHUNK);
+        if (r == 0)
+        {
+            fprintf(stderr, "bench: server closed a connection\n");
+            return -1;
+        }
+        if (r == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN ? 0 : -1;
+        }
+
+        if (c->client->framed)
+        {
+            if (frame_feed(&c->dec, buf, r, &handler, &rc) == -1)
+            {
+                fprintf(stderr, "bench: malformed frame from server\n");
+                return -1;
+            }
+            continue;
+        }
+
+        // Raw replies have the same length as the requests, so byte counts identify them
+        size_t skip = (size_t)r < c->banner_left ? (size_t)r : c->banner_left;
+        c->banner_left -= skip;
+        c->rx_bytes += r - skip;
+        while (c->done < c->sent && c->rx_bytes >= (c->done + 1) * cfg->size)
+        {
+            complete_request(c, cfg, latency, c->done);
+        }
+    }
+}
+
+// Writes requests until the pipeline is full, the socket is full or all were sent
+// Returns 0 on success, -1 when the connection failed
+static int bench_send(BenchConn *c, const BenchConfig *cfg, const char *payload)
+{
+    size_t hdr_len = c->client->framed ? FRAME_HEADER_LEN : 0;
+    size_t msg_len = hdr_len + cfg->size;
+
+    while (1)
+    {
+        if (c->msg_off == 0)
+        {
+            // Start the next request only when the pipeline has room for it and its slot is free
+            // (an unanswered older request keeps its slot even when newer replies came back)
+            size_t slot = c->sent % cfg->depth;
+            if (c->sent >= cfg->requests || c->sent - c->done >= (uint64_t)cfg->depth || c->slot_id[slot] != 0)
+            {
+                return 0;
+            }
+            if (hdr_len)
+            {
+                frame_encode_header(c->hdr, FRAME_DATA, (uint32_t)(c->sent + 1), cfg->size);
+            }
+            c->start_ns[slot] = now_ns();
+            c->slot_id[slot] = (uint32_t)(c->sent + 1);
+        }
+
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (c->msg_off < hdr_len)
+        {
+            iov[iovcnt].iov_base = c->hdr + c->msg_off;
+            iov[iovcnt].iov_len = hdr_len - c->msg_off;
+            iovcnt++;
+        }
+        size_t payload_off = c->msg_off > hdr_len ? c->msg_off - hdr_len : 0;
+        iov[iovcnt].iov_base = (char *)payload + payload_off;
+        iov[iovcnt].iov_len = cfg->size - payload_off;
+        iovcnt++;
+
+        ssize_t w = writev(c->client->socket, iov, iovcnt);
+        if (w == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN ? 0 : -1;
+        }
+
+        c->msg_off += w;
+        if (c->msg_off == msg_len)
+        {
+            c->msg_off = 0;
+            c->sent++;
+        }
+    }
+}
+
+// Parses the benchmark options, the transport options are left to create_client()
+static void parse_bench_args(char **args, BenchConfig *cfg)
+{
+    cfg->connections = 16;
+    cfg->size = 64;
+    cfg->depth = 1;
+    cfg->requests = 10000;
+
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        if (args[i + 1] == NULL)
+        {
+            break;
+        }
+        if (strcmp(args[i], "-n") == 0)
+        {
+            cfg->connections = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-s") == 0)
+        {
+            cfg->size = strtoul(args[++i], NULL, 10);
+        }
+        else if (strcmp(args[i], "-d") == 0)
+        {
+            cfg->depth = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-r") == 0)
+        {
+            cfg->requests = strtoull(args[++i], NULL, 10);
+        }
+    }
+
+    if (cfg->connections < 1 || cfg->size < 1 || cfg->depth < 1 || cfg->requests < 1)
+    {
+        fprintf(stderr, "bench: -n, -s, -d and -r must be positive\n");
+        exit(1);
+    }
+}
+
+// Runs the benchmark described by the command-line arguments
+void run_benchmark(char **args)
+{
+    BenchConfig cfg;
+    Histogram *setup = malloc(sizeof(Histogram));
+    Histogram *latency = malloc(sizeof(Histogram));
+    BenchConn *conns;
+    char *payload;
+    char *buf;
+
+    parse_bench_args(args, &cfg);
+    conns = calloc(cfg.connections, sizeof(BenchConn));
+    payload = malloc(cfg.size);
+    buf = malloc(BENCH_READ_CHUNK);
+    if (!setup || !latency || !conns || !payload || !buf)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    hist_init(setup);
+    hist_init(latency);
+
+    // Lower-case text, so the server really has something to transform
+    for (size_t i = 0; i < cfg.size; i++)
+    {
+        payload[i] = 'a' + i % 26;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1)
+    {
+        perror("epoll_create1");
+        exit(1);
+    }
+
+    // Step 1: Open every connection, timing each connect()
+    uint64_t setup_start = now_ns();
+    int time_limit = 60;
+    for (int i = 0; i < cfg.connections; i++)
+    {
+        BenchConn *c = &conns[i];
+        c->client = create_client(args);
+        c->client->quiet = 1;
+        time_limit = c->client->time_limit;
+
+        uint64_t t0 = now_ns();
+        bind_client_socket(c->client);
+        hist_record(setup, now_ns() - t0);
+
+        int flags = fcntl(c->client->socket, F_GETFL, 0);
+        fcntl(c->client->socket, F_SETFL, flags | O_NONBLOCK);
+
+        c->start_ns = calloc(cfg.depth, sizeof(uint64_t));
+        c->slot_id = calloc(cfg.depth, sizeof(uint32_t));
+        c->banner_left = c->client->framed ? 0 : strlen(SERVER_BANNER);
+        if (!c->start_ns || !c->slot_id)
+        {
+            perror("calloc");
+            exit(1);
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = c;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->client->socket, &ev) == -1)
+        {
+            perror("epoll_ctl");
+            exit(1);
+        }
+    }
+    double setup_ms = (now_ns() - setup_start) / 1e6;
+
+    // Step 2: Drive all connections from one event loop until every request is answered
+    struct epoll_event events[BENCH_MAX_EVENTS];
+    int remaining = cfg.connections;
+    uint64_t run_start = now_ns();
+
+    while (remaining > 0)
+    {
+        int n = epoll_wait(epfd, events, BENCH_MAX_EVENTS, time_limit * 1000);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        if (n == 0)
+        {
+            fprintf(stderr, "bench: no progress for %d seconds, giving up (%d connections unfinished)\n",
+                    time_limit, remaining);
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            BenchConn *c = events[i].data.ptr;
+            if (c->done >= cfg.requests)
+            {
+                continue;
+            }
+
+            // Replies free pipeline slots, so receive first and refill afterwards
+            if (bench_receive(c, &cfg, latency, buf) == -1 || bench_send(c, &cfg, payload) == -1)
+            {
+                fprintf(stderr, "bench: connection failed after %llu requests\n", (unsigned long long)c->done);
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c->client->socket, NULL);
+                c->done = cfg.requests;
+                remaining--;
+                continue;
+            }
+            if (c->done >= cfg.requests)
+            {
+                remaining--;
+            }
+        }
+    }
+    double run_sec = (now_ns() - run_start) / 1e9;
+
+    // Step 3: Report
+    printf("Benchmark: %d connections, %zu B payload, pipeline depth %d, %llu requests/connection, %s protocol\n",
+           cfg.connections, cfg.size, cfg.depth, (unsigned long long)cfg.requests,
+           conns[0].client->framed ? "framed" : "raw");
+    printf("Connection setup: %.2f ms total, mean %.1f us, p99 %.1f us, max %.1f us\n",
+           setup_ms, hist_mean(setup) / 1e3, hist_percentile(setup, 99) / 1e3, setup->max / 1e3);
+    printf("Completed: %llu requests in %.3f s\n", (unsigned long long)latency->total, run_sec);
+    printf("Throughput: %.0f req/s, %.2f MB/s payload each way\n",
+           latency->total / run_sec, latency->total * (double)cfg.size / run_sec / 1e6);
+    printf("Latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f  mean %.1f\n",
+           hist_percentile(latency, 50) / 1e3, hist_percentile(latency, 90) / 1e3,
+           hist_percentile(latency, 99) / 1e3, hist_percentile(latency, 99.9) / 1e3,
+           latency->max / 1e3, hist_mean(latency) / 1e3);
+    if (conns[0].client->framed)
+    {
+        uint64_t out_of_order = 0, unmatched = 0;
+        for (int i = 0; i < cfg.connections; i++)
+        {
+            out_of_order += conns[i].out_of_order;
+            unmatched += conns[i].unmatched;
+        }
+        printf("Replies matched by id: %llu out of order, %llu unmatched\n",
+               (unsigned long long)out_of_order, (unsigned long long)unmatched);
+    }
+
+    for (int i = 0; i < cfg.connections; i++)
+    {
+        close(conns[i].client->socket);
+        free(conns[i].start_ns);
+        free(conns[i].slot_id);
+        free(conns[i].client);
+    }
+    close(epfd);
+    free(conns);
+    free(payload);
+    free(buf);
+    free(setup);
+    free(latency);
+}
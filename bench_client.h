@@ -0,0 +1,19 @@
+#ifndef BENCH_CLIENT_H
+#define BENCH_CLIENT_H
+
+// Built-in load generator ("-b" mode)
+//
+// Opens N concurrent client connections with create_client()/bind_client_socket(),
+// keeps a configurable number of requests in flight on each of them and reports
+// throughput, connection-setup time and the round-trip latency distribution.
+//
+// Options (next to the usual -p / -ip / -u / -F / -t client options):
+//   -n <connections>   Number of concurrent connections (default 16)
+//   -s <bytes>         Payload size of one request (default 64)
+//   -d <depth>         Requests in flight per connection (default 1)
+//   -r <requests>      Requests sent by each connection (default 10000)
+
+// Runs the benchmark described by the command-line arguments
+void run_benchmark(char **args);
+
+#endif // BENCH_CLIENT_H
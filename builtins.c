@@ -0,0 +1,721 @@
+#include "builtins.h"
+#include "shell.h"
+#include "client_utils.h"
+#include "cmd_hash.h"
+#include "prompt.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "server_stats.h"
+
+#include <errno.h>          // errno, EINTR
+#include <limits.h>         // PATH_MAX
+
+static const Builtin builtin_table[];
+
+// "help": Display help message, one line per registry entry
+static int builtin_help(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)argv; (void)socket;
+
+    printf("Simple Shell Help:\n");
+    for (const Builtin *b = builtin_table; b->name; b++)
+    {
+        if (b->usage && (!(b->flags & BUILTIN_CLIENT_ONLY) || isClient))
+        {
+            printf("  %s\n", b->usage);
+        }
+    }
+    printf("Supports:\n  Piping (|), Redirection (<, >), Multiple cmds (;), Background (&), Comments (#), Quotes (' \" \\)\n");
+    return 0;
+}
+
+// "hash": Show, fill or clear the command path cache
+static int builtin_hash(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+    int status = 0;
+
+    if (argc == 1) {
+        cmd_hash_print(stdout);  // List cached commands with their hit counts
+    } else if (strcmp(argv[1], "-r") == 0) {
+        cmd_hash_clear();  // Forget every cached path
+    } else if (strcmp(argv[1], "-d") == 0) {
+        for (int i = 2; i < argc; i++) cmd_hash_forget(argv[i]);  // Forget selected commands
+    } else {
+        for (int i = 1; i < argc; i++) {
+            if (!cmd_hash_lookup(argv[i])) {
+                fprintf(stderr, "hash: %s: not found\n", argv[i]);
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
+
+// "prompt": Show or replace the prompt template
+static int builtin_prompt(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+
+    if (argc == 1) {
+        printf("%s\n", prompt_get_template());
+    } else if (argc == 2) {
+        // One (usually quoted) word is the template exactly as typed, trailing spaces included
+        prompt_set_template(argv[1]);
+    } else {
+        // Re-join the words, the template may contain spaces
+        char tmpl[MAX_LINE] = {0};
+        size_t used = 0;
+        for (int i = 1; i < argc && used < sizeof(tmpl) - 1; i++) {
+            used += snprintf(tmpl + used, sizeof(tmpl) - used, "%s%s", argv[i], i < argc - 1 ? " " : "");
+        }
+        prompt_set_template(tmpl);
+    }
+    return 0;
+}
+
+// "source" / ".": Run a script file in this shell
+static int builtin_source(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc;
+
+    if (!argv[1]) {
+        fprintf(stderr, "%s: missing file name\n", argv[0]);
+        return 2;
+    }
+    return run_script(argv[1], socket, isClient) == 0 ? shell_last_status() : 1;
+}
+
+// "exit": Exit the shell, with the given status or the one of the last command
+static int builtin_exit(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+
+    fflush(stdout);
+    exit(argc > 1 ? atoi(argv[1]) : shell_last_status());
+}
+
+// "cd": Change the current directory
+static int builtin_cd(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)socket; (void)isClient;
+
+    if (!argv[1]) {
+        fprintf(stderr, "cd: missing argument\n");  // Print error if no argument
+        return 1;
+    }
+    int status = 0;
+    if (chdir(argv[1]) == -1) {
+        perror("cd");
+        status = 1;
+    }
+    prompt_invalidate_cwd();  // A \w in the prompt must show the new directory
+    return status;
+}
+
+// Joins argv[1..] with single spaces, never past the end of the buffer
+static void join_words(int argc, char **argv, char *out, size_t size)
+{
+    size_t used = 0;
+    out[0] = '\0';
+    for (int i = 1; i < argc && used < size - 1; i++) {
+        used += snprintf(out + used, size - used, "%s%s", argv[i], i < argc - 1 ? " " : "");
+    }
+}
+
+// "send": Send the words as one message to the server
+static int builtin_send(int argc, char **argv, int socket, int isClient)
+{
+    (void)isClient;
+
+    if (argv[1] == NULL) {
+        // Without words "send" is a sink: "cmd | send" or "send < file" streams stdin
+        if (!isatty(STDIN_FILENO)) {
+            return client_send_stream(socket, STDIN_FILENO);
+        }
+        printf("Error: No message provided to send.\n");
+        return 1;
+    }
+
+    // Concatenate all arguments (excluding "send")
+    char msg[MAX_MSG_LEN];
+    join_words(argc, argv, msg, sizeof(msg));
+
+    // Send the concatenated message
+    handle_user_input(socket, msg);
+    return 0;
+}
+
+// "sendfile": Stream a file to the server, the replies arrive like those of "send"
+static int builtin_sendfile(int argc, char **argv, int socket, int isClient)
+{
+    (void)isClient;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: sendfile path\n");
+        return 2;
+    }
+    return client_sendfile(socket, argv[1]);
+}
+
+// "sendbatch": Send every line of a file (or stdin for "-") as its own request, pipelined
+static int builtin_sendbatch(int argc, char **argv, int socket, int isClient)
+{
+    (void)isClient;
+
+    long window = SENDBATCH_WINDOW;
+    int quiet = 0;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strcmp(argv[i], "-q") == 0)
+        {
+            quiet = 1;
+        }
+        else if (strncmp(argv[i], "-w", 2) == 0)
+        {
+            const char *value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            window = strtol(value, NULL, 10);
+            if (window < 1)
+            {
+                fprintf(stderr, "sendbatch: -w needs a positive number\n");
+                return 2;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "sendbatch: unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (i != argc - 1)
+    {
+        fprintf(stderr, "usage: sendbatch [-w N] [-q] file|-\n");
+        return 2;
+    }
+
+    int fd = strcmp(argv[i], "-") == 0 ? STDIN_FILENO : open(argv[i], O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        perror(argv[i]);
+        return 1;
+    }
+    int status = client_sendbatch(socket, fd, window, quiet);
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    return status;
+}
+
+// "latency": Show how long the server took to answer, "-r" starts a new measurement
+static int builtin_latency(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+
+    int reset = argc > 1 && strcmp(argv[1], "-r") == 0;
+    return client_latency_report(reset);
+}
+
+// "stats": Ask a server's control socket ("-S path") for its counters, "-p" in Prometheus format
+static int builtin_stats(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+
+    int prometheus = argc > 1 && strcmp(argv[1], "-p") == 0;
+    if (argc != 2 + prometheus) {
+        fprintf(stderr, "usage: stats [-p] socket\n");
+        return 2;
+    }
+    return stats_query(argv[1 + prometheus], prometheus);
+}
+
+// "rexec": Run the words as a command line in the server's shell, output is streamed back
+static int builtin_rexec(int argc, char **argv, int socket, int isClient)
+{
+    (void)isClient;
+
+    if (argv[1] == NULL) {
+        fprintf(stderr, "usage: rexec command [args]\n");
+        return 2;
+    }
+
+    char cmd[MAX_MSG_LEN];
+    join_words(argc, argv, cmd, sizeof(cmd));
+    return client_rexec(socket, cmd);
+}
+
+// "quit": Gracefully quit the shell
+static int builtin_quit(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)argv; (void)isClient;
+
+    write(socket, "disconnecting ...\n", 19);
+    close(socket);
+
+    const char *exit_command = "exit\n";
+
+    // Write to stdin (File descriptor 0)
+    if (write(STDIN_FILENO, exit_command, strlen(exit_command)) == -1)
+    {
+        perror("Error writing to stdin");
+        exit(1);
+    }
+
+    // Optionally, you can also trigger the shell to process the exit by explicitly calling exit
+    exit(0);  // Exit the shell or program
+}
+
+// "halt": Immediately quit the shell
+static int builtin_halt(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)argv; (void)socket; (void)isClient;
+
+    kill(0, SIGTERM); // Terminate the whole process group (optional)
+    exit(1); // Final quit
+}
+
+// "echo": Print the words, "-n" leaves out the newline
+static int builtin_echo(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+    int i = 1;
+    int newline = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-n") == 0)
+    {
+        newline = 0;
+        i++;
+    }
+    for (; i < argc; i++)
+    {
+        fputs(argv[i], stdout);
+        if (i < argc - 1)
+        {
+            putchar(' ');
+        }
+    }
+    if (newline)
+    {
+        putchar('\n');
+    }
+    return ferror(stdout) ? 1 : 0;
+}
+
+// "pwd": Print the working directory
+static int builtin_pwd(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)argv; (void)socket; (void)isClient;
+    char cwd[PATH_MAX];
+
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+// "true" / "false": Only an exit status
+static int builtin_true(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)argv; (void)socket; (void)isClient;
+    return 0;
+}
+
+static int builtin_false(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)argv; (void)socket; (void)isClient;
+    return 1;
+}
+
+// Prints 's' with the backslash escapes printf(1) understands, returns 1 after "\c"
+static int print_escaped(const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '\\' || i + 1 >= len)
+        {
+            putchar(s[i]);
+            continue;
+        }
+        switch (s[++i])
+        {
+            case 'n':  putchar('\n'); break;
+            case 't':  putchar('\t'); break;
+            case 'r':  putchar('\r'); break;
+            case 'a':  putchar('\a'); break;
+            case 'b':  putchar('\b'); break;
+            case 'f':  putchar('\f'); break;
+            case 'v':  putchar('\v'); break;
+            case '\\': putchar('\\'); break;
+            case 'c':  return 1;
+            case '0':
+            {
+                // Up to three octal digits after "\0"
+                int value = 0;
+                for (int d = 0; d < 3 && i + 1 < len && s[i + 1] >= '0' && s[i + 1] <= '7'; d++)
+                {
+                    value = value * 8 + (s[++i] - '0');
+                }
+                putchar(value);
+                break;
+            }
+            default:   putchar('\\'); putchar(s[i]); break;
+        }
+    }
+    return 0;
+}
+
+// "printf": Format the arguments, the format is reused until every argument is consumed
+static int builtin_printf(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    const char *fmt = argv[1];
+    int arg = 2;
+    int status = 0;
+
+    do
+    {
+        int consumed = arg;
+        for (const char *p = fmt; *p; p++)
+        {
+            if (*p != '%')
+            {
+                // Plain text up to the next conversion, with its escapes
+                const char *next = strchrnul(p, '%');
+                if (print_escaped(p, next - p))
+                {
+                    return status;
+                }
+                p = next - 1;
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                putchar('%');
+                p++;
+                continue;
+            }
+
+            // Copy one conversion ("%-08.3d") into a spec the C printf understands
+            char spec[32];
+            size_t n = 0;
+            spec[n++] = *p++;
+            while (*p && strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 4)
+            {
+                spec[n++] = *p++;
+            }
+            if (!*p)
+            {
+                fprintf(stderr, "printf: missing format character\n");
+                return 1;
+            }
+
+            const char *value = arg < argc ? argv[arg++] : NULL;
+            char *end;
+            switch (*p)
+            {
+                case 's':
+                case 'b':
+                    if (*p == 'b')
+                    {
+                        // %b: the argument's own escapes are interpreted
+                        if (value && print_escaped(value, strlen(value)))
+                        {
+                            return status;
+                        }
+                        break;
+                    }
+                    spec[n++] = 's'; spec[n] = '\0';
+                    printf(spec, value ? value : "");
+                    break;
+                case 'c':
+                    spec[n++] = 'c'; spec[n] = '\0';
+                    printf(spec, value && *value ? *value : '\0');
+                    break;
+                case 'd':
+                case 'i':
+                {
+                    long long v = value ? strtoll(value, &end, 0) : 0;
+                    if (value && *end)
+                    {
+                        fprintf(stderr, "printf: %s: invalid number\n", value);
+                        status = 1;
+                    }
+                    spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = *p; spec[n] = '\0';
+                    printf(spec, v);
+                    break;
+                }
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                {
+                    unsigned long long v = value ? strtoull(value, &end, 0) : 0;
+                    if (value && *end)
+                    {
+                        fprintf(stderr, "printf: %s: invalid number\n", value);
+                        status = 1;
+                    }
+                    spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = *p; spec[n] = '\0';
+                    printf(spec, v);
+                    break;
+                }
+                case 'f':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                {
+                    double v = value ? strtod(value, &end) : 0;
+                    if (value && *end)
+                    {
+                        fprintf(stderr, "printf: %s: invalid number\n", value);
+                        status = 1;
+                    }
+                    spec[n++] = *p; spec[n] = '\0';
+                    printf(spec, v);
+                    break;
+                }
+                default:
+                    fprintf(stderr, "printf: %%%c: invalid conversion\n", *p);
+                    return 1;
+            }
+        }
+
+        // Stop once the format consumed nothing, or every argument was used
+        if (arg == consumed)
+        {
+            break;
+        }
+    } while (arg < argc);
+
+    return status;
+}
+
+// Evaluates a unary file or string test, returns -1 for an unknown operator
+static int test_unary(const char *op, const char *arg)
+{
+    struct stat st;
+
+    if (strcmp(op, "-n") == 0) return *arg != '\0';
+    if (strcmp(op, "-z") == 0) return *arg == '\0';
+    if (strcmp(op, "-r") == 0) return access(arg, R_OK) == 0;
+    if (strcmp(op, "-w") == 0) return access(arg, W_OK) == 0;
+    if (strcmp(op, "-x") == 0) return access(arg, X_OK) == 0;
+    if (strcmp(op, "-L") == 0 || strcmp(op, "-h") == 0) return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0' || !strchr("efdsp", op[1]))
+    {
+        return -1;
+    }
+    if (stat(arg, &st) == -1)
+    {
+        return 0;
+    }
+    switch (op[1])
+    {
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 's': return st.st_size > 0;
+        default:  return S_ISFIFO(st.st_mode);
+    }
+}
+
+// Evaluates a binary string or integer comparison, returns -1 for an unknown operator
+static int test_binary(const char *a, const char *op, const char *b)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+
+    static const char *ops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+    for (int i = 0; i < 6; i++)
+    {
+        if (strcmp(op, ops[i]) != 0)
+        {
+            continue;
+        }
+        long long x = strtoll(a, NULL, 10);
+        long long y = strtoll(b, NULL, 10);
+        switch (i)
+        {
+            case 0:  return x == y;
+            case 1:  return x != y;
+            case 2:  return x < y;
+            case 3:  return x <= y;
+            case 4:  return x > y;
+            default: return x >= y;
+        }
+    }
+    return -1;
+}
+
+// "test" / "[": Evaluate an expression, status 0 = true, 1 = false, 2 = error
+// Supports "!", one string, the unary file/string tests and the binary comparisons
+static int builtin_test(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+
+    if (strcmp(argv[0], "[") == 0)
+    {
+        if (strcmp(argv[argc - 1], "]") != 0)
+        {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    char **args = argv + 1;
+    int n = argc - 1;
+    int negate = 0;
+    while (n > 1 && strcmp(args[0], "!") == 0)
+    {
+        negate = !negate;
+        args++;
+        n--;
+    }
+
+    int result;
+    switch (n)
+    {
+        case 0:  result = 0; break;
+        case 1:  result = args[0][0] != '\0'; break;
+        case 2:  result = test_unary(args[0], args[1]); break;
+        case 3:  result = test_binary(args[0], args[1], args[2]); break;
+        default: result = -1; break;
+    }
+    if (result == -1)
+    {
+        fprintf(stderr, "%s: unsupported expression\n", argv[0]);
+        return 2;
+    }
+    return (result ^ negate) ? 0 : 1;
+}
+
+// "sleep": Wait the given (possibly fractional) number of seconds
+static int builtin_sleep(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+    char *end;
+
+    double seconds = argc > 1 ? strtod(argv[1], &end) : -1;
+    if (argc < 2 || *end || seconds < 0)
+    {
+        fprintf(stderr, "sleep: invalid time interval\n");
+        return 1;
+    }
+
+    fflush(stdout);
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+    {
+        // A signal interrupted the wait, keep sleeping for the rest
+    }
+    return 0;
+}
+
+// "jobs": List background and stopped jobs
+static int builtin_jobs(int argc, char **argv, int socket, int isClient)
+{
+    (void)argc; (void)argv; (void)socket; (void)isClient;
+    return jobs_list();
+}
+
+// "fg" / "bg": Continue a job in the foreground / background
+static int builtin_fg(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+    return jobs_fg(argc > 1 ? argv[1] : NULL);
+}
+
+static int builtin_bg(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+    return jobs_bg(argc > 1 ? argv[1] : NULL);
+}
+
+// "wait": Wait for the given jobs, or for all of them
+static int builtin_wait(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+
+    if (argc == 1)
+    {
+        return jobs_wait(NULL);
+    }
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        status = jobs_wait(argv[i]);
+    }
+    return status;
+}
+
+// "parallel": Run a command over many arguments in parallel job slots (parallel.c)
+static int builtin_parallel(int argc, char **argv, int socket, int isClient)
+{
+    (void)socket; (void)isClient;
+    return parallel_run(argc, argv);
+}
+
+// The registry, in the order "help" lists it
+static const Builtin builtin_table[] = {
+    { "cd",     builtin_cd,     0, "cd [dir]       - change directory" },
+    { "exit",   builtin_exit,   0, "exit [n]       - exit shell" },
+    { "help",   builtin_help,   BUILTIN_INLINE, "help           - show this help message" },
+    { "hash",   builtin_hash,   0, "hash [-r|-d] [cmd] - show, add or clear cached command paths" },
+    { "source", builtin_source, 0, "source file    - run the commands of a script file (also '. file')" },
+    { ".",      builtin_source, 0, NULL },
+    { "prompt", builtin_prompt, 0, "prompt [tmpl]  - show or set the prompt (\\u \\h \\H \\t \\w \\W \\$ \\n)" },
+    { "echo",   builtin_echo,   BUILTIN_INLINE, "echo [-n] args - print the arguments" },
+    { "printf", builtin_printf, BUILTIN_INLINE, "printf fmt args - print formatted arguments" },
+    { "pwd",    builtin_pwd,    BUILTIN_INLINE, "pwd            - print the working directory" },
+    { "true",   builtin_true,   BUILTIN_INLINE, "true / false   - succeed / fail" },
+    { "false",  builtin_false,  BUILTIN_INLINE, NULL },
+    { "test",   builtin_test,   BUILTIN_INLINE, "test expr      - evaluate an expression (also '[ expr ]')" },
+    { "[",      builtin_test,   BUILTIN_INLINE, NULL },
+    { "sleep",  builtin_sleep,  BUILTIN_JOB, "sleep seconds  - wait" },
+    { "jobs",   builtin_jobs,   0, "jobs           - list background and stopped jobs" },
+    { "fg",     builtin_fg,     0, "fg [%n]        - continue a job in the foreground" },
+    { "bg",     builtin_bg,     0, "bg [%n]        - continue a stopped job in the background" },
+    { "wait",   builtin_wait,   0, "wait [%n|pid]  - wait for jobs to finish" },
+    { "parallel", builtin_parallel, 0, "parallel [-j N] [-k] cmd [{}] [::: args] - run cmd for every argument (or stdin line), N at a time" },
+    { "stats",  builtin_stats,  0, "stats [-p] socket - Show a server's counters from its control socket (-p: Prometheus format)" },
+    { "quit",   builtin_quit,   0, "quit           - Gracefully quit the shell" },
+    { "halt",   builtin_halt,   0, "halt           - Immediately quit the shell" },
+    { "send",   builtin_send,   BUILTIN_CLIENT_ONLY | BUILTIN_SINK, "send [msg]     - Send a message to the server (without msg: stream stdin, 'cmd | send')" },
+    { "sendfile", builtin_sendfile, BUILTIN_CLIENT_ONLY, "sendfile path  - Stream a file to the server (zero-copy)" },
+    { "sendbatch", builtin_sendbatch, BUILTIN_CLIENT_ONLY | BUILTIN_SINK, "sendbatch [-w N] [-q] file|- - Send every line as a request, N in flight (-q: count replies only) (-F)" },
+    { "latency", builtin_latency, BUILTIN_CLIENT_ONLY, "latency [-r]   - Show reply latencies of this connection (-r: reset) (-F)" },
+    { "rexec",  builtin_rexec,  BUILTIN_CLIENT_ONLY, "rexec cmd      - Run cmd in the server's shell, its output is streamed back (-F)" },
+    { NULL,     NULL,           0, NULL },
+};
+
+// Returns the builtin called 'name', or NULL when it must be launched as a program
+const Builtin *builtin_find(const char *name, int isClient)
+{
+    for (const Builtin *b = builtin_table; b->name; b++)
+    {
+        if (strcmp(b->name, name) == 0)
+        {
+            if ((b->flags & BUILTIN_CLIENT_ONLY) && !isClient)
+            {
+                return NULL;
+            }
+            return b;
+        }
+    }
+    return NULL;
+}
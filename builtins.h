@@ -0,0 +1,34 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+// Registry of the commands the shell runs itself instead of launching a program
+//
+// Every builtin is one entry of a dispatch table, so run_command() does a single lookup
+// instead of a strcmp chain. Builtins print through stdio; the caller swaps file descriptors
+// 0 and 1 around the call for redirections and pipes, so no builtin needs a fork().
+
+// Flags of a registry entry
+#define BUILTIN_CLIENT_ONLY 0x1   // Only available in the client shell (it needs the server socket)
+#define BUILTIN_INLINE      0x2   // Never reads stdin and never changes the shell's state, so it
+                                  // also runs inside the shell when it is a pipeline stage
+#define BUILTIN_SINK        0x4   // Reads stdin and needs the shell's state ("send"): as the last
+                                  // stage of a pipeline it runs inside the shell, reading the pipe
+#define BUILTIN_JOB         0x8   // Blocks without touching the shell's state ("sleep"): always runs
+                                  // in a forked copy in the job's process group, even on its own, so
+                                  // Ctrl+C / Ctrl+Z reach it and never the shell
+
+// A builtin gets the command words and the shell context, and returns its exit status
+typedef int (*builtin_fn)(int argc, char **argv, int socket, int isClient);
+
+// One entry of the registry
+typedef struct {
+    const char *name;       // Command name as typed
+    builtin_fn fn;          // Implementation
+    int flags;              // BUILTIN_* flags
+    const char *usage;      // One line for "help"
+} Builtin;
+
+// Returns the builtin called 'name', or NULL when it must be launched as a program
+const Builtin *builtin_find(const char *name, int isClient);
+
+#endif // BUILTINS_H
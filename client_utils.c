@@ -1,5 +1,40 @@
 #include "client_utils.h"  // Header file containing definitions and functions for client operations
 #include "shell.h"         // Header file for shell-related functions used in client mode
+#include "protocol.h"      // Length-prefixed framing used with -F
+
+#include "histogram.h"     // Latencies of matched replies ("latency" builtin)
+
+#include <errno.h>          // errno, EINTR, EAGAIN
+#include <poll.h>           // poll() while a send waits for the socket or a pipe
+#include <sys/ioctl.h>      // ioctl(FIONREAD) sizes the frames of a piped "send"
+#include <sys/sendfile.h>   // sendfile() for the "sendfile" builtin
+#include <sys/stat.h>       // fstat() for the file size
+#include <sys/timerfd.h>    // Inactivity timer polled by the shell
+#include <time.h>           // clock_gettime()
+
+// Connection used by the shell builtins (send), set once the socket is connected
+static ClientConnection *active_client = NULL;
+
+// Reassembly state of framed replies
+static FrameDecoder reply_decoder;
+
+// Whether replies and requests on 's' use the framed protocol
+static int is_framed(int s)
+{
+    return active_client && active_client->socket == s && active_client->framed;
+}
+
+// Whether the transport keeps message boundaries ("-k dgram" or "-k seqpacket")
+static int sends_messages(void)
+{
+    return active_client->sock_type != SOCK_STREAM;
+}
+
+// Whether sendfile() and splice() may feed the server: a byte stream into the socket itself
+static int zero_copy_ok(void)
+{
+    return !active_client->shm && !sends_messages();
+}
 
 // Function to create and initialize a client connection structure based on command-line arguments
 ClientConnection* create_client(char **args) 
@@ -24,6 +59,7 @@ ClientConnection* create_client(char **args)
 
     // Set a default time limit (in seconds) for inactivity before disconnection
     client->time_limit = 60;
+    client->sock_type = SOCK_STREAM;  // A connection unless "-k" asks for messages
 
 
     // Parse each argument passed to the client program
@@ -53,16 +89,58 @@ ClientConnection* create_client(char **args)
             client->ip[0] = '\0';  // Clear IP field
             strncpy(client->unix_path, args[++i], MAX_UNIX_PATH - 1);  // Set UNIX socket path
         }
+        // If "-m" is provided, connect to a shared-memory server of that name
+        else if (strcmp(args[i], "-m") == 0 && args[i + 1] != NULL)
+        {
+            client->use_tcp = 0;  // The handshake runs over an abstract UNIX socket
+            client->shm = 1;
+            client->port = -1;
+            client->ip[0] = '\0';
+            strncpy(client->unix_path, args[++i], MAX_UNIX_PATH - 2);  // Name of the channel
+        }
         // If "-t" is provided, update the time limit for inactivity
         else if (strcmp(args[i], "-t") == 0 && args[i + 1] != NULL)
         {
             client->time_limit = atoi(args[++i]);  // Convert timeout to integer
         }
+        // If "-F" is provided, talk to the server with length-prefixed frames
+        else if (strcmp(args[i], "-F") == 0)
+        {
+            client->framed = 1;
+        }
+        // If "-k" is provided, pick the socket kind: every request then travels as one message
+        else if (strcmp(args[i], "-k") == 0 && args[i + 1] != NULL)
+        {
+            i++;
+            if (strcmp(args[i], "dgram") == 0)
+            {
+                client->sock_type = SOCK_DGRAM;  // UDP with -p/-ip, a UNIX datagram socket with -u
+            }
+            else if (strcmp(args[i], "seqpacket") == 0)
+            {
+                client->sock_type = SOCK_SEQPACKET;  // UNIX connection that keeps message boundaries
+            }
+            else if (strcmp(args[i], "stream") == 0)
+            {
+                client->sock_type = SOCK_STREAM;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown socket kind: %s\n", args[i]);
+                exit(1);
+            }
+        }
 
         // Move to the next argument
         i++;
     }
 
+    if (client->sock_type != SOCK_STREAM && (client->shm || (client->use_tcp && client->sock_type == SOCK_SEQPACKET)))
+    {
+        fprintf(stderr, "Seqpacket sockets (-k seqpacket) need -u, datagrams -p/-ip or -u\n");
+        exit(1);
+    }
+
     // Return pointer to initialized client structure
     return client;
 }
@@ -77,8 +155,8 @@ void bind_client_socket(ClientConnection *client)
     {
         struct sockaddr_in addr;  // Structure to hold TCP socket info
 
-        // Create a TCP socket (IPv4, stream-based)
-        s = socket(AF_INET, SOCK_STREAM, 0);
+        // Create a TCP socket (IPv4, stream-based), or a UDP one with "-k dgram"
+        s = socket(AF_INET, client->sock_type, 0);
         if (s == -1) 
         {
             perror("socket");  // Handle socket creation error
@@ -92,7 +170,11 @@ void bind_client_socket(ClientConnection *client)
         addr.sin_port = htons(client->port);  // Set port (convert to network byte order)
 
         // Attempt to connect to the server using TCP
-        printf("Running as TCP client, connecting to %s:%d...\n", client->ip, client->port);
+        if (!client->quiet)
+        {
+            printf("Running as %s client, connecting to %s:%d...\n", client->sock_type == SOCK_DGRAM ? "UDP" : "TCP",
+                   client->ip, client->port);
+        }
         if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) == -1) 
         {
             perror("connect");  // Handle connection error
@@ -104,128 +186,1020 @@ void bind_client_socket(ClientConnection *client)
         struct sockaddr_un addr;  // Structure to hold UNIX socket info
 
         // Create a UNIX domain socket
-        s = socket(AF_UNIX, SOCK_STREAM, 0);
+        s = socket(AF_UNIX, client->sock_type, 0);
         if (s == -1) 
         {
             perror("socket");  // Handle socket creation error
             exit(1);
         }
 
+        // A datagram socket needs an address of its own for the replies: an autobound abstract one
+        sa_family_t family = AF_UNIX;
+        if (client->sock_type == SOCK_DGRAM && bind(s, (struct sockaddr *)&family, sizeof(family)) == -1)
+        {
+            perror("bind");
+            exit(1);
+        }
+
         // Clear and set UNIX socket address structure
+        socklen_t addr_len = sizeof(addr);
         memset(&addr, 0, sizeof(addr));
         addr.sun_family = AF_UNIX;  // Use UNIX domain
-        strncpy(addr.sun_path, client->unix_path, sizeof(addr.sun_path) - 1);  // Set path
+        if (client->shm)
+        {
+            // The server's abstract name (leading NUL)
+            strncpy(addr.sun_path + 1, client->unix_path, sizeof(addr.sun_path) - 2);
+            addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(client->unix_path);
+        }
+        else
+        {
+            strncpy(addr.sun_path, client->unix_path, sizeof(addr.sun_path) - 1);  // Set path
+        }
 
         // Attempt to connect to the UNIX socket
-        printf("Running as UNIX client, connecting to %s...\n", client->unix_path);
-        if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) == -1) 
+        if (!client->quiet)
+        {
+            printf("Running as %s client, connecting to %s...\n",
+                   client->shm ? "shared-memory" :
+                   client->sock_type == SOCK_DGRAM ? "UNIX datagram" :
+                   client->sock_type == SOCK_SEQPACKET ? "UNIX seqpacket" : "UNIX", client->unix_path);
+        }
+        if (connect(s, (struct sockaddr*)&addr, addr_len) == -1) 
         {
             perror("connect");  // Handle connection error
             exit(2);
         }
+
+        // With -m the server answers with the rings, the socket carries no data after that
+        if (client->shm && shm_channel_connect(&client->channel, s) == -1)
+        {
+            perror("shm");
+            exit(2);
+        }
     }
 
     // Save the created socket in the client structure for future use
     client->socket = s;
+    client->next_id = 1;  // Id 0 is reserved for the server banner
+    active_client = client;
 }
 
-// Utility function to initialize the file descriptor set for select()
-void init_fd_set(int s, fd_set *rs) 
+// Nanoseconds on the monotonic clock, for latencies and the inactivity timer
+static uint64_t now_ns(void)
 {
-    FD_ZERO(rs);      // Clear the set
-    FD_SET(0, rs);    // Add stdin (file descriptor 0) for keyboard input
-    FD_SET(s, rs);    // Add server socket for incoming data
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
-// Handles the server’s response received through the socket
-void handle_server_response(int s) 
+// Request bookkeeping of the client
+// Framed replies carry their request's id and come back in request order, so the send time of
+// every outstanding request sits in a ring indexed by id; raw replies are exactly as long as
+// their request, so counting bytes tells whether answers are still on the way
+static uint64_t sent_at[CLIENT_MAX_INFLIGHT];   // Send time of request 'id' at id % CLIENT_MAX_INFLIGHT
+static unsigned int replies_done = 0;           // Framed requests answered so far
+static uint64_t raw_outstanding = 0;            // Raw bytes sent but not echoed yet
+static Histogram latency;                       // Request -> reply latencies (ns)
+static uint64_t last_activity = 0;              // Last time the server sent something
+
+// Takes the id for a new framed request and remembers when it left
+static uint32_t take_request_id(void)
 {
-    char msg[MAX_MSG_LEN];  // Buffer to hold received message
-    int r = read(s, msg, sizeof(msg) - 1);  // Read from socket
+    uint32_t id = active_client->next_id++;
+    sent_at[id % CLIENT_MAX_INFLIGHT] = now_ns();
+    return id;
+}
 
-    // If data was received
-    if (r > 0) 
+// A framed request was answered: record its latency, unless its slot was reused meanwhile
+static void complete_request(uint32_t id)
+{
+    if (id == 0)
     {
-        msg[r] = '\0';  // Null-terminate the message
+        return;  // The banner answers no request
+    }
+    replies_done++;
+    if (active_client->next_id - id <= CLIENT_MAX_INFLIGHT)
+    {
+        hist_record(&latency, now_ns() - sent_at[id % CLIENT_MAX_INFLIGHT]);
+    }
+}
+
+// Whether requests still wait for their replies
+static int requests_outstanding(void)
+{
+    if (active_client->framed)
+    {
+        return replies_done != active_client->next_id - 1;
+    }
+    return raw_outstanding > 0;
+}
+
+// Set while "sendbatch -q" runs: DATA replies are counted but not printed
+static int quiet_replies = 0;
+
+// Exit status of a "rexec" command, collected from its EXIT frame
+static unsigned char exit_payload[4];
+static size_t exit_have = 0;
+
+// Prints the payload of a framed reply as it arrives
+// A remote command's stderr goes to our stderr, everything else to stdout
+static int print_reply_payload(void *ctx, const FrameHeader *h, char *data, size_t len)
+{
+    (void)ctx;
+    if (h->type == FRAME_EXIT)
+    {
+        size_t take = len < sizeof(exit_payload) - exit_have ? len : sizeof(exit_payload) - exit_have;
+        memcpy(exit_payload + exit_have, data, take);
+        exit_have += take;
+        return 0;
+    }
+    if (h->type != FRAME_DATA || !quiet_replies)
+    {
+        write(h->type == FRAME_STDERR ? 2 : 1, data, len);
+    }
+    return 0;
+}
+
+// Terminates a framed reply
+// A DATA payload itself carries no newline, command output keeps its own,
+// a failed remote command is reported with its status
+static int end_reply(void *ctx, const FrameHeader *h)
+{
+    (void)ctx;
+    if (h->type == FRAME_DATA)
+    {
+        if (!quiet_replies)
+        {
+            write(1, "\n", 1);
+        }
+        complete_request(h->id);
+    }
+    else if (h->type == FRAME_EXIT)
+    {
+        uint32_t status;
+        memcpy(&status, exit_payload, sizeof(status));
+        status = exit_have == sizeof(status) ? ntohl(status) : 1;
+        exit_have = 0;
+        if (status != 0)
+        {
+            fprintf(stderr, "rexec: exit status %u\n", status);
+        }
+        complete_request(h->id);
+    }
+    return 0;
+}
+
+// Stops using the connection: it is no longer polled and later sends are refused
+// The descriptor stays open until the client exits, so its number cannot be reused meanwhile
+static void disconnect(const char *reason)
+{
+    if (!active_client->connected)
+    {
+        return;
+    }
+    printf("%s\n", reason);
+    fflush(stdout);
+    shell_unwatch_fd(active_client->socket);
+    shell_unwatch_fd(active_client->timer_fd);
+    if (active_client->shm)
+    {
+        shell_unwatch_fd(active_client->channel.wake_fd);
+    }
+    active_client->connected = 0;
+}
+
+// Handles the server's responses: reads the non-blocking socket (or the reply ring) until it is drained
+// Returns 0 while connected, -1 once the server went away
+int handle_server_response(int s)
+{
+    static const FrameHandler reply_handler = { NULL, print_reply_payload, end_reply };
+    char msg[CLIENT_READ_CHUNK];  // Buffer to hold received data
+
+    if (active_client->shm)
+    {
+        shm_channel_ack(&active_client->channel);  // Before reading, so no wakeup gets lost
+    }
+
+    while (active_client->connected)
+    {
+        ssize_t r = active_client->shm ? shm_channel_read(&active_client->channel, msg, sizeof(msg))
+                                       : read(s, msg, sizeof(msg));
+        if (r == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (r == -1 && errno == EAGAIN)
+        {
+            return 0;
+        }
+        if (r == 0 && active_client->sock_type == SOCK_DGRAM)
+        {
+            continue;  // An empty datagram, not the end of anything
+        }
+        if (r <= 0)
+        {
+            // If no data received, assume server disconnected
+            disconnect("Server closed connection.");
+            break;
+        }
+        last_activity = now_ns();
+
+        if (active_client->framed)
+        {
+            // Strip the frame headers, a reply may span several reads
+            if (frame_feed(&reply_decoder, msg, r, &reply_handler, NULL) == -1)
+            {
+                disconnect("Malformed frame from server.");
+            }
+            continue;
+        }
+
+        raw_outstanding = raw_outstanding > (uint64_t)r ? raw_outstanding - r : 0;
         printf("\n");
+        fflush(stdout);
         write(1, msg, r);  // Write the message to stdout
     }
-    else 
+    return -1;
+}
+
+// Shell watch handler of the socket (of the ring wakeup with -m)
+static void on_socket_ready(int fd, void *ctx)
+{
+    ClientConnection *client = ctx;
+    (void)fd;
+    handle_server_response(client->socket);
+}
+
+// With -m the socket carries no data: readable means the server went away
+// Replies it left in the ring are printed first
+static int check_hangup(int s)
+{
+    char byte;
+    if (handle_server_response(s) == -1)
+    {
+        return -1;
+    }
+    if (recv(s, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == -1 && (errno == EAGAIN || errno == EINTR))
+    {
+        return 0;
+    }
+    disconnect("Server closed connection.");
+    return -1;
+}
+
+// Shell watch handler of the socket with -m
+static void on_hangup(int fd, void *ctx)
+{
+    (void)ctx;
+    check_hangup(fd);
+}
+
+// Descriptors announcing server activity: the socket, or with -m the ring wakeup and the socket
+// Returns how many were filled in
+static int server_pollfds(int s, struct pollfd *p)
+{
+    p[0].fd = active_client->shm ? active_client->channel.wake_fd : s;
+    p[0].events = POLLIN;
+    p[0].revents = 0;
+    p[1].fd = s;
+    p[1].events = POLLIN;
+    p[1].revents = 0;
+    return active_client->shm ? 2 : 1;
+}
+
+// Handles what poll() reported for server_pollfds()
+// Returns 0 while connected, -1 once the server went away
+static int server_ready(int s, const struct pollfd *p, int n)
+{
+    if ((p[0].revents & (POLLIN | POLLHUP | POLLERR)) && handle_server_response(s) == -1)
+    {
+        return -1;
+    }
+    if (n > 1 && p[1].revents && check_hangup(s) == -1)
+    {
+        return -1;
+    }
+    return active_client->connected ? 0 : -1;
+}
+
+// Shell watch handler of the inactivity timer: the timer is re-armed for the rest of the period
+// instead of on every reply, so a busy connection costs no timerfd_settime() calls
+static void on_timer(int fd, void *ctx)
+{
+    ClientConnection *client = ctx;
+    uint64_t expirations;
+    uint64_t limit = (uint64_t)client->time_limit * 1000000000ull;
+    uint64_t idle = now_ns() - last_activity;
+
+    if (read(fd, &expirations, sizeof(expirations)) == -1 && errno == EAGAIN)
+    {
+        return;
+    }
+    if (idle >= limit)
+    {
+        char reason[64];
+        snprintf(reason, sizeof(reason), "\nNo activity for %d seconds. Closing connection.", client->time_limit);
+        disconnect(reason);
+        return;
+    }
+
+    struct itimerspec its = { { 0, 0 }, { (limit - idle) / 1000000000ull, (limit - idle) % 1000000000ull } };
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+// Waits until the socket takes more bytes, handling replies that arrive meanwhile,
+// so a long upload never deadlocks against the server's output
+// Returns 0 when writable, -1 when the server went away
+static int wait_writable(int s)
+{
+    while (active_client->connected)
+    {
+        struct pollfd p[2];
+        int n = server_pollfds(s, p);
+        if (!active_client->shm)
+        {
+            p[0].events |= POLLOUT;
+        }
+        if (poll(p, n, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (server_ready(s, p, n) == -1)
+        {
+            return -1;
+        }
+        // With -m the wakeup also means the server consumed from the full ring
+        if (p[0].revents & (active_client->shm ? POLLIN : POLLOUT | POLLERR | POLLHUP))
+        {
+            return 0;  // Errors are reported by the next write
+        }
+    }
+    return -1;
+}
+
+// Refuses to send once the connection is gone
+static int check_connected(void)
+{
+    if (!active_client->connected)
     {
-        // If no data received, assume server disconnected
-        printf("Server closed connection.\n");
-        close(s);  // Close client-side socket
+        fprintf(stderr, "Not connected to the server.\n");
+        return -1;
     }
+    return 0;
 }
 
-// Handles background communication from server while user interacts with shell
+// Writes a whole iovec array to the non-blocking socket (the array is modified)
+// Returns 0 on success, -1 on an error
+static int send_all(int s, struct iovec *iov, int iovcnt, int flags)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t w;
+        if (active_client->shm)
+        {
+            // Copied into the ring, a full ring waits for the server to consume
+            w = shm_channel_writev(&active_client->channel, iov, iovcnt);
+            if (w == 0)
+            {
+                if (check_connected() == -1 || wait_writable(s) == -1)
+                {
+                    errno = EPIPE;
+                    return -1;
+                }
+                continue;
+            }
+        }
+        else
+        {
+            struct msghdr mh = { 0 };
+            mh.msg_iov = iov;
+            mh.msg_iovlen = iovcnt;
+
+            // MSG_NOSIGNAL: a vanished server is an error here, not a SIGPIPE for the shell
+            w = sendmsg(s, &mh, flags | MSG_NOSIGNAL);
+        }
+        if (w == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN && wait_writable(s) == 0)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        while (iovcnt > 0 && (size_t)w >= iov->iov_len)
+        {
+            w -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+// Sends one request: a DATA frame with -F, the bare bytes otherwise
+// A message transport takes at most CLIENT_DGRAM_MAX bytes per message, longer text becomes several requests
+static int send_message(int s, const char *data, size_t len)
+{
+    unsigned char hdr[FRAME_HEADER_LEN];
+    struct iovec iov[2];
+    int n = 0;
+
+    size_t limit = CLIENT_DGRAM_MAX - (is_framed(s) ? FRAME_HEADER_LEN : 0);
+    while (sends_messages() && len > limit)
+    {
+        if (send_message(s, data, limit) == -1)
+        {
+            return -1;
+        }
+        data += limit;
+        len -= limit;
+    }
+
+    if (is_framed(s))
+    {
+        frame_encode_header(hdr, FRAME_DATA, take_request_id(), len);
+        iov[n].iov_base = hdr;
+        iov[n].iov_len = sizeof(hdr);
+        n++;
+    }
+    else
+    {
+        raw_outstanding += len;
+    }
+    iov[n].iov_base = (void *)data;
+    iov[n].iov_len = len;
+    n++;
+    return send_all(s, iov, n, 0);
+}
+
+// Runs the client: a single process, the shell's input loop also polls the server socket and an
+// inactivity timer, so replies are printed while the prompt waits and nothing races on stdout
 void handle_client_background(ClientConnection *client) 
 {
-    pid_t pid = fork();  // Create a child process
+    // Reads never block the shell: the socket is drained until EAGAIN whenever it is readable
+    int flags = fcntl(client->socket, F_GETFL, 0);
+    if (flags == -1 || fcntl(client->socket, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        perror("fcntl");
+        exit(1);
+    }
 
-    // Handle fork failure
-    if (pid == -1) 
+    client->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (client->timer_fd == -1)
     {
-        perror("fork failed");
+        perror("timerfd_create");
         exit(1);
-    } 
-    // Parent process will handle user shell
-    else if (pid > 0) 
+    }
+    struct itimerspec its = { { 0, 0 }, { client->time_limit, 0 } };
+    timerfd_settime(client->timer_fd, 0, &its, NULL);
+
+    hist_init(&latency);
+    last_activity = now_ns();
+    client->connected = 1;
+    if (client->shm)
     {
-        run_shell(client->socket, 1);  // Launch shell in client mode
-    } 
-    // Child process handles asynchronous server responses
-    else 
+        shell_watch_fd(client->channel.wake_fd, on_socket_ready, client);
+        shell_watch_fd(client->socket, on_hangup, client);
+    }
+    else
     {
-        fd_set rs;  // Read set for select()
-        struct timeval timeout;  // Timeout interval for inactivity
+        shell_watch_fd(client->socket, on_socket_ready, client);
+    }
+    shell_watch_fd(client->timer_fd, on_timer, client);
 
-        while (1) 
+    run_shell(client->socket, 1);  // Launch shell in client mode
+
+    // End of input: replies that are still on the way get printed before leaving
+    uint64_t deadline = now_ns() + (uint64_t)client->time_limit * 1000000000ull;
+    while (client->connected && requests_outstanding())
+    {
+        uint64_t now = now_ns();
+        if (now >= deadline)
+        {
+            break;
+        }
+        struct pollfd p[2];
+        int n = server_pollfds(client->socket, p);
+        if (poll(p, n, (deadline - now) / 1000000 + 1) > 0)
+        {
+            server_ready(client->socket, p, n);
+        }
+    }
+
+    if (client->shm)
+    {
+        shm_channel_close(&client->channel);
+    }
+    close(client->timer_fd);
+    close(client->socket);
+}
+
+// Sends user input (a message string) to the server through the socket
+void handle_user_input(int s, const char *msg) 
+{
+    if (msg != NULL && check_connected() == 0)
+    {
+        // With -F one frame per message, the server answers with the same id
+        if (send_message(s, msg, strlen(msg)) == -1)
+        {
+            perror("send");
+        }
+    }
+}
+
+// Runs a command line on the server, its output arrives through handle_server_response()
+int client_rexec(int s, const char *cmd)
+{
+    if (!is_framed(s))
+    {
+        fprintf(stderr, "rexec: needs the framed protocol (connect with -F)\n");
+        return 1;
+    }
+    if (sends_messages())
+    {
+        fprintf(stderr, "rexec: not available over datagram or seqpacket sockets\n");
+        return 1;
+    }
+    if (strlen(cmd) > FRAME_EXEC_MAX)
+    {
+        fprintf(stderr, "rexec: command too long\n");
+        return 1;
+    }
+    if (check_connected() == -1)
+    {
+        return 1;
+    }
+
+    unsigned char hdr[FRAME_HEADER_LEN];
+    struct iovec iov[2] = { { hdr, sizeof(hdr) }, { (void *)cmd, strlen(cmd) } };
+    frame_encode_header(hdr, FRAME_EXEC, take_request_id(), strlen(cmd));
+    if (send_all(s, iov, 2, 0) == -1)
+    {
+        perror("rexec");
+        return 1;
+    }
+    return 0;
+}
+
+// Sends a DATA frame header announcing 'len' bytes; MSG_MORE lets it leave with the payload
+static int send_data_header(int s, uint64_t len)
+{
+    unsigned char hdr[FRAME_HEADER_LEN];
+    struct iovec iov = { hdr, sizeof(hdr) };
+    frame_encode_header(hdr, FRAME_DATA, take_request_id(), len);
+    return send_all(s, &iov, 1, MSG_MORE);
+}
+
+// Sends bytes [offset, end) of a regular file with sendfile(), as one frame when framed
+// Returns 0 on success, -1 on a socket error
+static int send_file_range(int s, int fd, off_t offset, off_t end)
+{
+    if (is_framed(s))
+    {
+        if (send_data_header(s, end - offset) == -1)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        raw_outstanding += end - offset;
+    }
+
+    while (offset < end)
+    {
+        ssize_t n = sendfile(s, fd, &offset, end - offset);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN && wait_writable(s) == 0)
+        {
+            continue;
+        }
+        if (n == -1)
+        {
+            return -1;
+        }
+        if (n == 0)
+        {
+            // The file shrank while being sent: pad the announced length so the stream stays in sync
+            static const char zeros[4096];
+            size_t pad = end - offset < (off_t)sizeof(zeros) ? end - offset : sizeof(zeros);
+            struct iovec iov = { (void *)zeros, pad };
+            if (send_all(s, &iov, 1, 0) == -1)
+            {
+                return -1;
+            }
+            offset += pad;
+        }
+    }
+    return 0;
+}
+
+// Reads a descriptor and forwards it chunk by chunk until EOF (one frame per chunk with -F)
+// The rings of -m and message sockets have no copy-free path from a file, a byte stream uses it
+// only for sockets and devices
+// Returns 0 on success, -1 on an error
+static int send_by_reading(int s, int fd)
+{
+    char buf[SEND_SPLICE_CHUNK];
+    ssize_t n;
+    int rc = 0;
+
+    while (rc == 0 && (n = read(fd, buf, sizeof(buf))) != 0)
+    {
+        if (n == -1)
+        {
+            rc = errno == EINTR ? 0 : -1;
+            continue;
+        }
+        rc = send_message(s, buf, n);
+    }
+    return rc;
+}
+
+// Streams a whole file to the server with sendfile(), the bytes never enter user space
+int client_sendfile(int s, const char *path)
+{
+    struct stat st;
+
+    if (check_connected() == -1)
+    {
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        perror(path);
+        return 1;
+    }
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        fprintf(stderr, "sendfile: %s: not a regular file\n", path);
+        close(fd);
+        return 1;
+    }
+
+    int rc = zero_copy_ok() ? send_file_range(s, fd, 0, st.st_size) : send_by_reading(s, fd);
+    if (rc == -1)
+    {
+        perror("sendfile");
+    }
+    close(fd);
+    return rc == -1;
+}
+
+// Moves a pipe into the socket with splice() until its writers are gone
+// Every chunk the pipe holds is sized by FIONREAD first (one frame each with -F); replies are
+// handled while waiting for the pipe, so the server's output never backs up into our upload
+// Returns 0 on success, -1 on an error
+static int send_pipe(int s, int fd)
+{
+    while (active_client->connected)
+    {
+        struct pollfd p[2] = {
+            { fd, POLLIN, 0 },
+            { s, POLLIN, 0 },
+        };
+        int avail = 0;
+
+        if (poll(p, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if ((p[1].revents & POLLIN) && handle_server_response(s) == -1)
+        {
+            return -1;
+        }
+        if (p[0].revents == 0)
+        {
+            continue;
+        }
+        if (ioctl(fd, FIONREAD, &avail) == -1)
+        {
+            return -1;
+        }
+        if (avail == 0)
+        {
+            if (p[0].revents & (POLLHUP | POLLERR))
+            {
+                return 0;  // Drained and every writer closed its end
+            }
+            continue;
+        }
+
+        if (is_framed(s))
+        {
+            if (send_data_header(s, avail) == -1)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            raw_outstanding += avail;
+        }
+        while (avail > 0)
+        {
+            ssize_t n = splice(fd, NULL, s, NULL, avail, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n == -1 && errno == EAGAIN && wait_writable(s) == 0)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return -1;  // The announced bytes were in the pipe, so this is a socket error
+            }
+            avail -= n;
+        }
+    }
+    return -1;
+}
+
+// Streams a descriptor to the server until EOF, picking the copy-free path its type allows
+int client_send_stream(int s, int fd)
+{
+    struct stat st;
+    int rc;
+
+    if (check_connected() == -1)
+    {
+        return 1;
+    }
+    if (fstat(fd, &st) == -1)
+    {
+        perror("send");
+        return 1;
+    }
+
+    if (!zero_copy_ok())
+    {
+        rc = send_by_reading(s, fd);  // Copied into the rings or into messages, whatever the source
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+        // "send < file": the rest of the file from the current position
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        rc = send_file_range(s, fd, pos == -1 ? 0 : pos, st.st_size);
+        lseek(fd, 0, SEEK_END);
+    }
+    else if (S_ISFIFO(st.st_mode))
+    {
+        rc = send_pipe(s, fd);  // "cmd | send"
+    }
+    else
+    {
+        rc = send_by_reading(s, fd);  // Anything else (sockets, devices)
+    }
+
+    if (rc == -1)
+    {
+        perror("send");
+    }
+    return rc == -1;
+}
+
+// Handles replies until at most 'limit' requests are outstanding
+// Returns 0, or -1 when the server went away or stayed silent for the time limit
+static int wait_outstanding(int s, unsigned int limit)
+{
+    while (active_client->connected && active_client->next_id - 1 - replies_done > limit)
+    {
+        struct pollfd p[2];
+        int n = server_pollfds(s, p);
+        int r = poll(p, n, active_client->time_limit * 1000);
+        if (r == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (r <= 0)
+        {
+            fprintf(stderr, "sendbatch: no reply for %d seconds\n", active_client->time_limit);
+            return -1;
+        }
+        if (server_ready(s, p, n) == -1)
+        {
+            return -1;
+        }
+    }
+    return active_client->connected ? 0 : -1;
+}
+
+// Messages of "sendbatch" waiting for the next writev: a frame header and a line each
+typedef struct {
+    struct iovec iov[SENDBATCH_IOV];
+    unsigned char hdrs[SENDBATCH_IOV / 2][FRAME_HEADER_LEN];
+    int count;      // Queued messages (two iovecs each)
+} Batch;
+
+// Sends the queued requests as one message each, as many per sendmmsg() as the socket takes
+static int send_batch_messages(int s, Batch *b)
+{
+    struct mmsghdr msgs[SENDBATCH_IOV / 2];
+    int done = 0;
+
+    memset(msgs, 0, b->count * sizeof(msgs[0]));
+    for (int i = 0; i < b->count; i++)
+    {
+        msgs[i].msg_hdr.msg_iov = &b->iov[2 * i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+    while (done < b->count)
+    {
+        int r = sendmmsg(s, msgs + done, b->count - done, MSG_NOSIGNAL);
+        if (r == -1)
         {
-            // Set timeout duration for select()
-            timeout.tv_sec = client->time_limit;
-            timeout.tv_usec = 0;
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN && wait_writable(s) == 0)
+            {
+                continue;
+            }
+            return -1;
+        }
+        done += r;
+    }
+    return 0;
+}
+
+// Writes every queued message with as few sendmsg() calls as the socket allows
+// (with sendmmsg() over a message transport, where every request stays its own message)
+static int flush_batch(int s, Batch *b)
+{
+    int rc = 0;
+    if (b->count > 0)
+    {
+        rc = sends_messages() ? send_batch_messages(s, b) : send_all(s, b->iov, 2 * b->count, 0);
+    }
+    b->count = 0;
+    return rc;
+}
 
-            FD_ZERO(&rs);
-            FD_SET(client->socket, &rs);  // Monitor the socket for incoming data
+// Sends every line of 'fd' as one request
+int client_sendbatch(int s, int fd, unsigned int window, int quiet)
+{
+    if (!is_framed(s))
+    {
+        fprintf(stderr, "sendbatch: replies can only be matched with the framed protocol (-F)\n");
+        return 1;
+    }
+    if (check_connected() == -1)
+    {
+        return 1;
+    }
+    if (window < 1 || window > CLIENT_MAX_INFLIGHT)
+    {
+        window = window < 1 ? 1 : CLIENT_MAX_INFLIGHT;
+    }
 
-            // Wait for data or timeout
-            int ready = select(client->socket + 1, &rs, NULL, NULL, &timeout);
+    char *buf = malloc(SENDBATCH_READ_CHUNK);
+    Batch *batch = malloc(sizeof(Batch));
+    if (!buf || !batch)
+    {
+        perror("malloc");
+        free(buf);
+        free(batch);
+        return 1;
+    }
+    batch->count = 0;
+    quiet_replies = quiet;
 
-            // Handle select() error
-            if (ready < 0) 
+    uint64_t start = now_ns();
+    unsigned int first_id = active_client->next_id;
+    size_t have = 0;
+    int eof = 0, rc = 0;
+
+    while (!eof && rc == 0)
+    {
+        ssize_t r = read(fd, buf + have, SENDBATCH_READ_CHUNK - have);
+        if (r == -1)
+        {
+            if (errno == EINTR)
             {
-                perror("select");
-                break;
-            } 
-            // If timeout occurred with no activity
-            else if (ready == 0) 
+                continue;
+            }
+            perror("sendbatch");
+            rc = -1;
+            break;
+        }
+        eof = r == 0;
+        have += r;
+
+        // Queue every complete line (all of the rest at EOF, or when one line fills the buffer)
+        size_t pos = 0;
+        while (pos < have && rc == 0)
+        {
+            char *line = buf + pos;
+            char *nl = memchr(line, '\n', have - pos);
+            if (!nl && !eof && (pos > 0 || have < SENDBATCH_READ_CHUNK))
             {
-                printf("\nNo activity for 30 seconds. Closing connection.\n");
-                close(client->socket);  // Close the connection
-                printf("Connection closed (child).\n");
-                break;
-            } 
-            // If socket is ready, handle server response
-            else if (FD_ISSET(client->socket, &rs)) 
+                break;  // Partial line, completed by a later read (moved to the front below)
+            }
+            size_t len = nl ? (size_t)(nl - line) : have - pos;
+            pos += len + (nl != NULL);
+            if (len == 0)
             {
-                handle_server_response(client->socket);
-                fflush(stdout);  // Ensure message is printed immediately
+                continue;  // Empty lines are no requests
+            }
+
+            // Keep at most 'window' requests in flight, the queued ones included
+            unsigned int in_flight = active_client->next_id - 1 - replies_done;
+            if (in_flight >= window)
+            {
+                rc = flush_batch(s, batch);
+                if (rc == 0)
+                {
+                    rc = wait_outstanding(s, window - 1);
+                }
+                if (rc == -1)
+                {
+                    break;
+                }
+            }
+
+            frame_encode_header(batch->hdrs[batch->count], FRAME_DATA, take_request_id(), len);
+            batch->iov[2 * batch->count].iov_base = batch->hdrs[batch->count];
+            batch->iov[2 * batch->count].iov_len = FRAME_HEADER_LEN;
+            batch->iov[2 * batch->count + 1].iov_base = line;
+            batch->iov[2 * batch->count + 1].iov_len = len;
+            if (++batch->count == SENDBATCH_IOV / 2)
+            {
+                rc = flush_batch(s, batch);
             }
         }
 
-        // Clean up and exit the child process
-        close(client->socket);
-        exit(0);
+        // The queued lines point into the buffer, so they leave before it is refilled
+        if (rc == 0)
+        {
+            rc = flush_batch(s, batch);
+        }
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
     }
+
+    if (rc == 0)
+    {
+        rc = wait_outstanding(s, 0);
+    }
+    quiet_replies = 0;
+
+    double secs = (now_ns() - start) / 1e9;
+    unsigned int sent = active_client->next_id - first_id;
+    fprintf(stderr, "sendbatch: %u requests in %.3f s (%.0f req/s), window %u\n",
+            sent, secs, secs > 0 ? sent / secs : 0.0, window);
+
+    free(buf);
+    free(batch);
+    return rc == -1;
 }
 
-// Sends user input (a message string) to the server through the socket
-void handle_user_input(int s, const char *msg) 
+// Prints the latency distribution of the answered requests, optionally starting over
+int client_latency_report(int reset)
 {
-    if (msg != NULL) 
+    if (!active_client->framed)
+    {
+        fprintf(stderr, "latency: replies can only be matched with the framed protocol (-F)\n");
+        return 1;
+    }
+
+    printf("%llu replies, %u outstanding\n", (unsigned long long)latency.total,
+           active_client->next_id - 1 - replies_done);
+    if (latency.total > 0)
+    {
+        printf("Latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  min %.1f  max %.1f  mean %.1f\n",
+               hist_percentile(&latency, 50) / 1e3, hist_percentile(&latency, 90) / 1e3,
+               hist_percentile(&latency, 99) / 1e3, hist_percentile(&latency, 99.9) / 1e3,
+               latency.min / 1e3, latency.max / 1e3, hist_mean(&latency) / 1e3);
+    }
+    if (reset)
     {
-        // Send the entire string to the server
-        write(s, msg, strlen(msg));
+        hist_init(&latency);
     }
+    return 0;
 }
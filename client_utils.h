@@ -18,6 +18,8 @@
 #include <fcntl.h>          // File descriptor control (e.g., non-blocking)
 #include <signal.h>         // Signal handling (e.g., SIGCHLD)
 
+#include "shm_channel.h"    // Shared-memory rings used with -m
+
 // Maximum allowed size for an IP address string (e.g., "127.000.000.001\0")
 #define MAX_IP_LEN 16
 
@@ -25,7 +27,24 @@
 #define MAX_UNIX_PATH 108
 
 // Maximum message buffer size for communication
-#define MAX_MSG_LEN 64
+#define MAX_MSG_LEN 4096
+
+// Buffer size for streams "send" cannot splice
+#define SEND_SPLICE_CHUNK 65536
+
+// Size of the buffer the socket is drained with
+#define CLIENT_READ_CHUNK 65536
+
+// Largest message sent over "-k dgram" or "-k seqpacket" (UDP's limit), longer text is split
+#define CLIENT_DGRAM_MAX 65507
+
+// "sendbatch": default number of requests in flight, iovecs per sendmsg() and read size
+#define SENDBATCH_WINDOW 128
+#define SENDBATCH_IOV 512
+#define SENDBATCH_READ_CHUNK 262144
+
+// Requests whose send time is remembered for latency matching (older ones are not measured)
+#define CLIENT_MAX_INFLIGHT 4096
 
 // Structure to hold all necessary information for a client connection
 typedef struct {
@@ -35,6 +54,14 @@ typedef struct {
     char unix_path[MAX_UNIX_PATH];     // Filesystem path for UNIX socket (used if use_tcp == 0)
     int socket;                         // File descriptor for the connected socket
     int time_limit;                     // Timeout in seconds for inactivity (optional feature)
+    int framed;                         // Use the length-prefixed protocol (1) or raw text (0)
+    unsigned int next_id;               // Request id for the next framed message
+    int quiet;                          // Suppress connection progress messages (benchmark mode)
+    int connected;                      // The server is still there (the socket stays open until exit)
+    int timer_fd;                       // timerfd of the inactivity limit
+    int shm;                            // Talk through shared-memory rings ("-m name", unix_path holds the name)
+    ShmChannel channel;                 // The rings, once connected with -m
+    int sock_type;                      // SOCK_STREAM, or SOCK_DGRAM / SOCK_SEQPACKET with "-k"
 } ClientConnection;
 
 // Parses command-line arguments and returns a pointer to a dynamically allocated ClientConnection
@@ -43,16 +70,39 @@ ClientConnection* create_client(char **args);
 // Establishes a socket connection to the server based on the client settings (TCP or UNIX)
 void bind_client_socket(ClientConnection *client);
 
-// Manages background client tasks such as receiving messages from the server or timing out
+// Runs the client shell in a single process: the shell's input loop also polls the socket and the
+// inactivity timer; at the end of input the replies still on the way are awaited
 void handle_client_background(ClientConnection *client);
 
-// Initializes the file descriptor set for the select() system call to monitor I/O
-void init_fd_set(int s, fd_set *rs);
-
-// Reads and handles a message sent by the server to the client
-void handle_server_response(int s);
+// Reads and handles everything the server sent (non-blocking socket)
+// Returns 0 while connected, -1 once the server went away
+int handle_server_response(int s);
 
 // Sends user-provided input (message) to the connected server
 void handle_user_input(int s, const char *msg);
 
+// Streams a whole regular file to the server with sendfile() (one DATA frame with -F)
+// Returns 0 when everything was sent, 1 otherwise
+int client_sendfile(int s, const char *path);
+
+// Streams a descriptor to the server until EOF ("send" without words, e.g. "cat log | send")
+// Pipes are moved with splice(), regular files with sendfile(), with -F every chunk is a DATA frame
+// Returns 0 when everything was sent, 1 otherwise
+int client_send_stream(int s, int fd);
+
+// Sends every line of 'fd' as one framed request ("sendbatch"), queued messages leave in large
+// sendmsg() calls and at most 'window' requests are in flight; 'quiet' counts replies without
+// printing them. Waits for every reply, then prints the request rate to stderr
+// Returns 0 on success, 1 otherwise
+int client_sendbatch(int s, int fd, unsigned int window, int quiet);
+
+// Prints the latency distribution of the requests answered so far ("latency [-r]", -F only)
+// Returns 0, or 1 when replies cannot be matched
+int client_latency_report(int reset);
+
+// Asks the server to run a command line through its shell ("rexec", framed protocol only)
+// The output is streamed back as STDOUT/STDERR frames and printed as it arrives
+// Returns 0 when the request was sent, 1 otherwise
+int client_rexec(int s, const char *cmd);
+
 #endif // CLIENT_H
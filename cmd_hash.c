@@ -0,0 +1,179 @@
+#include "cmd_hash.h"
+
+#include <stdlib.h>         // malloc(), free(), getenv()
+#include <string.h>         // strchr(), strcmp(), strdup()
+#include <unistd.h>         // access()
+#include <sys/stat.h>       // stat(), S_ISREG
+
+// Number of hash chains, a power of two so the hash can be masked
+#define CMD_HASH_BUCKETS 256
+
+// Longest path built while searching $PATH
+#define CMD_HASH_MAX_PATH 4096
+
+// One remembered command
+typedef struct CmdHashEntry {
+    char *name;                 // Command name as typed (e.g. "ls")
+    char *path;                 // Resolved absolute path (e.g. "/usr/bin/ls")
+    unsigned long hits;         // How many times the entry was used
+    struct CmdHashEntry *next;  // Next entry in the same chain
+} CmdHashEntry;
+
+static CmdHashEntry *buckets[CMD_HASH_BUCKETS];
+
+// Copy of $PATH the table was filled with, any change invalidates every entry
+static char *hashed_path_env = NULL;
+
+// FNV-1a hash of a command name
+static unsigned int hash_name(const char *name)
+{
+    unsigned int h = 2166136261u;
+    while (*name)
+    {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h & (CMD_HASH_BUCKETS - 1);
+}
+
+// Drops every entry
+void cmd_hash_clear(void)
+{
+    for (int i = 0; i < CMD_HASH_BUCKETS; i++)
+    {
+        CmdHashEntry *e = buckets[i];
+        while (e)
+        {
+            CmdHashEntry *next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        buckets[i] = NULL;
+    }
+}
+
+// Drops the entry of one command
+void cmd_hash_forget(const char *name)
+{
+    CmdHashEntry **link = &buckets[hash_name(name)];
+    while (*link)
+    {
+        CmdHashEntry *e = *link;
+        if (strcmp(e->name, name) == 0)
+        {
+            *link = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+// Walks $PATH the way execvp() does and returns a malloc'ed path of the first executable match
+static char *search_path(const char *name, const char *path_env)
+{
+    char candidate[CMD_HASH_MAX_PATH];
+    const char *dir = path_env;
+
+    while (dir)
+    {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+
+        // An empty component means the current directory
+        int n = dir_len
+            ? snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)dir_len, dir, name)
+            : snprintf(candidate, sizeof(candidate), "./%s", name);
+
+        struct stat st;
+        if (n > 0 && (size_t)n < sizeof(candidate) &&
+            stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0)
+        {
+            return strdup(candidate);
+        }
+
+        dir = end ? end + 1 : NULL;
+    }
+    return NULL;
+}
+
+// Returns the absolute path for 'name', searching $PATH only on a cache miss
+const char *cmd_hash_lookup(const char *name)
+{
+    // Explicit paths are never hashed
+    if (strchr(name, '/'))
+    {
+        return name;
+    }
+
+    const char *path_env = getenv("PATH");
+    if (!path_env)
+    {
+        path_env = "/bin:/usr/bin";  // Same default as execvp()
+    }
+
+    // $PATH changed since the table was filled: every entry may now be wrong
+    if (!hashed_path_env || strcmp(hashed_path_env, path_env) != 0)
+    {
+        cmd_hash_clear();
+        free(hashed_path_env);
+        hashed_path_env = strdup(path_env);
+    }
+
+    unsigned int b = hash_name(name);
+    for (CmdHashEntry *e = buckets[b]; e; e = e->next)
+    {
+        if (strcmp(e->name, name) == 0)
+        {
+            e->hits++;
+            return e->path;
+        }
+    }
+
+    char *path = search_path(name, path_env);
+    if (!path)
+    {
+        return NULL;
+    }
+
+    CmdHashEntry *e = malloc(sizeof(CmdHashEntry));
+    if (!e)
+    {
+        free(path);
+        return NULL;
+    }
+    e->name = strdup(name);
+    e->path = path;
+    e->hits = 1;
+    e->next = buckets[b];
+    buckets[b] = e;
+    return e->path;
+}
+
+// Prints the table as "hits<TAB>path" lines
+void cmd_hash_print(FILE *out)
+{
+    int empty = 1;
+
+    for (int i = 0; i < CMD_HASH_BUCKETS; i++)
+    {
+        for (CmdHashEntry *e = buckets[i]; e; e = e->next)
+        {
+            if (empty)
+            {
+                fprintf(out, "hits\tcommand\n");
+                empty = 0;
+            }
+            fprintf(out, "%4lu\t%s\n", e->hits, e->path);
+        }
+    }
+
+    if (empty)
+    {
+        fprintf(out, "hash: hash table empty\n");
+    }
+}
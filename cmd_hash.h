@@ -0,0 +1,25 @@
+#ifndef CMD_HASH_H
+#define CMD_HASH_H
+
+#include <stdio.h>      // FILE for cmd_hash_print()
+
+// Shell-level command hash table (like bash's "hash" builtin)
+//
+// Resolved absolute paths of external commands are remembered, so each launch costs one
+// posix_spawn() instead of a failed execve() for every $PATH directory before the right one.
+// The whole table is dropped when $PATH changes, single entries when their binary disappears.
+
+// Returns the absolute path for 'name', searching $PATH only on a cache miss
+// Names containing '/' are returned unchanged, NULL means the command was not found
+const char *cmd_hash_lookup(const char *name);
+
+// Drops the entry of one command (e.g. after its cached binary disappeared)
+void cmd_hash_forget(const char *name);
+
+// Drops every entry
+void cmd_hash_clear(void);
+
+// Prints the table as "hits<TAB>path" lines, the way bash does
+void cmd_hash_print(FILE *out);
+
+#endif // CMD_HASH_H
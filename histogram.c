@@ -0,0 +1,109 @@
+#include "histogram.h"
+
+#include <string.h>     // memset()
+
+// Resets a histogram to the empty state
+void hist_init(Histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+// Maps a value to its bucket
+// Values below HIST_SUB_BUCKETS get a bucket each, larger ones are shifted down until the
+// top HIST_SUB_BITS - 1 bits remain and those bits pick the linear bucket within the power of two
+int hist_bucket_index(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKETS)
+    {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (HIST_SUB_BITS - 1);
+    int sub = (int)(value >> shift) - HIST_SUB_BUCKETS / 2;
+    return HIST_SUB_BUCKETS + (shift - 1) * (HIST_SUB_BUCKETS / 2) + sub;
+}
+
+// Returns the highest value that falls into a bucket
+uint64_t hist_bucket_upper(int index)
+{
+    if (index < HIST_SUB_BUCKETS)
+    {
+        return (uint64_t)index;
+    }
+
+    int shift = (index - HIST_SUB_BUCKETS) / (HIST_SUB_BUCKETS / 2) + 1;
+    uint64_t sub = (uint64_t)((index - HIST_SUB_BUCKETS) % (HIST_SUB_BUCKETS / 2)) + HIST_SUB_BUCKETS / 2;
+    return ((sub + 1) << shift) - 1;
+}
+
+// Records one value
+void hist_record(Histogram *h, uint64_t value)
+{
+    h->counts[hist_bucket_index(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value < h->min)
+    {
+        h->min = value;
+    }
+    if (value > h->max)
+    {
+        h->max = value;
+    }
+}
+
+// Adds every value of 'src' into 'dst'
+void hist_merge(Histogram *dst, const Histogram *src)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+    {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max)
+    {
+        dst->max = src->max;
+    }
+}
+
+// Returns the value below which 'percentile' percent of the recorded values fall
+uint64_t hist_percentile(const Histogram *h, double percentile)
+{
+    if (h->total == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the wanted value, at least the first one
+    uint64_t rank = (uint64_t)(percentile / 100.0 * h->total + 0.5);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= rank)
+        {
+            // Never report more than the real maximum
+            uint64_t upper = hist_bucket_upper(i);
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+// Returns the mean of the recorded values
+double hist_mean(const Histogram *h)
+{
+    return h->total ? (double)h->sum / h->total : 0.0;
+}
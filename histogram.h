@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>     // uint64_t
+
+// HDR-style log-linear histogram of unsigned 64-bit values (e.g. latencies in nanoseconds)
+// Every power of two is split into HIST_SUB_BUCKETS / 2 linear buckets, which keeps the
+// relative error of any reported value below 1/64 (~1.6%) over the whole 64-bit range,
+// with a fixed-size table and O(1) recording
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB_BUCKETS + (64 - HIST_SUB_BITS) * (HIST_SUB_BUCKETS / 2))
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];  // Number of values recorded in each bucket
+    uint64_t total;                 // Number of recorded values
+    uint64_t min;                   // Smallest recorded value
+    uint64_t max;                   // Largest recorded value
+    uint64_t sum;                   // Sum of all recorded values (for the mean)
+} Histogram;
+
+// Resets a histogram to the empty state
+void hist_init(Histogram *h);
+
+// Records one value
+void hist_record(Histogram *h, uint64_t value);
+
+// Adds every value of 'src' into 'dst'
+void hist_merge(Histogram *dst, const Histogram *src);
+
+// Returns the value below which 'percentile' percent (0..100) of the recorded values fall
+uint64_t hist_percentile(const Histogram *h, double percentile);
+
+// Returns the mean of the recorded values (0 when empty)
+double hist_mean(const Histogram *h);
+
+// Maps a value to its bucket and a bucket back to the highest value it holds
+int hist_bucket_index(uint64_t value);
+uint64_t hist_bucket_upper(int index);
+
+#endif // HISTOGRAM_H
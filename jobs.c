@@ -0,0 +1,646 @@
+#include "jobs.h"
+
+#include <errno.h>          // errno, EINTR, ECHILD
+#include <signal.h>         // sigprocmask(), kill(), SIGCHLD, SIGCONT
+#include <stdio.h>          // printf(), fprintf()
+#include <stdlib.h>         // malloc(), free(), strtol()
+#include <string.h>         // memcpy(), strlen()
+#include <unistd.h>         // isatty(), tcsetpgrp(), getpgrp(), read()
+#include <sys/signalfd.h>   // signalfd(), struct signalfd_siginfo
+#include <sys/wait.h>       // waitpid(), WUNTRACED, WCONTINUED
+
+// Longest job text shown by "jobs"
+#define JOB_TEXT_MAX 256
+
+// State of one process of a job
+typedef enum {
+    PROC_RUNNING,
+    PROC_STOPPED,
+    PROC_DONE,
+} ProcState;
+
+typedef struct {
+    pid_t pid;
+    ProcState state;
+    int status;             // waitpid() status once it is PROC_DONE
+} JobProcess;
+
+// State of a whole job, derived from its processes
+typedef enum {
+    JOB_RUNNING,            // At least one process runs
+    JOB_STOPPED,            // Nothing runs, at least one process is stopped
+    JOB_DONE,               // Every process exited
+} JobState;
+
+typedef struct {
+    int id;                 // Number shown as [id], 0 marks a free slot
+    pid_t pgid;             // Process group, -1 when the processes share the shell's group
+    JobProcess *procs;
+    int count;
+    JobState state;
+    int background;         // Started with '&' (or continued with "bg")
+    int notified_state;     // Last state the user was told about
+    char text[JOB_TEXT_MAX];
+} Job;
+
+// Jobs are looked up by id, which is also their index + 1
+#define MAX_JOBS 256
+static Job jobs[MAX_JOBS];
+static int current_job = 0;     // The '+' job: most recently started or stopped
+static int job_count = 0;       // Slots in use
+static int signal_fd = -1;
+
+// Blocks SIGCHLD and opens the signalfd that reports it instead
+void jobs_init(void)
+{
+    if (signal_fd != -1)
+    {
+        return;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+    {
+        perror("sigprocmask");
+        return;
+    }
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd == -1)
+    {
+        perror("signalfd");
+    }
+}
+
+int jobs_count(void)
+{
+    return job_count;
+}
+
+int jobs_signal_fd(void)
+{
+    jobs_init();
+    return signal_fd;
+}
+
+// Signals of the terminal's foreground group that a job-control shell leaves to its jobs
+static const int job_signals[] = { SIGINT, SIGTSTP, SIGTTIN, SIGTTOU };
+#define JOB_SIGNALS (sizeof(job_signals) / sizeof(job_signals[0]))
+
+// Ignores the job signals while the shell owns the terminal
+void jobs_claim_terminal(void)
+{
+    if (!isatty(STDIN_FILENO) || tcgetpgrp(STDIN_FILENO) != getpgrp())
+    {
+        return;  // Not interactive, or started in the background: keep the defaults
+    }
+    for (size_t i = 0; i < JOB_SIGNALS; i++)
+    {
+        signal(job_signals[i], SIG_IGN);
+    }
+}
+
+// The signals a started job gets back at their defaults
+void jobs_job_signals(sigset_t *set)
+{
+    sigemptyset(set);
+    for (size_t i = 0; i < JOB_SIGNALS; i++)
+    {
+        sigaddset(set, job_signals[i]);
+    }
+}
+
+// Restores the job signals in a forked child
+void jobs_reset_signals(void)
+{
+    for (size_t i = 0; i < JOB_SIGNALS; i++)
+    {
+        signal(job_signals[i], SIG_DFL);
+    }
+}
+
+// Hands the terminal to a process group (tcsetpgrp() from a background group raises SIGTTOU)
+void jobs_give_terminal(pid_t pgid)
+{
+    if (!isatty(STDIN_FILENO))
+    {
+        return;
+    }
+
+    void (*old)(int) = signal(SIGTTOU, SIG_IGN);
+    tcsetpgrp(STDIN_FILENO, pgid);
+    signal(SIGTTOU, old);
+}
+
+// Builds the "a | b > f" text of a job from its commands
+static void describe(char *out, const Command *cmd)
+{
+    size_t used = 0;
+    out[0] = '\0';
+
+    for (; cmd; cmd = cmd->next)
+    {
+        for (int i = 0; i < cmd->argc; i++)
+        {
+            used += snprintf(out + used, JOB_TEXT_MAX - used, "%s%s", i ? " " : "", cmd->argv[i]);
+            if (used >= JOB_TEXT_MAX) return;
+        }
+        if (cmd->input_file)
+        {
+            used += snprintf(out + used, JOB_TEXT_MAX - used, " < %s", cmd->input_file);
+            if (used >= JOB_TEXT_MAX) return;
+        }
+        if (cmd->output_file)
+        {
+            used += snprintf(out + used, JOB_TEXT_MAX - used, " > %s", cmd->output_file);
+            if (used >= JOB_TEXT_MAX) return;
+        }
+        if (cmd->next)
+        {
+            used += snprintf(out + used, JOB_TEXT_MAX - used, " | ");
+            if (used >= JOB_TEXT_MAX) return;
+        }
+    }
+}
+
+// Registers started processes as a job, returns its id
+int jobs_add(pid_t pgid, const pid_t *pids, int count, const Command *commands, int background)
+{
+    jobs_init();
+
+    // The lowest free id, like other shells
+    int slot = 0;
+    while (slot < MAX_JOBS && jobs[slot].id != 0)
+    {
+        slot++;
+    }
+    if (slot == MAX_JOBS)
+    {
+        // Table full: recycle a finished job nobody asked about yet
+        jobs_reap();
+        for (slot = 0; slot < MAX_JOBS && jobs[slot].state != JOB_DONE; slot++)
+        {
+        }
+        if (slot == MAX_JOBS)
+        {
+            fprintf(stderr, "jobs: too many jobs\n");
+            return -1;
+        }
+        free(jobs[slot].procs);
+        job_count--;
+    }
+
+    Job *j = &jobs[slot];
+    j->procs = malloc(count * sizeof(JobProcess));
+    if (!j->procs)
+    {
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        j->procs[i] = (JobProcess){ pids[i], PROC_RUNNING, 0 };
+    }
+    j->id = slot + 1;
+    job_count++;
+    j->pgid = pgid;
+    j->count = count;
+    j->state = JOB_RUNNING;
+    j->background = background;
+    j->notified_state = JOB_RUNNING;
+    describe(j->text, commands);
+
+    if (background)
+    {
+        current_job = j->id;
+        printf("[%d] %d\n", j->id, (int)(pgid > 0 ? pgid : pids[count - 1]));
+    }
+    return j->id;
+}
+
+static Job *find_job(int id)
+{
+    return (id >= 1 && id <= MAX_JOBS && jobs[id - 1].id == id) ? &jobs[id - 1] : NULL;
+}
+
+static void free_job(Job *j)
+{
+    free(j->procs);
+    j->procs = NULL;
+    j->id = 0;
+    job_count--;
+
+    if (current_job == j - jobs + 1)
+    {
+        // The newest remaining job becomes the current one
+        current_job = 0;
+        for (int i = MAX_JOBS - 1; i >= 0; i--)
+        {
+            if (jobs[i].id != 0)
+            {
+                current_job = jobs[i].id;
+                break;
+            }
+        }
+    }
+}
+
+// Applies one waitpid() result to the job that owns 'pid', returns 0 when no job owns it
+static int record_status(pid_t pid, int wstatus)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        for (int k = 0; j->id && k < j->count; k++)
+        {
+            JobProcess *p = &j->procs[k];
+            if (p->pid != pid)
+            {
+                continue;
+            }
+            if (WIFSTOPPED(wstatus))
+            {
+                p->state = PROC_STOPPED;
+                p->status = wstatus;
+            }
+            else if (WIFCONTINUED(wstatus))
+            {
+                p->state = PROC_RUNNING;
+            }
+            else
+            {
+                p->state = PROC_DONE;
+                p->status = wstatus;
+            }
+
+            // The job runs while any process runs, is stopped while any is stopped, else done
+            int running = 0, stopped = 0;
+            for (int m = 0; m < j->count; m++)
+            {
+                running += j->procs[m].state == PROC_RUNNING;
+                stopped += j->procs[m].state == PROC_STOPPED;
+            }
+            j->state = running ? JOB_RUNNING : stopped ? JOB_STOPPED : JOB_DONE;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Exit status of a job: the status of its last process (128 + signal when killed or stopped)
+static int job_status(const Job *j)
+{
+    for (int k = j->count - 1; k >= 0; k--)
+    {
+        int st = j->procs[k].status;
+        if (j->procs[k].state == PROC_STOPPED)
+        {
+            return 128 + WSTOPSIG(st);
+        }
+        if (j->procs[k].state == PROC_DONE)
+        {
+            return WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+        }
+    }
+    return 0;
+}
+
+// Waits for the next state change of one of the job's processes, returns its pid
+static pid_t wait_job_once(Job *j, int *wstatus, int flags)
+{
+    while (1)
+    {
+        pid_t pid;
+        if (j->pgid > 0)
+        {
+            pid = waitpid(-j->pgid, wstatus, flags);  // One call covers the whole group
+        }
+        else
+        {
+            // No own group: wait for the first process that has not exited yet
+            int k = 0;
+            while (k < j->count && j->procs[k].state == PROC_DONE) k++;
+            if (k == j->count)
+            {
+                errno = ECHILD;
+                return -1;
+            }
+            pid = waitpid(j->procs[k].pid, wstatus, flags);
+        }
+        if (pid == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        return pid;
+    }
+}
+
+// Marks every process that is gone without a status (e.g. reaped elsewhere) as done
+static void forget_lost_processes(Job *j)
+{
+    for (int k = 0; k < j->count; k++)
+    {
+        if (j->procs[k].state != PROC_DONE && kill(j->procs[k].pid, 0) == -1 && errno == ESRCH)
+        {
+            record_status(j->procs[k].pid, 0);
+        }
+    }
+}
+
+static void print_job(const Job *j, const char *state)
+{
+    printf("[%d]%c  %-22s %s%s\n", j->id, j->id == current_job ? '+' : ' ', state, j->text,
+           j->state == JOB_RUNNING && j->background ? " &" : "");
+}
+
+// Waits with the terminal handed over until the job exits or stops
+int jobs_wait_foreground(int id)
+{
+    Job *j = find_job(id);
+    if (!j)
+    {
+        return 1;
+    }
+
+    // The terminal may already belong to the job (handle_pipeline() hands it over early)
+    pid_t owner = isatty(STDIN_FILENO) ? tcgetpgrp(STDIN_FILENO) : -1;
+    int interactive = owner != -1 && (owner == getpgrp() || owner == j->pgid);
+    if (interactive && j->pgid > 0)
+    {
+        jobs_give_terminal(j->pgid);
+    }
+
+    int wstatus;
+    while (j->state == JOB_RUNNING)
+    {
+        pid_t pid = wait_job_once(j, &wstatus, WUNTRACED);
+        if (pid == -1)
+        {
+            forget_lost_processes(j);
+            break;
+        }
+        record_status(pid, wstatus);
+    }
+
+    if (interactive && j->pgid > 0)
+    {
+        jobs_give_terminal(getpgrp());
+    }
+
+    int status = job_status(j);
+    if (j->state == JOB_STOPPED)
+    {
+        // Ctrl+Z: the job stays in the table and can be resumed with "fg" or "bg"
+        j->background = 0;
+        j->notified_state = JOB_STOPPED;
+        current_job = j->id;
+        printf("\n");
+        print_job(j, "Stopped");
+    }
+    else
+    {
+        free_job(j);
+    }
+    return status;
+}
+
+// Drains the signalfd and collects every pending status change
+void jobs_reap(void)
+{
+    struct signalfd_siginfo info[16];
+
+    jobs_init();
+    while (read(signal_fd, info, sizeof(info)) > 0)
+    {
+        // SIGCHLD is not queued per child, the wait loop below finds every change
+    }
+
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        int wstatus;
+        while (j->id && j->state != JOB_DONE)
+        {
+            pid_t pid = wait_job_once(j, &wstatus, WNOHANG | WUNTRACED | WCONTINUED);
+            if (pid <= 0)
+            {
+                if (pid == -1)
+                {
+                    forget_lost_processes(j);
+                }
+                break;
+            }
+            record_status(pid, wstatus);
+        }
+    }
+}
+
+// Tells the user about jobs that finished or stopped since the last prompt
+void jobs_notify(void)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        if (!j->id || (int)j->state == j->notified_state)
+        {
+            continue;
+        }
+
+        if (j->state == JOB_DONE)
+        {
+            int status = job_status(j);
+            char label[32];
+            if (status == 0)
+            {
+                snprintf(label, sizeof(label), "Done");
+            }
+            else
+            {
+                snprintf(label, sizeof(label), "Exit %d", status);
+            }
+            print_job(j, label);
+            free_job(j);
+        }
+        else
+        {
+            j->notified_state = j->state;
+            print_job(j, j->state == JOB_STOPPED ? "Stopped" : "Running");
+        }
+    }
+    fflush(stdout);
+}
+
+// Parses "%n", "%%", "%+", "n" or a pid into a job, NULL (with a message) when there is none
+static Job *parse_spec(const char *builtin, const char *spec)
+{
+    Job *j = NULL;
+
+    if (!spec || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0 || strcmp(spec, "%") == 0)
+    {
+        j = find_job(current_job);
+    }
+    else
+    {
+        char *end;
+        long n = strtol(spec[0] == '%' ? spec + 1 : spec, &end, 10);
+        if (*end == '\0' && spec[0] == '%')
+        {
+            j = find_job((int)n);
+        }
+        else if (*end == '\0')
+        {
+            // A plain number is a pid of one of the jobs' processes
+            for (int i = 0; i < MAX_JOBS && !j; i++)
+            {
+                for (int k = 0; jobs[i].id && k < jobs[i].count; k++)
+                {
+                    if (jobs[i].procs[k].pid == n)
+                    {
+                        j = &jobs[i];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!j)
+    {
+        fprintf(stderr, "%s: %s: no such job\n", builtin, spec ? spec : "current");
+    }
+    return j;
+}
+
+// "jobs": List every job with its state
+int jobs_list(void)
+{
+    jobs_reap();
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *j = &jobs[i];
+        if (!j->id)
+        {
+            continue;
+        }
+        print_job(j, j->state == JOB_RUNNING ? "Running" : j->state == JOB_STOPPED ? "Stopped" : "Done");
+        j->notified_state = j->state;
+        if (j->state == JOB_DONE)
+        {
+            free_job(j);
+        }
+    }
+    return 0;
+}
+
+// Sends SIGCONT to every process of the job
+static void continue_job(Job *j)
+{
+    if (j->pgid > 0)
+    {
+        kill(-j->pgid, SIGCONT);
+    }
+    else
+    {
+        for (int k = 0; k < j->count; k++)
+        {
+            if (j->procs[k].state != PROC_DONE) kill(j->procs[k].pid, SIGCONT);
+        }
+    }
+    for (int k = 0; k < j->count; k++)
+    {
+        if (j->procs[k].state == PROC_STOPPED) j->procs[k].state = PROC_RUNNING;
+    }
+    if (j->state == JOB_STOPPED)
+    {
+        j->state = JOB_RUNNING;
+    }
+    j->notified_state = j->state;
+}
+
+// "fg": Continue a job in the foreground and wait for it
+int jobs_fg(const char *spec)
+{
+    jobs_reap();
+    Job *j = parse_spec("fg", spec);
+    if (!j)
+    {
+        return 1;
+    }
+
+    printf("%s\n", j->text);
+    fflush(stdout);
+    j->background = 0;
+    int interactive = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+    if (interactive && j->pgid > 0)
+    {
+        jobs_give_terminal(j->pgid);  // Before SIGCONT, so the job does not stop on a terminal read
+    }
+    continue_job(j);
+    return jobs_wait_foreground(j->id);
+}
+
+// "bg": Continue a stopped job in the background
+int jobs_bg(const char *spec)
+{
+    jobs_reap();
+    Job *j = parse_spec("bg", spec);
+    if (!j)
+    {
+        return 1;
+    }
+
+    j->background = 1;
+    continue_job(j);
+    current_job = j->id;
+    print_job(j, "Running");
+    return 0;
+}
+
+// Waits until one job is done (not just stopped), returns its status and drops it
+static int wait_done(Job *j)
+{
+    int wstatus;
+    while (j->state != JOB_DONE)
+    {
+        pid_t pid = wait_job_once(j, &wstatus, WUNTRACED | WCONTINUED);
+        if (pid == -1)
+        {
+            forget_lost_processes(j);
+            break;
+        }
+        record_status(pid, wstatus);
+        if (j->state == JOB_STOPPED)
+        {
+            break;  // A stopped job would never finish on its own
+        }
+    }
+
+    int status = job_status(j);
+    if (j->state == JOB_DONE)
+    {
+        free_job(j);
+    }
+    return status;
+}
+
+// "wait": Wait for one job, or for every job when no spec is given
+int jobs_wait(const char *spec)
+{
+    jobs_reap();
+    if (spec)
+    {
+        Job *j = parse_spec("wait", spec);
+        return j ? wait_done(j) : 127;
+    }
+
+    int status = 0;
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (jobs[i].id && jobs[i].state != JOB_STOPPED)
+        {
+            status = wait_done(&jobs[i]);
+        }
+    }
+    return status;
+}
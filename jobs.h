@@ -0,0 +1,65 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <signal.h>         // sigset_t
+#include <sys/types.h>      // pid_t
+#include "parser.h"         // Command, for the job's command text
+
+// Job table of the shell: background ('&') and stopped (Ctrl+Z) pipelines
+//
+// SIGCHLD is blocked and delivered through a signalfd instead, which run_shell() polls next to
+// stdin. Whenever it fires, jobs_reap() collects every status change without blocking, so any
+// number of background jobs can run while the prompt stays responsive. Foreground pipelines
+// are jobs too; they only stay in the table when they get stopped.
+
+// Prepares the table: blocks SIGCHLD and opens the signalfd (called lazily by the other calls)
+void jobs_init(void);
+
+// Descriptor that becomes readable when a child changed state (stopped, continued or exited)
+int jobs_signal_fd(void);
+
+// Registers started processes as a job
+// Arguments:
+//  - pgid: Process group of the job, or -1 when its processes stay in the shell's group
+//  - pids / count: Every started process, the last one gives the job its exit status
+//  - commands: The job's commands, used for its text in "jobs"
+//  - background: 1 for '&' (kept in the table and announced), 0 for a foreground job
+// Returns the job id
+int jobs_add(pid_t pgid, const pid_t *pids, int count, const Command *commands, int background);
+
+// Waits until the foreground job 'id' exits or is stopped, with the terminal handed to it
+// A finished job leaves the table, a stopped one stays and is announced
+// Returns the exit status of the job (128 + signal when it was stopped or killed)
+int jobs_wait_foreground(int id);
+
+// Number of jobs in the table
+int jobs_count(void);
+
+// Collects every pending status change without blocking
+void jobs_reap(void);
+
+// Prints the jobs that finished since the last call and drops them from the table
+void jobs_notify(void);
+
+// Hands the terminal to a process group, so Ctrl+C / Ctrl+Z reach the job and not the shell
+// Does nothing when stdin is not a terminal
+void jobs_give_terminal(pid_t pgid);
+
+// Makes an interactive shell (stdin is a terminal it owns) ignore SIGINT, SIGTSTP, SIGTTIN and
+// SIGTTOU, so keyboard signals only ever reach the foreground job; call it before forking
+// helpers that must survive them too (the server engines)
+void jobs_claim_terminal(void);
+
+// Fills 'set' with the signals jobs_claim_terminal() ignores, for posix_spawnattr_setsigdefault()
+void jobs_job_signals(sigset_t *set);
+
+// Puts those signals back to their defaults, in a forked child that becomes (part of) a job
+void jobs_reset_signals(void);
+
+// Builtins: "jobs", "fg [%n]", "bg [%n]" and "wait [%n|pid ...]", return their exit status
+int jobs_list(void);
+int jobs_fg(const char *spec);
+int jobs_bg(const char *spec);
+int jobs_wait(const char *spec);
+
+#endif // JOBS_H
@@ -12,6 +12,8 @@
 #include "server_utils.h"  // Contains functions and definitions for server setup and handling
 #include "client_utils.h"  // Contains functions and definitions for client setup and handling
 #include "shell.h"         // Likely defines shell behavior or interactive session features
+#include "bench_client.h"  // Built-in load generator used by the -b mode
+#include "jobs.h"          // jobs_claim_terminal() before the server engines fork
 
 // Define constants for maximum command line length and maximum number of arguments
 #define MAX_LINE 1024  // Maximum number of characters in a single input line
@@ -21,7 +23,7 @@
 ClientConnection *client = NULL;  // Will point to the client connection data
 ServerConnection *server = NULL;  // Will point to the server connection data
 
-#define MAX_BUFF_LEN 64  // Define a maximum buffer length (not used in this file but may be used in shell.h)
+#define MAX_BUFF_LEN 4096  // Define a maximum buffer length (not used in this file but may be used in shell.h)
 
 // Function to run the server-side logic
 void run_server(char **args)
@@ -34,16 +36,38 @@ void run_server(char **args)
         printf("  args[%d] = %s\n", i, args[i]);  // Print each command-line argument
     }
 
+    // Keyboard signals belong to the shell's jobs: the engine processes forked below must
+    // survive a Ctrl+C or Ctrl+Z typed at the server's prompt, like the shell itself
+    jobs_claim_terminal();
+
     // Step 1: Create the server connection based on input arguments
     server = create_server(args);
 
     // Step 2: Bind the server to its socket (either IP/port or UNIX domain)
     bind_server_socket(server);
 
-    // Step 3: Begin handling server operations, likely in the background
-    handle_server_background(server, 0);
+    // Step 3: Map the per-worker counters and open the "-S" control socket
+    start_server_stats(server);
 
-    // Step 4: Free the allocated memory once done
+    // Step 4: Begin handling server operations with the selected engine
+    if (server->engine == SERVER_ENGINE_EPOLL)
+    {
+        handle_server_epoll(server);
+    }
+    else if (server->engine == SERVER_ENGINE_URING)
+    {
+        handle_server_uring(server);
+    }
+    else if (server->engine == SERVER_ENGINE_DGRAM)
+    {
+        handle_server_dgram(server);
+    }
+    else
+    {
+        handle_server_background(server, 0);
+    }
+
+    // Step 5: Free the allocated memory once done
     free(server);
 }
 
@@ -67,17 +91,24 @@ void run_client(char **args)
     // Step 3: Start handling client logic, such as reading and sending data
     handle_client_background(client);
 
-    // Step 4: Free the allocated memory once done
+    // Step 5: Free the allocated memory once done
     free(client);
 }
 
+// Function to run the built-in load generator against a server
+void run_bench(char **args)
+{
+    // The connections are opened with the regular client helpers inside the benchmark
+    run_benchmark(args);
+}
+
 // Main function: program entry point
 int main(int argc, char *argv[]) 
 {
     // Check if the user provided enough arguments
     if (argc < 2)
     {
-        printf("Usage: %s -s|-c [options]\n", argv[0]);
+        printf("Usage: %s -s|-c|-b [options] | -f script\n", argv[0]);
         return 1;
     }
 
@@ -91,6 +122,16 @@ int main(int argc, char *argv[])
     {
         run_client(&argv[2]);  // Pass the rest of the arguments to the client
     } 
+    // If the first argument is "-b", benchmark a running server
+    else if (strcmp(argv[1], "-b") == 0) 
+    {
+        run_bench(&argv[2]);  // Pass the rest of the arguments to the load generator
+    } 
+    // If the first argument is "-f", run a script non-interactively
+    else if (strcmp(argv[1], "-f") == 0 && argc > 2) 
+    {
+        return run_script(argv[2], -1, 0) == 0 ? 0 : 1;
+    } 
     // If the argument is invalid, print an error
     else 
     {
@@ -124,29 +165,46 @@ int main(int argc, char *argv[])
 /* Program Behavior:
  * - Accepts command-line arguments to specify mode (client/server) and address
  *     - -p for port, -u for UNIX socket, -i for IP address
+ *     - -m name for the shared-memory transport (same host, epoll engine)
+ *     - -k dgram|seqpacket for UDP / UNIX datagram or seqpacket sockets instead of a stream
+ *     - -S path opens a server control socket; the "stats" builtin reads the counters from it
  * - Shell and networking features work concurrently
  * - Handles errors in argument parsing, socket communication, and client/server logic
  * - Exits gracefully when errors occur or connections are closed
  * - Supports manual timeout configuration with -t [seconds]
+ * - Server engine is chosen with -e select|epoll|uring
+ * - -F on both sides switches to the length-prefixed protocol from protocol.h
+ * - -f script runs a script without prompts (memory-mapped, parsed in place)
+ * - -b runs a load generator: -n connections, -s message size, -d pipeline depth, -r requests
  */
 
 /* Assumptions for Correct Functioning:
  * - Only one of -p, -u, or -i is used at a time
  * - The system environment supports socket creation and file descriptor management
  * - Input commands are valid and available in the system PATH
- * - Only one client connects to the server at a time
+ * - Only one client connects to the server at a time with the default select engine
+ *   (the epoll engine, "-e epoll", serves any number of clients concurrently)
  */
 
 /* System Calls and Libraries:
- * - Shell logic uses: fork(), execvp(), pipe(), dup2(), wait()
+ * - Shell logic uses: posix_spawn() on the path from the command hash, fork(), pipe(), dup2(), wait()
  * - Networking uses: socket(), bind(), listen(), accept(), connect(), read(), write()
- * - Prompt uses: gethostname(), getlogin(), gettimeofday()
+ * - The uring engine uses: io_uring_setup(), io_uring_enter(), io_uring_register(), mmap()
+ * - Worker threads use: pthread_create(), pthread_setaffinity_np(), setsockopt(SO_REUSEPORT)
+ * - The shared-memory transport uses: memfd_create(), mmap(), eventfd(), sendmsg(SCM_RIGHTS)
+ * - Datagram and seqpacket sockets use: recvmmsg(), sendmmsg()
+ * - Server metrics use: mmap(MAP_SHARED | MAP_ANONYMOUS), <stdatomic.h>, clock_gettime(CLOCK_MONOTONIC)
+ * - Remote execution uses: fork(), pipe2(), ioctl(FIONREAD), splice()
+ * - The "sendfile" builtin streams files to the server with sendfile()
+ * - "send" without words streams its stdin: splice() for pipes, sendfile() for files
+ * - Prompt uses: getpwuid() and gethostname() once per process, time() and localtime_r(), one write()
+ *   of the cached prompt
  */
 
 /* Possible Improvements:
  * - Add support for multiple concurrent clients (e.g., using select(), poll(), or threads)
  * - Enhance input parsing for edge cases and escaped characters
- * - Implement advanced shell features such as command history, job control, and signal handling
+ * - Implement advanced shell features such as command history
  */
 
 /* Algorithms Used:
@@ -159,6 +217,37 @@ int main(int argc, char *argv[])
  * - Modular design to separate shell and networking functionality
  * - Child processes (via fork/exec) used for command execution without blocking shell input
  * - Pipes and file descriptor redirection used to support features like input/output redirection and pipelines
+ * - Job control (jobs.c): '&' jobs, Ctrl+Z, fg/bg/wait; SIGCHLD arrives through a signalfd that is
+ *   polled next to stdin, so finished jobs are reaped while the prompt waits for input; an
+ *   interactive shell ignores SIGINT/SIGTSTP/SIGTTIN/SIGTTOU, its programs get them back through
+ *   POSIX_SPAWN_SETSIGDEF and take the terminal inside the spawn (addtcsetpgrp_np)
+ * - "parallel" keeps N spawned jobs in flight; a pidfd per job wakes the poll() loop on exit, and
+ *   each job's stdout/stderr is collected through pipes and printed in one piece
+ * - Builtins (echo, printf, test, pwd, ...) come from a dispatch table (builtins.c) and run
+ *   inside the shell; redirections and pipe ends are swapped in with dup2() and restored afterwards
+ * - The client is one process: read_line() polls the server socket and an inactivity timerfd next
+ *   to stdin; framed replies are matched to their request id for the "latency" histogram
+ * - "rexec" (rexec.c) runs a client's command in the server's shell; each chunk of its output is
+ *   announced with a frame header sized by FIONREAD and moved pipe -> socket with splice()
+ * - Server replies go through a bounded per-connection output ring (out_ring.c) on a non-blocking
+ *   socket, flushed with one writev() per wakeup; a client that stops reading is simply not read
+ *   from until its ring drains, so it cannot stall the loop or grow the server's memory
+ * - The "uring" engine (server_uring.c) drives io_uring through raw syscalls: multishot accept and
+ *   recv pick buffers from a registered buffer ring, replies are sent from the buffer they arrived
+ *   in, and every SQE queued while handling completions is submitted by the next wait
+ * - "-w N" (server_workers.c) runs N copies of the epoll/uring loop on threads, each on its own
+ *   SO_REUSEPORT listener, optionally pinned with pthread_setaffinity_np(); they share only the
+ *   settings and an atomic client count touched on connect/disconnect for the idle shutdown
+ * - "-m name" (shm_channel.c) swaps the socket's data path for two lock-free byte rings in a
+ *   memfd; a side writes the peer's eventfd only when the peer flagged that it sleeps on an empty
+ *   or full ring, so a busy exchange needs no system call; the socket only reports hangup
+ * - "-k dgram|seqpacket" (server_dgram.c) keeps message boundaries in the transport: up to 64
+ *   messages per recvmmsg(), each answered in its own receive buffer and sent back from there with
+ *   one sendmmsg(); with -F a message carries whole frames, so nothing is reassembled
+ * - Server metrics (server_stats.c) are cache-line aligned counters per event loop in a shared
+ *   mapping made before the engine forks; each loop is the only writer of its block (relaxed
+ *   load + store, no locked instruction) and the shell process answers "-S" queries by reading
+ *   them, as a text table or in the Prometheus format, without ever stopping a worker
  */
 
 /* Special Notes:
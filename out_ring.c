@@ -0,0 +1,115 @@
+#include "out_ring.h"
+
+#include <errno.h>          // errno, EAGAIN, EINTR
+#include <stdlib.h>         // malloc(), free()
+#include <string.h>         // memcpy()
+#include <sys/socket.h>     // sendmsg(), MSG_NOSIGNAL
+
+// Releases the ring's memory
+void out_ring_free(OutRing *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+    r->head = 0;
+    r->len = 0;
+}
+
+// Bytes that can still be queued
+size_t out_ring_space(const OutRing *r)
+{
+    return OUT_RING_SIZE - r->len;
+}
+
+// Copies bytes behind the queued ones, wrapping at the end of the buffer
+static int push(OutRing *r, const char *data, size_t len)
+{
+    if (len > out_ring_space(r))
+    {
+        return -1;
+    }
+    if (!r->buf && !(r->buf = malloc(OUT_RING_SIZE)))
+    {
+        return -1;
+    }
+
+    size_t tail = (r->head + r->len) & (OUT_RING_SIZE - 1);
+    size_t first = OUT_RING_SIZE - tail < len ? OUT_RING_SIZE - tail : len;
+    memcpy(r->buf + tail, data, first);
+    memcpy(r->buf, data + first, len - first);
+    r->len += len;
+    return 0;
+}
+
+// One sendmsg() without SIGPIPE: a vanished client is an error of its connection only
+// Returns the bytes written, 0 when the socket is full, -1 on an error
+static ssize_t send_iov(int fd, const struct iovec *iov, int iovcnt)
+{
+    struct msghdr mh = { 0 };
+    mh.msg_iov = (struct iovec *)iov;
+    mh.msg_iovlen = iovcnt;
+
+    while (1)
+    {
+        ssize_t w = sendmsg(fd, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (w >= 0)
+        {
+            return w;
+        }
+        if (errno != EINTR)
+        {
+            return errno == EAGAIN ? 0 : -1;
+        }
+    }
+}
+
+// Sends iovecs, queueing what the socket does not take
+int out_ring_writev(OutRing *r, int fd, const struct iovec *iov, int iovcnt)
+{
+    ssize_t w = 0;
+
+    // Keep ordering: with output queued everything goes behind it
+    if (r->len == 0 && (w = send_iov(fd, iov, iovcnt)) == -1)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < iovcnt; i++)
+    {
+        size_t sent = (size_t)w < iov[i].iov_len ? (size_t)w : iov[i].iov_len;
+        w -= sent;
+        if (sent < iov[i].iov_len &&
+            push(r, (const char *)iov[i].iov_base + sent, iov[i].iov_len - sent) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Writes as much queued output as the socket takes, one writev per pass
+int out_ring_flush(OutRing *r, int fd)
+{
+    while (r->len > 0)
+    {
+        struct iovec iov[2];
+        size_t first = OUT_RING_SIZE - r->head < r->len ? OUT_RING_SIZE - r->head : r->len;
+        iov[0].iov_base = r->buf + r->head;
+        iov[0].iov_len = first;
+        iov[1].iov_base = r->buf;
+        iov[1].iov_len = r->len - first;
+
+        ssize_t w = send_iov(fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+        if (w == -1)
+        {
+            return -1;
+        }
+        if (w == 0)
+        {
+            return 0;  // Socket buffer is full, the caller waits for writability
+        }
+        r->head = (r->head + w) & (OUT_RING_SIZE - 1);
+        r->len -= w;
+    }
+    r->head = 0;  // Empty: start at the front again, so the next burst does not wrap
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef OUT_RING_H
+#define OUT_RING_H
+
+#include <stddef.h>     // size_t
+#include <sys/uio.h>    // struct iovec
+
+// Bounded output ring of a server connection
+//
+// Replies are written straight to the non-blocking socket while nothing is queued; whatever the
+// socket does not take lands in a fixed-size ring and leaves with one writev() per flush (two
+// iovecs when the data wraps). The ring never grows: a server stops reading from a client
+// while the ring could not hold the reply to another read, so a slow reader costs bounded
+// memory and cannot stall anybody else.
+
+// Capacity of a connection's ring (power of two)
+#define OUT_RING_SIZE (256 * 1024)
+
+// Free space a server keeps beyond one read's reply before it reads again: split frame headers
+// are echoed from a copy, and a failed "rexec" answers with a small EXIT frame
+#define OUT_RING_SLACK 256
+
+typedef struct {
+    char *buf;          // Allocated on first use, idle connections cost nothing
+    size_t head;        // Offset of the first queued byte
+    size_t len;         // Number of queued bytes
+} OutRing;
+
+// Releases the ring's memory
+void out_ring_free(OutRing *r);
+
+// Bytes that can still be queued
+size_t out_ring_space(const OutRing *r);
+
+// Sends iovecs to 'fd': directly when the ring is empty, the rest (or everything, to keep the
+// order) is queued
+// Returns 0 on success, -1 on a socket error or when the ring is full (the caller ignored
+// the backpressure, the connection must be closed)
+int out_ring_writev(OutRing *r, int fd, const struct iovec *iov, int iovcnt);
+
+// Writes as much queued output as the socket takes
+// Returns 0 when the connection is usable (check 'len' for leftovers), -1 on a socket error
+int out_ring_flush(OutRing *r, int fd);
+
+#endif // OUT_RING_H
@@ -0,0 +1,501 @@
+#include "parallel.h"
+#include "shell.h"
+
+#include <errno.h>          // errno, EINTR, EAGAIN
+#include <poll.h>           // poll()
+#include <sys/pidfd.h>      // pidfd_open()
+
+// Size of one read from a job's output pipe
+#define PARALLEL_READ_CHUNK 65536
+
+// Highest exit status, the number of failed jobs is capped here
+#define PARALLEL_MAX_FAILED 101
+
+// Output collected from one stream of a job
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} OutputBuffer;
+
+// One job slot
+typedef struct {
+    int busy;               // A job occupies the slot
+    int index;              // Position of the job's argument, for ordered output
+    pid_t pid;
+    int pidfd;              // Readable once the process exited, -1 when not available or reaped
+    int exited;             // The exit status was collected
+    int status;             // Exit status of the job
+    int out_fd;             // Read end of the stdout pipe, -1 after EOF
+    int err_fd;             // Read end of the stderr pipe, -1 after EOF
+    OutputBuffer out;
+    OutputBuffer err;
+} JobSlot;
+
+// Output of a finished job waiting for its turn (ordered mode)
+typedef struct {
+    int ready;
+    OutputBuffer out;
+    OutputBuffer err;
+} JobResult;
+
+// Writes the whole buffer, resuming partial writes
+static void write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t w = write(fd, data, len);
+        if (w == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;  // The reader is gone, the output is dropped
+        }
+        data += w;
+        len -= w;
+    }
+}
+
+// Prints a job's collected output in one piece and releases it
+static void emit_output(OutputBuffer *out, OutputBuffer *err)
+{
+    write_all(STDOUT_FILENO, out->data, out->len);
+    write_all(STDERR_FILENO, err->data, err->len);
+    free(out->data);
+    free(err->data);
+    *out = (OutputBuffer){ 0 };
+    *err = (OutputBuffer){ 0 };
+}
+
+// Reads what a pipe holds into the buffer, closes it at EOF (sets *fd to -1)
+static void drain_pipe(int *fd, OutputBuffer *buf)
+{
+    while (1)
+    {
+        if (buf->cap - buf->len < PARALLEL_READ_CHUNK)
+        {
+            size_t cap = buf->cap ? buf->cap * 2 : PARALLEL_READ_CHUNK;
+            while (cap - buf->len < PARALLEL_READ_CHUNK)
+            {
+                cap *= 2;
+            }
+            char *grown = realloc(buf->data, cap);
+            if (!grown)
+            {
+                perror("realloc");
+                return;
+            }
+            buf->data = grown;
+            buf->cap = cap;
+        }
+
+        ssize_t r = read(*fd, buf->data + buf->len, buf->cap - buf->len);
+        if (r > 0)
+        {
+            buf->len += r;
+            continue;
+        }
+        if (r == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (r == -1 && errno == EAGAIN)
+        {
+            return;  // Drained for now
+        }
+        close(*fd);
+        *fd = -1;
+        return;
+    }
+}
+
+// Builds the command of one job: "{}" becomes the argument, or it is appended when there is none
+// Returns a NULL-terminated argv, the words that needed substitution are allocated
+static char **build_argv(char **words, int count, const char *arg)
+{
+    char **argv = malloc((count + 2) * sizeof(char *));
+    if (!argv)
+    {
+        return NULL;
+    }
+
+    int substituted = 0;
+    size_t arg_len = strlen(arg);
+    for (int i = 0; i < count; i++)
+    {
+        if (!strstr(words[i], "{}"))
+        {
+            argv[i] = words[i];
+            continue;
+        }
+
+        // Every "{}" grows the word by arg_len - 2 bytes
+        size_t n = 0;
+        for (const char *p = words[i]; (p = strstr(p, "{}")); p += 2) n++;
+        char *word = malloc(strlen(words[i]) + n * arg_len + 1);
+        if (!word)
+        {
+            argv[i] = words[i];
+            continue;
+        }
+
+        char *o = word;
+        for (const char *p = words[i]; *p;)
+        {
+            if (p[0] == '{' && p[1] == '}')
+            {
+                memcpy(o, arg, arg_len);
+                o += arg_len;
+                p += 2;
+            }
+            else
+            {
+                *o++ = *p++;
+            }
+        }
+        *o = '\0';
+        argv[i] = word;
+        substituted = 1;
+    }
+
+    if (!substituted)
+    {
+        argv[count++] = (char *)arg;
+    }
+    argv[count] = NULL;
+    return argv;
+}
+
+static void free_argv(char **argv, char **words, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (argv[i] != words[i])
+        {
+            free(argv[i]);
+        }
+    }
+    free(argv);
+}
+
+// Starts the job for argument 'index' in a free slot, returns 0 on success
+static int start_job(JobSlot *slot, int index, char **words, int count, const char *arg, int null_stdin)
+{
+    int out[2], err[2];
+
+    if (pipe2(out, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+    if (pipe2(err, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+
+    char **argv = build_argv(words, count, arg);
+    SpawnIO io = {
+        .stdin_fd = -1,
+        .stdout_fd = out[1],
+        .stderr_fd = err[1],
+        .input_file = null_stdin ? "/dev/null" : NULL,  // stdin held the arguments
+        .output_file = NULL,
+        .pgid = -1,
+    };
+    pid_t pid = argv ? spawn_command(argv, &io) : -1;
+    if (argv)
+    {
+        free_argv(argv, words, count);
+    }
+    close(out[1]);
+    close(err[1]);
+
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+    fcntl(err[0], F_SETFL, O_NONBLOCK);
+
+    *slot = (JobSlot){ 0 };
+    slot->busy = 1;
+    slot->index = index;
+    slot->pid = pid;
+    slot->out_fd = out[0];
+    slot->err_fd = err[0];
+    slot->pidfd = pid > 0 ? pidfd_open(pid, 0) : -1;
+    if (pid <= 0)
+    {
+        slot->exited = 1;
+        slot->status = 127;  // spawn_command() already said why
+    }
+    return 0;
+}
+
+// Collects the exit status of a slot's process, blocking only when 'block' is set
+static void reap_job(JobSlot *slot, int block)
+{
+    int wstatus;
+    pid_t r;
+
+    while ((r = waitpid(slot->pid, &wstatus, block ? 0 : WNOHANG)) == -1 && errno == EINTR)
+    {
+    }
+    if (r == 0)
+    {
+        return;  // Not yet
+    }
+
+    slot->exited = 1;
+    slot->status = r == -1 ? 1 : WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+    if (slot->pidfd != -1)
+    {
+        close(slot->pidfd);
+        slot->pidfd = -1;
+    }
+}
+
+// Reads the whole of stdin and splits it into lines (the returned array points into *text)
+static char **read_stdin_args(int *count, char **text)
+{
+    size_t len = 0, cap = PARALLEL_READ_CHUNK;
+    char *buf = malloc(cap + 1);
+    ssize_t r;
+
+    while (buf && (r = read(STDIN_FILENO, buf + len, cap - len)) != 0)
+    {
+        if (r == -1)
+        {
+            if (errno == EINTR) continue;
+            perror("parallel: stdin");
+            break;
+        }
+        len += r;
+        if (len == cap)
+        {
+            char *grown = realloc(buf, (cap *= 2) + 1);
+            if (!grown) break;
+            buf = grown;
+        }
+    }
+    if (!buf)
+    {
+        return NULL;
+    }
+
+    // One argument per non-empty line
+    int n = 0, max = 16;
+    char **args = malloc(max * sizeof(char *));
+    char *p = buf, *end = buf + len;
+    while (args && p < end)
+    {
+        char *nl = memchr(p, '\n', end - p);
+        char *stop = nl ? nl : end;
+        *stop = '\0';
+        if (stop > p)
+        {
+            if (n == max)
+            {
+                char **grown = realloc(args, (max *= 2) * sizeof(char *));
+                if (!grown) break;
+                args = grown;
+            }
+            args[n++] = p;
+        }
+        p = stop + 1;
+    }
+
+    *count = n;
+    *text = buf;
+    return args;
+}
+
+// Runs the builtin, returns the number of failed jobs (at most 101)
+int parallel_run(int argc, char **argv)
+{
+    long slots = sysconf(_SC_NPROCESSORS_ONLN);
+    int keep_order = 0;
+    int i = 1;
+
+    // Options come before the command
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-k") == 0)
+        {
+            keep_order = 1;
+        }
+        else if (strncmp(argv[i], "-j", 2) == 0)
+        {
+            const char *value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            slots = strtol(value, NULL, 10);
+            if (slots < 1)
+            {
+                fprintf(stderr, "parallel: -j needs a positive number\n");
+                return 2;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "parallel: unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (slots < 1)
+    {
+        slots = 1;
+    }
+
+    // The command runs up to ":::", the arguments follow it (or come from stdin)
+    char **words = argv + i;
+    int word_count = 0;
+    while (i + word_count < argc && strcmp(words[word_count], ":::") != 0)
+    {
+        word_count++;
+    }
+    if (word_count == 0)
+    {
+        fprintf(stderr, "usage: parallel [-j N] [-k] command [{}] [::: arg ...]\n");
+        return 2;
+    }
+
+    char **args;
+    int arg_count;
+    char *stdin_text = NULL;
+    int from_stdin = i + word_count == argc;
+    if (from_stdin)
+    {
+        args = read_stdin_args(&arg_count, &stdin_text);
+        if (!args)
+        {
+            free(stdin_text);
+            return 1;
+        }
+    }
+    else
+    {
+        args = words + word_count + 1;
+        arg_count = argc - (i + word_count + 1);
+    }
+
+    if (slots > arg_count)
+    {
+        slots = arg_count > 0 ? arg_count : 1;
+    }
+    JobSlot *jobs = calloc(slots, sizeof(JobSlot));
+    JobResult *results = keep_order ? calloc(arg_count + 1, sizeof(JobResult)) : NULL;
+    struct pollfd *fds = malloc(slots * 3 * sizeof(struct pollfd));
+    if (!jobs || !fds || (keep_order && !results))
+    {
+        perror("malloc");
+        free(jobs);
+        free(results);
+        free(fds);
+        if (from_stdin) { free(args); free(stdin_text); }
+        return 1;
+    }
+
+    // Output printed by the shell so far must come first
+    fflush(stdout);
+
+    int next_arg = 0;       // Next argument to start
+    int next_print = 0;     // Next argument whose output is due (ordered mode)
+    int running = 0;
+    int failed = 0;
+
+    while (next_arg < arg_count || running > 0)
+    {
+        // Fill every free slot
+        for (int s = 0; s < slots && next_arg < arg_count; s++)
+        {
+            if (!jobs[s].busy)
+            {
+                if (start_job(&jobs[s], next_arg, words, word_count, args[next_arg], from_stdin) == -1)
+                {
+                    next_arg = arg_count;  // No more pipes: let the running jobs finish
+                    break;
+                }
+                next_arg++;
+                running++;
+            }
+        }
+        if (running == 0)
+        {
+            break;
+        }
+
+        // Wait for output or an exit in any slot
+        int nfds = 0;
+        for (int s = 0; s < slots; s++)
+        {
+            JobSlot *j = &jobs[s];
+            fds[nfds++] = (struct pollfd){ j->busy ? j->out_fd : -1, POLLIN, 0 };
+            fds[nfds++] = (struct pollfd){ j->busy ? j->err_fd : -1, POLLIN, 0 };
+            fds[nfds++] = (struct pollfd){ j->busy && !j->exited ? j->pidfd : -1, POLLIN, 0 };
+        }
+        if (poll(fds, nfds, -1) == -1 && errno != EINTR)
+        {
+            perror("poll");
+            break;
+        }
+
+        for (int s = 0; s < slots; s++)
+        {
+            JobSlot *j = &jobs[s];
+            if (!j->busy)
+            {
+                continue;
+            }
+            if (fds[s * 3].revents && j->out_fd != -1) drain_pipe(&j->out_fd, &j->out);
+            if (fds[s * 3 + 1].revents && j->err_fd != -1) drain_pipe(&j->err_fd, &j->err);
+            if (fds[s * 3 + 2].revents && !j->exited) reap_job(j, 0);
+
+            if (j->out_fd != -1 || j->err_fd != -1)
+            {
+                continue;
+            }
+            if (!j->exited)
+            {
+                // Both pipes closed: without a pidfd the exit is collected here
+                reap_job(j, j->pidfd == -1);
+                if (!j->exited)
+                {
+                    continue;
+                }
+            }
+
+            // The job is done: hand over its output and free the slot
+            failed += j->status != 0;
+            if (keep_order)
+            {
+                results[j->index] = (JobResult){ 1, j->out, j->err };
+                while (next_print < arg_count && results[next_print].ready)
+                {
+                    emit_output(&results[next_print].out, &results[next_print].err);
+                    next_print++;
+                }
+            }
+            else
+            {
+                emit_output(&j->out, &j->err);
+            }
+            j->busy = 0;
+            running--;
+        }
+    }
+
+    free(jobs);
+    free(results);
+    free(fds);
+    if (from_stdin)
+    {
+        free(args);
+        free(stdin_text);
+    }
+    return failed > PARALLEL_MAX_FAILED ? PARALLEL_MAX_FAILED : failed;
+}
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// "parallel" builtin: run one command over many arguments, several at a time
+//
+//   parallel [-j N] [-k] command [words with {}] [::: arg ...]
+//
+// Without ":::" the arguments are read from stdin, one per line. Every "{}" in the command is
+// replaced by the argument; without any "{}" the argument is appended as the last word.
+// N job slots (default: one per online CPU) are kept busy, a slot is refilled as soon as its
+// job finished. Each job's stdout and stderr are collected through pipes and printed in one
+// piece when the job is done, so outputs never interleave; -k prints them in argument order.
+
+// Runs the builtin, returns the number of failed jobs (at most 101, like GNU parallel)
+int parallel_run(int argc, char **argv);
+
+#endif // PARALLEL_H
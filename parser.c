@@ -0,0 +1,338 @@
+#include "parser.h"
+
+#include <stdio.h>          // fprintf()
+#include <stdlib.h>         // malloc(), free()
+#include <string.h>         // memcpy()
+
+// Size of the first arena chunk, enough for typical interactive lines without a second chunk
+#define ARENA_CHUNK_SIZE 16384
+
+// Most words a single command may have
+#define PARSER_MAX_WORDS 256
+
+// Every allocation is rounded up to this alignment
+#define ARENA_ALIGN (sizeof(void *) * 2)
+
+// Prepares an empty arena
+void arena_init(Arena *a)
+{
+    a->first = NULL;
+    a->current = NULL;
+}
+
+// Returns 'size' bytes aligned for any type, valid until the next arena_reset()
+void *arena_alloc(Arena *a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    // Walk forward through the chunks kept from earlier lines before allocating a new one
+    while (a->current && a->current->used + size > a->current->size)
+    {
+        if (!a->current->next)
+        {
+            break;
+        }
+        a->current = a->current->next;
+        a->current->used = 0;
+    }
+
+    if (!a->current || a->current->used + size > a->current->size)
+    {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + chunk_size);
+        if (!chunk)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        chunk->next = NULL;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        if (a->current)
+        {
+            // Append after the current chunk, spare chunks behind it stay reachable
+            chunk->next = a->current->next;
+            a->current->next = chunk;
+        }
+        else
+        {
+            a->first = chunk;
+        }
+        a->current = chunk;
+    }
+
+    void *p = a->current->data + a->current->used;
+    a->current->used += size;
+    return p;
+}
+
+// Forgets every allocation but keeps the chunks for the next line
+void arena_reset(Arena *a)
+{
+    a->current = a->first;
+    if (a->current)
+    {
+        a->current->used = 0;
+    }
+}
+
+// Releases every chunk
+void arena_free(Arena *a)
+{
+    ArenaChunk *chunk = a->first;
+    while (chunk)
+    {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena_init(a);
+}
+
+// Parser state while a line is scanned
+typedef struct {
+    Arena *arena;
+    char *words[PARSER_MAX_WORDS];  // Words of the command being built
+    int word_count;
+    const char *input_file;         // '<' target of the command being built
+    const char *output_file;        // '>' target of the command being built
+    int after_pipe;                 // A '|' was seen, so a command must follow
+    Pipeline *head;                 // First pipeline of the line
+    Pipeline *pipeline;             // Pipeline being built (NULL between ';')
+    Pipeline **pipeline_tail;       // Where the next pipeline is linked
+    Command **command_tail;         // Where the next stage of 'pipeline' is linked
+} ParseState;
+
+static int syntax_error(const char *what)
+{
+    fprintf(stderr, "syntax error: %s\n", what);
+    return -1;
+}
+
+// Turns the collected words and redirections into a Command of the current pipeline
+static int finish_command(ParseState *st)
+{
+    if (st->word_count == 0)
+    {
+        if (st->input_file || st->output_file)
+        {
+            return syntax_error("missing command before redirection");
+        }
+        if (st->after_pipe)
+        {
+            return syntax_error("empty pipeline stage");
+        }
+        return 0;  // Nothing between two ';' (or an empty line)
+    }
+
+    Command *cmd = arena_alloc(st->arena, sizeof(Command));
+    cmd->argc = st->word_count;
+    cmd->argv = arena_alloc(st->arena, (st->word_count + 1) * sizeof(char *));
+    memcpy(cmd->argv, st->words, st->word_count * sizeof(char *));
+    cmd->argv[st->word_count] = NULL;
+    cmd->input_file = st->input_file;
+    cmd->output_file = st->output_file;
+    cmd->next = NULL;
+
+    if (!st->pipeline)
+    {
+        st->pipeline = arena_alloc(st->arena, sizeof(Pipeline));
+        st->pipeline->count = 0;
+        st->pipeline->commands = NULL;
+        st->pipeline->background = 0;
+        st->pipeline->next = NULL;
+        st->command_tail = &st->pipeline->commands;
+        *st->pipeline_tail = st->pipeline;
+        st->pipeline_tail = &st->pipeline->next;
+    }
+    *st->command_tail = cmd;
+    st->command_tail = &cmd->next;
+    st->pipeline->count++;
+
+    st->word_count = 0;
+    st->input_file = NULL;
+    st->output_file = NULL;
+    st->after_pipe = 0;
+    return 0;
+}
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int is_operator(char c)
+{
+    return c == '|' || c == ';' || c == '&' || c == '<' || c == '>';
+}
+
+// Parses one line into a sequence of pipelines allocated in 'arena'
+int parse_line(Arena *arena, const char *src, size_t len, Pipeline **out)
+{
+    ParseState st = { 0 };
+    st.arena = arena;
+    st.pipeline_tail = &st.head;
+
+    // Unquoting only ever shrinks words, so all word text of the line fits into one block:
+    // at most 'len' characters plus one terminator per word, and there are at most 'len' words
+    char *text = arena_alloc(arena, 2 * len + 1);
+    size_t tpos = 0;
+    char pending = 0;  // '<' or '>' still waiting for its file name
+    size_t i = 0;
+
+    *out = NULL;
+
+    while (1)
+    {
+        // Skip blanks, including backslash-newline line continuations between words
+        while (i < len && (is_blank(src[i]) || (src[i] == '\\' && i + 1 < len && src[i + 1] == '\n')))
+        {
+            i += src[i] == '\\' ? 2 : 1;
+        }
+
+        // End of the line or a comment: close whatever is open
+        if (i >= len || src[i] == '#')
+        {
+            if (pending)
+            {
+                return syntax_error("missing file name after redirection");
+            }
+            if (finish_command(&st) == -1)
+            {
+                return -1;
+            }
+            break;
+        }
+
+        char c = src[i];
+        if (is_operator(c))
+        {
+            if (pending)
+            {
+                return syntax_error("missing file name after redirection");
+            }
+            i++;
+
+            if (c == '<' || c == '>')
+            {
+                pending = c;
+                continue;
+            }
+            if (c == '|' && st.word_count == 0)
+            {
+                return syntax_error("empty pipeline stage");
+            }
+            if (finish_command(&st) == -1)
+            {
+                return -1;
+            }
+            if (c == '|')
+            {
+                st.after_pipe = 1;
+            }
+            else if (c == '&')
+            {
+                // '&' ends the pipeline like ';' but runs it in the background
+                if (i < len && src[i] == '&')
+                {
+                    return syntax_error("'&&' is not supported");
+                }
+                if (!st.pipeline)
+                {
+                    return syntax_error("missing command before '&'");
+                }
+                st.pipeline->background = 1;
+                st.pipeline = NULL;
+            }
+            else
+            {
+                st.pipeline = NULL;  // ';' ends the pipeline
+            }
+            continue;
+        }
+
+        // A word: copy it into the line's text block, removing quotes and escapes on the way
+        char *word = text + tpos;
+        while (i < len && !is_blank(src[i]) && !is_operator(src[i]))
+        {
+            c = src[i++];
+            if (c == '\'')
+            {
+                // Single quotes: everything up to the next quote is literal
+                while (i < len && src[i] != '\'')
+                {
+                    text[tpos++] = src[i++];
+                }
+                if (i >= len)
+                {
+                    return syntax_error("unterminated single quote");
+                }
+                i++;
+            }
+            else if (c == '"')
+            {
+                // Double quotes: a backslash only escapes " \ $ and `, and a backslash-newline
+                // pair disappears like outside the quotes ("ec\<newline>ho" is "echo")
+                while (i < len && src[i] != '"')
+                {
+                    if (src[i] == '\\' && i + 1 < len && src[i + 1] == '\n')
+                    {
+                        i += 2;
+                        continue;
+                    }
+                    if (src[i] == '\\' && i + 1 < len &&
+                        (src[i + 1] == '"' || src[i + 1] == '\\' || src[i + 1] == '$' || src[i + 1] == '`'))
+                    {
+                        i++;
+                    }
+                    text[tpos++] = src[i++];
+                }
+                if (i >= len)
+                {
+                    return syntax_error("unterminated double quote");
+                }
+                i++;
+            }
+            else if (c == '\\')
+            {
+                // Backslash outside quotes keeps the next character literal,
+                // a backslash-newline pair is a line continuation and disappears
+                if (i < len && src[i] == '\n')
+                {
+                    i++;
+                }
+                else if (i < len)
+                {
+                    text[tpos++] = src[i++];
+                }
+            }
+            else
+            {
+                text[tpos++] = c;
+            }
+        }
+        text[tpos++] = '\0';
+
+        if (pending == '<')
+        {
+            st.input_file = word;
+        }
+        else if (pending == '>')
+        {
+            st.output_file = word;
+        }
+        else if (st.word_count == PARSER_MAX_WORDS - 1)
+        {
+            return syntax_error("too many arguments");
+        }
+        else
+        {
+            st.words[st.word_count++] = word;
+        }
+        pending = 0;
+    }
+
+    *out = st.head;
+    return 0;
+}
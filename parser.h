@@ -0,0 +1,67 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>     // size_t
+
+// Single-pass lexer/parser for shell command lines
+//
+// Grammar (one line):
+//   list      := pipeline { (';' | '&') pipeline } [ ';' | '&' ]
+//   pipeline  := command { '|' command }
+//   command   := { word | '<' word | '>' word }
+//   word      := characters, 'single quoted', "double quoted" (\" \\ \$ \` escapes) or \x escapes
+// A '#' at the start of a word starts a comment that runs to the end of the line.
+//
+// Every node and every word lives in an Arena that is reset after each line,
+// so parsing a line costs no malloc() per token.
+
+// Bump allocator made of chained chunks, reset in O(chunks) without freeing
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;    // Next (older or spare) chunk
+    size_t size;                // Usable bytes in 'data'
+    size_t used;                // Bytes handed out from 'data'
+    char data[];                // Chunk storage
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *first;          // First chunk, kept across resets
+    ArenaChunk *current;        // Chunk allocations are served from
+} Arena;
+
+// Prepares an empty arena (the first chunk is allocated lazily)
+void arena_init(Arena *a);
+
+// Returns 'size' bytes aligned for any type, valid until the next arena_reset()
+void *arena_alloc(Arena *a, size_t size);
+
+// Forgets every allocation but keeps the chunks for the next line
+void arena_reset(Arena *a);
+
+// Releases every chunk
+void arena_free(Arena *a);
+
+// A simple command with its redirections
+typedef struct Command {
+    int argc;                   // Number of words
+    char **argv;                // NULL-terminated words
+    const char *input_file;     // Target of '<', NULL for none
+    const char *output_file;    // Target of '>', NULL for none
+    struct Command *next;       // Next stage of the same pipeline
+} Command;
+
+// Commands connected with '|'
+typedef struct Pipeline {
+    int count;                  // Number of stages
+    Command *commands;          // First stage
+    int background;             // Ended with '&': started as a job without waiting for it
+    struct Pipeline *next;      // Next pipeline of the sequence (after ';' or '&')
+} Pipeline;
+
+// Parses one line into a sequence of pipelines allocated in 'arena'
+// Arguments:
+//  - src / len: The text to parse, it does not have to be NUL-terminated and is never modified
+//  - out: Receives the first pipeline (NULL for an empty line or a comment)
+// Returns 0 on success, -1 on a syntax error (a message is printed to stderr)
+int parse_line(Arena *arena, const char *src, size_t len, Pipeline **out);
+
+#endif // PARSER_H
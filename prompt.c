@@ -0,0 +1,227 @@
+#include "prompt.h"
+#include "shell.h"
+
+#include <limits.h>         // PATH_MAX, LONG_MAX
+
+// Longest template and longest rendered prompt
+#define PROMPT_MAX_TEMPLATE 256
+#define PROMPT_MAX_RENDERED 1024
+
+// Kinds of segments a template compiles into
+typedef enum {
+    SEG_LITERAL,    // Plain text copied from the template
+    SEG_USER,       // \u
+    SEG_HOST,       // \h
+    SEG_HOST_FULL,  // \H
+    SEG_TIME,       // \t
+    SEG_CWD,        // \w
+    SEG_CWD_BASE,   // \W
+    SEG_PRIVILEGE,  // \$
+} SegmentType;
+
+// One compiled piece of the prompt
+typedef struct {
+    SegmentType type;
+    const char *text;   // Literal text (points into the template copy), only for SEG_LITERAL
+    size_t len;         // Length of 'text'
+} Segment;
+
+static char template_text[PROMPT_MAX_TEMPLATE];
+static char literal_pool[PROMPT_MAX_TEMPLATE];   // Unescaped literal text of all segments
+static Segment segments[PROMPT_MAX_TEMPLATE];
+static int segment_count = 0;
+static int compiled = 0;
+
+// Values resolved once per process
+static char user_name[256];
+static char host_full[256];
+static char host_short[256];
+static char privilege[2];
+static int identity_resolved = 0;
+
+// Working directory, refreshed after "cd"
+static char cwd[PATH_MAX];
+static int cwd_valid = 0;
+
+// The fully rendered prompt and until when it stays correct
+static char rendered[PROMPT_MAX_RENDERED];
+static size_t rendered_len = 0;
+static time_t rendered_until = 0;   // 0 = must render again
+static int uses_time = 0;
+static int uses_cwd = 0;
+
+// Compiles a new template into segments
+void prompt_set_template(const char *tmpl)
+{
+    size_t pool = 0;
+
+    strncpy(template_text, tmpl, sizeof(template_text) - 1);
+    template_text[sizeof(template_text) - 1] = '\0';
+    segment_count = 0;
+    uses_time = 0;
+    uses_cwd = 0;
+
+    for (const char *p = template_text; *p; p++)
+    {
+        SegmentType type = SEG_LITERAL;
+        char literal = *p;
+
+        if (*p == '\\' && p[1])
+        {
+            p++;
+            switch (*p)
+            {
+                case 'u': type = SEG_USER; break;
+                case 'h': type = SEG_HOST; break;
+                case 'H': type = SEG_HOST_FULL; break;
+                case 't': type = SEG_TIME; uses_time = 1; break;
+                case 'w': type = SEG_CWD; uses_cwd = 1; break;
+                case 'W': type = SEG_CWD_BASE; uses_cwd = 1; break;
+                case '$': type = SEG_PRIVILEGE; break;
+                case 'n': literal = '\n'; break;
+                default:  literal = *p; break;     // "\\" and unknown escapes stand for themselves
+            }
+        }
+
+        if (type != SEG_LITERAL)
+        {
+            segments[segment_count++] = (Segment){ type, NULL, 0 };
+            continue;
+        }
+
+        // Consecutive literal characters share one segment
+        if (segment_count > 0 && segments[segment_count - 1].type == SEG_LITERAL)
+        {
+            literal_pool[pool++] = literal;
+            segments[segment_count - 1].len++;
+        }
+        else
+        {
+            literal_pool[pool] = literal;
+            segments[segment_count++] = (Segment){ SEG_LITERAL, literal_pool + pool, 1 };
+            pool++;
+        }
+    }
+
+    compiled = 1;
+    rendered_until = 0;
+}
+
+// Returns the template currently in use
+const char *prompt_get_template(void)
+{
+    if (!compiled)
+    {
+        const char *env = getenv("SHELL_PROMPT");
+        prompt_set_template(env ? env : PROMPT_DEFAULT_TEMPLATE);
+    }
+    return template_text;
+}
+
+// Tells the prompt the working directory changed
+void prompt_invalidate_cwd(void)
+{
+    cwd_valid = 0;
+    if (uses_cwd)
+    {
+        rendered_until = 0;
+    }
+}
+
+// Resolves user and host once, getpwuid() may go through NSS/LDAP and is too slow per prompt
+static void resolve_identity(void)
+{
+    struct passwd *pw = getpwuid(getuid());
+    const char *name = pw ? pw->pw_name : getenv("USER");
+
+    snprintf(user_name, sizeof(user_name), "%s", name ? name : "?");
+    if (gethostname(host_full, sizeof(host_full)) == -1)
+    {
+        strcpy(host_full, "?");
+    }
+    host_full[sizeof(host_full) - 1] = '\0';
+    snprintf(host_short, sizeof(host_short), "%.*s", (int)strcspn(host_full, "."), host_full);
+    strcpy(privilege, getuid() == 0 ? "#" : "$");
+    identity_resolved = 1;
+}
+
+// Appends a string to the rendered prompt, truncating at the buffer end
+static void append(const char *text, size_t len)
+{
+    if (rendered_len + len >= sizeof(rendered))
+    {
+        len = sizeof(rendered) - 1 - rendered_len;
+    }
+    memcpy(rendered + rendered_len, text, len);
+    rendered_len += len;
+}
+
+// Renders every segment into the cached prompt
+static void render(time_t now)
+{
+    struct tm timeinfo;
+    char time_str[6];
+
+    localtime_r(&now, &timeinfo);
+    rendered_len = 0;
+
+    if (uses_cwd && !cwd_valid)
+    {
+        if (!getcwd(cwd, sizeof(cwd)))
+        {
+            strcpy(cwd, "?");
+        }
+        cwd_valid = 1;
+    }
+
+    for (int i = 0; i < segment_count; i++)
+    {
+        const Segment *seg = &segments[i];
+        switch (seg->type)
+        {
+            case SEG_LITERAL:   append(seg->text, seg->len); break;
+            case SEG_USER:      append(user_name, strlen(user_name)); break;
+            case SEG_HOST:      append(host_short, strlen(host_short)); break;
+            case SEG_HOST_FULL: append(host_full, strlen(host_full)); break;
+            case SEG_PRIVILEGE: append(privilege, 1); break;
+            case SEG_CWD:       append(cwd, strlen(cwd)); break;
+            case SEG_CWD_BASE:
+            {
+                const char *base = strrchr(cwd, '/');
+                base = (base && base[1]) ? base + 1 : cwd;
+                append(base, strlen(base));
+                break;
+            }
+            case SEG_TIME:
+                strftime(time_str, sizeof(time_str), "%H:%M", &timeinfo);
+                append(time_str, strlen(time_str));
+                break;
+        }
+    }
+
+    // The text stays correct until the next minute starts (or forever without \t)
+    rendered_until = uses_time ? now - timeinfo.tm_sec + 60 : (time_t)LONG_MAX;
+}
+
+// Display the shell prompt from the cached rendering, with a single write()
+void display_shell_prompt()
+{
+    if (!compiled)
+    {
+        prompt_get_template();
+    }
+    if (!identity_resolved)
+    {
+        resolve_identity();
+    }
+
+    time_t now = time(NULL);
+    if (rendered_until == 0 || now >= rendered_until)
+    {
+        render(now);
+    }
+
+    // Anything printed through stdio so far must appear before the prompt
+    fflush(stdout);
+    write(STDOUT_FILENO, rendered, rendered_len);
+}
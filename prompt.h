@@ -0,0 +1,26 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+// Prompt templates (PS1-like), compiled once into a list of segments
+//
+// Supported escapes:
+//   \u  user name          \h  host name up to the first '.'   \H  full host name
+//   \t  time as HH:MM      \w  current directory               \W  last component of \w
+//   \$  '#' for root, '$' otherwise                             \n  newline      \\  backslash
+//
+// User and host are resolved once, the time is refreshed at most once per minute and the
+// directory only after "cd", so displaying a prompt is normally a single write() of a cached string.
+
+// Template used when neither SHELL_PROMPT nor the "prompt" builtin set one (the classic prompt)
+#define PROMPT_DEFAULT_TEMPLATE "\\t \\u@\\h# "
+
+// Compiles a new template, it takes effect at the next prompt
+void prompt_set_template(const char *tmpl);
+
+// Returns the template currently in use
+const char *prompt_get_template(void);
+
+// Tells the prompt the working directory changed (called by "cd")
+void prompt_invalidate_cwd(void);
+
+#endif // PROMPT_H
@@ -0,0 +1,273 @@
+#include "protocol.h"
+#include "transform.h"
+
+#include <stdlib.h>         // realloc()
+#include <string.h>         // memcpy()
+#include <arpa/inet.h>      // htonl(), ntohl()
+
+// Serializes a header into FRAME_HEADER_LEN bytes
+void frame_encode_header(unsigned char *out, uint8_t type, uint32_t id, uint64_t len)
+{
+    uint32_t net_id = htonl(id);
+    uint32_t len_hi = htonl((uint32_t)(len >> 32));
+    uint32_t len_lo = htonl((uint32_t)len);
+
+    out[0] = FRAME_MAGIC_0;
+    out[1] = FRAME_MAGIC_1;
+    out[2] = FRAME_VERSION;
+    out[3] = type;
+    memcpy(out + 4, &net_id, 4);
+    memcpy(out + 8, &len_hi, 4);
+    memcpy(out + 12, &len_lo, 4);
+}
+
+// Parses FRAME_HEADER_LEN bytes, returns -1 when the magic or version does not match
+int frame_decode_header(const unsigned char *in, FrameHeader *h)
+{
+    uint32_t net_id, len_hi, len_lo;
+
+    if (in[0] != FRAME_MAGIC_0 || in[1] != FRAME_MAGIC_1 || in[2] != FRAME_VERSION)
+    {
+        return -1;
+    }
+
+    memcpy(&net_id, in + 4, 4);
+    memcpy(&len_hi, in + 8, 4);
+    memcpy(&len_lo, in + 12, 4);
+
+    h->type = in[3];
+    h->id = ntohl(net_id);
+    h->len = ((uint64_t)ntohl(len_hi) << 32) | ntohl(len_lo);
+    return 0;
+}
+
+// Feeds received bytes through the decoder, calling the handler for every header and payload chunk
+int frame_feed(FrameDecoder *d, char *buf, size_t len, const FrameHandler *h, void *ctx)
+{
+    size_t pos = 0;
+
+    while (pos < len)
+    {
+        if (!d->in_payload)
+        {
+            // Collect header bytes, a header may be split across several reads
+            size_t take = FRAME_HEADER_LEN - d->hdr_have;
+            if (take > len - pos)
+            {
+                take = len - pos;
+            }
+            memcpy(d->hdr + d->hdr_have, buf + pos, take);
+            d->hdr_have += take;
+            pos += take;
+
+            if (d->hdr_have < FRAME_HEADER_LEN)
+            {
+                break;  // Wait for the rest of the header
+            }
+
+            d->hdr_have = 0;
+            if (frame_decode_header(d->hdr, &d->cur) == -1)
+            {
+                return -1;
+            }
+            d->frames++;
+            if (h->on_header && h->on_header(ctx, &d->cur) == -1)
+            {
+                return -1;
+            }
+
+            d->remaining = d->cur.len;
+            d->in_payload = 1;
+        }
+
+        // Hand over as much of the payload as this buffer holds
+        size_t chunk = len - pos;
+        if (chunk > d->remaining)
+        {
+            chunk = d->remaining;
+        }
+        if (chunk > 0 && h->on_payload && h->on_payload(ctx, &d->cur, buf + pos, chunk) == -1)
+        {
+            return -1;
+        }
+        pos += chunk;
+        d->remaining -= chunk;
+
+        if (d->remaining == 0)
+        {
+            d->in_payload = 0;
+            if (h->on_end && h->on_end(ctx, &d->cur) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Most reply spans collected before frame_serve() hands them to 'emit'
+#define FRAME_SERVE_IOV 64
+
+// Reply spans of one frame_serve() call
+typedef struct {
+    struct iovec iov[FRAME_SERVE_IOV];
+    int iovcnt;
+    unsigned char hdr_copies[FRAME_SERVE_IOV][FRAME_HEADER_LEN];  // Headers that began in an earlier read
+    int copies;
+    frame_emit_fn emit;
+    void *ctx;
+} ReplySpans;
+
+static int flush_spans(ReplySpans *r)
+{
+    int rc = r->iovcnt > 0 ? r->emit(r->ctx, r->iov, r->iovcnt) : 0;
+    r->iovcnt = 0;
+    r->copies = 0;
+    return rc;
+}
+
+// Adds bytes to the reply, merged with the previous span when they follow it directly
+static int add_span(ReplySpans *r, void *data, size_t len)
+{
+    if (r->iovcnt > 0)
+    {
+        struct iovec *last = &r->iov[r->iovcnt - 1];
+        if ((char *)last->iov_base + last->iov_len == data)
+        {
+            last->iov_len += len;
+            return 0;
+        }
+    }
+    if (r->iovcnt == FRAME_SERVE_IOV && flush_spans(r) == -1)
+    {
+        return -1;
+    }
+    r->iov[r->iovcnt].iov_base = data;
+    r->iov[r->iovcnt].iov_len = len;
+    r->iovcnt++;
+    return 0;
+}
+
+// Server side of a connection: answers DATA frames in place and collects EXEC frames
+ssize_t frame_serve(FrameDecoder *d, FrameExecRequest *req, char *buf, size_t len, frame_emit_fn emit, void *ctx)
+{
+    ReplySpans r;
+    size_t pos = 0;
+
+    r.iovcnt = 0;
+    r.copies = 0;
+    r.emit = emit;
+    r.ctx = ctx;
+
+    while (pos < len)
+    {
+        if (!d->in_payload)
+        {
+            // Collect header bytes; a partial header is held back until its type is known
+            size_t start = pos;
+            size_t had = d->hdr_have;
+            size_t take = FRAME_HEADER_LEN - had;
+            if (take > len - pos)
+            {
+                take = len - pos;
+            }
+            memcpy(d->hdr + had, buf + pos, take);
+            d->hdr_have += take;
+            pos += take;
+
+            if (d->hdr_have < FRAME_HEADER_LEN)
+            {
+                break;
+            }
+            d->hdr_have = 0;
+            if (frame_decode_header(d->hdr, &d->cur) == -1)
+            {
+                return -1;
+            }
+            d->frames++;
+            d->remaining = d->cur.len;
+            d->in_payload = 1;
+
+            if (d->cur.type == FRAME_DATA)
+            {
+                // The reply header equals the request header: echo it from the buffer when it
+                // arrived in one piece, from a copy when it was split across reads
+                void *hdr = buf + start;
+                if (had > 0)
+                {
+                    if (r.copies == FRAME_SERVE_IOV && flush_spans(&r) == -1)
+                    {
+                        return -1;
+                    }
+                    hdr = memcpy(r.hdr_copies[r.copies++], d->hdr, FRAME_HEADER_LEN);
+                }
+                if (add_span(&r, hdr, FRAME_HEADER_LEN) == -1)
+                {
+                    return -1;
+                }
+            }
+            else if (d->cur.type == FRAME_EXEC && d->cur.len <= FRAME_EXEC_MAX)
+            {
+                if (req->cap < d->cur.len + 1)
+                {
+                    char *grown = realloc(req->cmd, d->cur.len + 1);
+                    if (!grown)
+                    {
+                        return -1;
+                    }
+                    req->cmd = grown;
+                    req->cap = d->cur.len + 1;
+                }
+                req->id = d->cur.id;
+                req->len = 0;
+            }
+            else
+            {
+                return -1;  // Not a request type, or a command that is too long
+            }
+        }
+
+        size_t chunk = len - pos;
+        if (chunk > d->remaining)
+        {
+            chunk = d->remaining;
+        }
+        if (chunk > 0)
+        {
+            if (d->cur.type == FRAME_DATA)
+            {
+                transform_upper(buf + pos, chunk);
+                if (add_span(&r, buf + pos, chunk) == -1)
+                {
+                    return -1;
+                }
+            }
+            else
+            {
+                memcpy(req->cmd + req->len, buf + pos, chunk);
+                req->len += chunk;
+            }
+        }
+        pos += chunk;
+        d->remaining -= chunk;
+
+        if (d->remaining == 0)
+        {
+            d->in_payload = 0;
+            if (d->cur.type == FRAME_EXEC)
+            {
+                // Replies so far go out first, then the caller runs the command
+                req->cmd[req->len] = '\0';
+                req->ready = 1;
+                break;
+            }
+        }
+    }
+
+    if (flush_spans(&r) == -1)
+    {
+        return -1;
+    }
+    return pos;
+}
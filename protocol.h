@@ -0,0 +1,90 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+// Length-prefixed framing used when client and server run with "-F"
+//
+// Every message is a fixed 16-byte header followed by 'len' payload bytes:
+//   offset 0  u8[2]  magic "UP"
+//   offset 2  u8     protocol version (FRAME_VERSION)
+//   offset 3  u8     frame type (FRAME_*)
+//   offset 4  u32    request id chosen by the sender, echoed in the reply
+//   offset 8  u64    payload length
+// Multi-byte fields are in network byte order. Payloads may be of any size and
+// may arrive split across reads, several frames may also share a single read.
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // Fixed-width integer types
+#include <sys/types.h>  // ssize_t
+#include <sys/uio.h>    // struct iovec
+
+#define FRAME_HEADER_LEN 16
+#define FRAME_MAGIC_0 'U'
+#define FRAME_MAGIC_1 'P'
+#define FRAME_VERSION 1
+
+// Frame types
+#define FRAME_DATA   0  // Text to transform (request) or transformed text (reply)
+#define FRAME_EXEC   1  // Command line for the server's shell (request)
+#define FRAME_STDOUT 2  // Chunk of the command's stdout (reply, id of the EXEC request)
+#define FRAME_STDERR 3  // Chunk of the command's stderr (reply, id of the EXEC request)
+#define FRAME_EXIT   4  // The command finished, payload: u32 exit status (reply)
+
+// Longest command line accepted in an EXEC frame
+#define FRAME_EXEC_MAX 65536
+
+// Decoded frame header
+typedef struct {
+    uint8_t type;       // One of FRAME_*
+    uint32_t id;        // Request id, replies carry the id of their request
+    uint64_t len;       // Number of payload bytes following the header
+} FrameHeader;
+
+// Incremental decoder state, one per connection direction
+typedef struct {
+    unsigned char hdr[FRAME_HEADER_LEN];    // Header bytes collected so far
+    size_t hdr_have;                        // How many header bytes are in 'hdr'
+    FrameHeader cur;                        // Header of the frame whose payload is being read
+    uint64_t remaining;                     // Payload bytes of 'cur' still expected
+    int in_payload;                         // Non-zero while payload bytes of 'cur' are expected
+    uint64_t frames;                        // Headers decoded so far (the server's message count)
+} FrameDecoder;
+
+// Callbacks invoked by frame_feed(), any of them may be NULL
+// Returning -1 from a callback stops decoding and makes frame_feed() fail
+typedef struct {
+    int (*on_header)(void *ctx, const FrameHeader *h);                          // A complete header arrived
+    int (*on_payload)(void *ctx, const FrameHeader *h, char *data, size_t len); // Next chunk of the payload
+    int (*on_end)(void *ctx, const FrameHeader *h);                             // The whole payload arrived
+} FrameHandler;
+
+// Command line collected from an EXEC frame by frame_serve()
+typedef struct {
+    char *cmd;              // NUL-terminated command once 'ready' is set
+    size_t len;             // Bytes collected so far
+    size_t cap;             // Allocated size of 'cmd'
+    uint32_t id;            // Request id, the output frames carry it
+    int ready;              // A whole command arrived and waits to be run
+} FrameExecRequest;
+
+// Receives reply bytes from frame_serve(), must send or copy them before returning (it may modify the array)
+// Returns 0 on success, -1 when the connection failed
+typedef int (*frame_emit_fn)(void *ctx, struct iovec *iov, int iovcnt);
+
+// Serializes a header into FRAME_HEADER_LEN bytes
+void frame_encode_header(unsigned char *out, uint8_t type, uint32_t id, uint64_t len);
+
+// Parses FRAME_HEADER_LEN bytes, returns -1 when the magic or version does not match
+int frame_decode_header(const unsigned char *in, FrameHeader *h);
+
+// Feeds received bytes through the decoder, calling the handler for every header and payload chunk
+// Returns 0 on success, -1 on a malformed header or when a callback failed
+int frame_feed(FrameDecoder *d, char *buf, size_t len, const FrameHandler *h, void *ctx);
+
+// Server side of a connection: DATA payloads are upper-cased in place and echoed with their
+// headers through 'emit' (normally as one iovec per read), EXEC payloads are collected into 'req'.
+// Decoding pauses right after a complete EXEC frame, so the caller can run the command before
+// any later request in the same buffer is answered.
+// Returns the number of bytes consumed (less than 'len' after an EXEC frame), -1 on a malformed stream
+ssize_t frame_serve(FrameDecoder *d, FrameExecRequest *req, char *buf, size_t len, frame_emit_fn emit, void *ctx);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,261 @@
+#include "rexec.h"
+#include "shell.h"
+#include "jobs.h"
+
+#include <arpa/inet.h>      // htonl()
+#include <errno.h>          // errno, EAGAIN, EINTR
+#include <fcntl.h>          // open(), splice(), pipe2()
+#include <poll.h>           // poll()
+#include <signal.h>         // kill(), signal(), SIGKILL
+#include <sys/ioctl.h>      // ioctl(FIONREAD)
+#include <sys/socket.h>     // send(), MSG_MORE
+#include <sys/wait.h>       // waitpid()
+
+// Child side: the pipes become stdout/stderr, then the line goes through the shell executor
+static void run_child(int out_w, int err_w, const char *cmd)
+{
+    int null_fd = open("/dev/null", O_RDONLY);
+
+    setpgid(0, 0);  // Own group, so an abort reaches every process of the command
+    signal(SIGPIPE, SIG_DFL);  // The epoll engine ignores it, the command's pipelines need it
+    jobs_reset_signals();  // An interactive server shell ignores the keyboard signals
+    if (null_fd != -1)
+    {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    dup2(out_w, STDOUT_FILENO);
+    dup2(err_w, STDERR_FILENO);
+    close(out_w);
+    close(err_w);
+
+    // Line-buffered, so builtin output streams as it is produced
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    char *line = strdup(cmd);
+    if (!line)
+    {
+        exit(1);
+    }
+    process_line(line, -1, 0);
+    fflush(stdout);
+    exit(shell_last_status());
+}
+
+// Forks the child that runs the command
+int rexec_start(RemoteExec *x, uint32_t id, const char *cmd)
+{
+    int out[2], err[2];
+
+    memset(x, 0, sizeof(*x));
+    x->id = id;
+    x->splice_fd = -1;
+    x->fds[0] = -1;
+    x->fds[1] = -1;
+
+    if (pipe2(out, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        return -1;
+    }
+    if (pipe2(err, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+
+    fflush(stdout);  // Nothing buffered may be written twice
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        close(out[0]);
+        close(out[1]);
+        close(err[0]);
+        close(err[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(out[0]);
+        close(err[0]);
+        run_child(out[1], err[1], cmd);
+    }
+
+    setpgid(pid, pid);  // Also here, so the group exists before an early abort
+    close(out[1]);
+    close(err[1]);
+    x->pid = pid;
+    x->fds[0] = out[0];
+    x->fds[1] = err[0];
+    return 0;
+}
+
+// Exit status of the reaped child, in the shell's convention
+static int reap_child(RemoteExec *x)
+{
+    int status = 0;
+
+    while (waitpid(x->pid, &status, 0) == -1 && errno == EINTR)
+    {
+    }
+    x->pid = 0;
+    if (WIFSIGNALED(status))
+    {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+// Writes the rest of 'pending'
+// Returns 1 when done, 0 when the socket is full, -1 on error
+static int write_pending(RemoteExec *x, int sock)
+{
+    while (x->pending_off < x->pending_len)
+    {
+        // A header is followed by its spliced payload: MSG_MORE lets both leave in one segment
+        int flags = MSG_NOSIGNAL | (x->splice_left > 0 ? MSG_MORE : 0);
+        ssize_t w = send(sock, x->pending + x->pending_off, x->pending_len - x->pending_off, flags);
+        if (w > 0)
+        {
+            x->pending_off += w;
+            continue;
+        }
+        if (w == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        return w == -1 && errno == EAGAIN ? 0 : -1;
+    }
+    return 1;
+}
+
+// Moves every output byte available now to the socket
+int rexec_pump(RemoteExec *x, int sock)
+{
+    while (1)
+    {
+        // Finish the frame in progress: header first, then its payload straight from the pipe
+        int rc = write_pending(x, sock);
+        if (rc != 1)
+        {
+            return rc;
+        }
+        if (x->exit_queued)
+        {
+            return 1;
+        }
+        while (x->splice_left > 0)
+        {
+            ssize_t s = splice(x->splice_fd, NULL, sock, NULL, x->splice_left, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (s > 0)
+            {
+                x->splice_left -= s;
+                continue;
+            }
+            if (s == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            return s == -1 && errno == EAGAIN ? 0 : -1;
+        }
+
+        // Announce the next chunk, stdout first
+        struct pollfd p[2] = {
+            { x->eof[0] ? -1 : x->fds[0], POLLIN, 0 },
+            { x->eof[1] ? -1 : x->fds[1], POLLIN, 0 },
+        };
+        if (poll(p, 2, 0) == -1 && errno != EINTR)
+        {
+            return -1;
+        }
+
+        int announced = 0;
+        for (int i = 0; i < 2 && !announced; i++)
+        {
+            int avail = 0;
+            if (p[i].fd == -1 || !(p[i].revents & (POLLIN | POLLHUP)))
+            {
+                continue;
+            }
+            if (ioctl(p[i].fd, FIONREAD, &avail) == -1 || avail == 0)
+            {
+                // Nothing left and the child's end is closed: this stream is over
+                // (the descriptor stays open until rexec_release(), so its owner can unregister it)
+                if (p[i].revents & POLLHUP)
+                {
+                    x->eof[i] = 1;
+                }
+                continue;
+            }
+            frame_encode_header(x->pending, i == 0 ? FRAME_STDOUT : FRAME_STDERR, x->id, avail);
+            x->pending_off = 0;
+            x->pending_len = FRAME_HEADER_LEN;
+            x->splice_fd = p[i].fd;
+            x->splice_left = avail;
+            announced = 1;
+        }
+        if (announced)
+        {
+            continue;
+        }
+
+        if (!x->eof[0] || !x->eof[1])
+        {
+            return 0;  // Waiting for more output
+        }
+
+        // Both streams ended: report the exit status
+        uint32_t status = htonl(reap_child(x));
+        frame_encode_header(x->pending, FRAME_EXIT, x->id, sizeof(status));
+        memcpy(x->pending + FRAME_HEADER_LEN, &status, sizeof(status));
+        x->pending_off = 0;
+        x->pending_len = FRAME_HEADER_LEN + sizeof(status);
+        x->exit_queued = 1;
+    }
+}
+
+// Pumps until the command finished, waiting in poll() in between
+int rexec_run(RemoteExec *x, int sock)
+{
+    while (1)
+    {
+        int rc = rexec_pump(x, sock);
+        if (rc != 0)
+        {
+            return rc == 1 ? 0 : -1;
+        }
+
+        // Wait for the socket while a frame is half written, for the pipes otherwise
+        int busy = x->pending_off < x->pending_len || x->splice_left > 0;
+        struct pollfd p[3] = {
+            { busy || x->eof[0] ? -1 : x->fds[0], POLLIN, 0 },
+            { busy || x->eof[1] ? -1 : x->fds[1], POLLIN, 0 },
+            { busy ? sock : -1, POLLOUT, 0 },
+        };
+        if (poll(p, 3, -1) == -1 && errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+// Releases the pipes, killing the command first when it still runs
+void rexec_release(RemoteExec *x)
+{
+    if (x->pid > 0)
+    {
+        kill(-x->pid, SIGKILL);
+        reap_child(x);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (x->fds[i] != -1)
+        {
+            close(x->fds[i]);
+            x->fds[i] = -1;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef REXEC_H
+#define REXEC_H
+
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint32_t
+#include <sys/types.h>      // pid_t
+#include "protocol.h"       // FRAME_HEADER_LEN
+
+// Server side of "rexec": runs a client's command line through the shell and streams its output
+//
+// The command runs in a forked child whose stdout and stderr are pipes. Whatever sits in a pipe
+// is announced with a STDOUT/STDERR frame header sized by FIONREAD and then moved to the socket
+// with splice(), so the bytes never pass through user space. An EXIT frame with the status ends
+// the stream. The same client connection is reused for every command.
+
+// One running command
+typedef struct {
+    pid_t pid;              // Child running the command, 0 once reaped
+    uint32_t id;            // Request id carried by every output frame
+    int fds[2];             // Read ends of the child's stdout and stderr, -1 once released
+    int eof[2];             // The stream at the same index ended
+    int splice_fd;          // Pipe whose announced bytes are being moved, -1 when none
+    size_t splice_left;     // Announced bytes not spliced yet
+    unsigned char pending[FRAME_HEADER_LEN + 4];  // Frame header (or whole EXIT frame) being written
+    size_t pending_off;     // Bytes of 'pending' already written
+    size_t pending_len;     // Size of the frame in 'pending'
+    int exit_queued;        // The EXIT frame is in 'pending'
+} RemoteExec;
+
+// Forks the child that runs 'cmd' (NUL-terminated) in a new process group
+// Returns 0 on success, -1 when the pipes or the child could not be created
+int rexec_start(RemoteExec *x, uint32_t id, const char *cmd);
+
+// Moves every output byte available now to 'sock', works with blocking and non-blocking sockets
+// Returns 1 when the EXIT frame went out, 0 when it must be called again once the pipes or
+// the socket are ready, -1 when the socket failed
+int rexec_pump(RemoteExec *x, int sock);
+
+// Runs rexec_pump() until the command finished, waiting in poll() in between
+// Returns 0 on success, -1 when the socket failed
+int rexec_run(RemoteExec *x, int sock);
+
+// Releases the pipes once the command finished, or kills its process group first when it
+// still runs (the client went away)
+void rexec_release(RemoteExec *x);
+
+#endif // REXEC_H
@@ -0,0 +1,485 @@
+#include "server_utils.h"
+#include "shell.h"
+#include "transform.h"
+#include "protocol.h"
+
+#include <errno.h>          // errno, EAGAIN, EINTR
+#include <signal.h>         // SIGTERM for the parent-death signal
+#include <sys/epoll.h>      // epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/prctl.h>      // prctl(PR_SET_PDEATHSIG)
+#include <sys/wait.h>       // waitpid()
+
+// Messages received with one recvmmsg() and answered with one sendmmsg()
+#define DGRAM_BATCH 64
+
+// Largest message taken, a bigger one is dropped (UDP's own limit is 65507 bytes)
+#define DGRAM_MSG_MAX 65536
+
+// Maximum number of events handled per epoll_wait() call
+#define DGRAM_MAX_EVENTS 64
+
+// A seqpacket connection (the datagram socket serves every sender without per-peer state)
+typedef struct DgramPeer {
+    int fd;                 // Connected socket (non-blocking)
+    char *backlog;          // Replies the socket did not take yet, each a u32 length and the bytes
+    size_t backlog_len;     // Bytes used in 'backlog'
+    size_t backlog_off;     // Start of the first reply not sent yet
+    size_t backlog_cap;     // Allocated size of 'backlog'
+    int closed;             // Closed during this epoll_wait() batch, freed after it
+    struct DgramPeer *next_closed;  // Link in the batch's list of closed peers
+} DgramPeer;
+
+// State of one event loop (one per worker thread with "-w")
+// The listening (or datagram) socket is registered with a NULL data pointer, peers store their DgramPeer
+typedef struct {
+    ServerWorker *worker;   // Socket and settings of this loop
+    int epfd;               // epoll instance of this loop
+    int active_clients;     // Seqpacket peers served by this loop
+    char *bufs;             // DGRAM_BATCH receive buffers of DGRAM_MSG_MAX bytes, replies are built in place
+    struct iovec iov[DGRAM_BATCH];                  // One buffer per message
+    struct sockaddr_storage addrs[DGRAM_BATCH];     // Senders of the datagrams, the replies go back there
+    struct mmsghdr in[DGRAM_BATCH];                 // recvmmsg() batch
+    struct mmsghdr out[DGRAM_BATCH];                // sendmmsg() batch, points at the same buffers
+} DgramLoop;
+
+// Turns a message into its reply in place
+// Raw text is upper-cased; with -F the message must hold whole DATA frames, their payloads are
+// upper-cased behind the unchanged headers; no reassembly, the transport kept the boundaries
+// Returns the number of requests it held (frames with -F), -1 when it is malformed
+static int answer_message(DgramLoop *lp, char *buf, size_t len)
+{
+    if (!lp->worker->server->framed)
+    {
+        transform_upper(buf, len);
+        return 1;
+    }
+
+    size_t pos = 0;
+    int frames = 0;
+    while (pos < len)
+    {
+        FrameHeader h;
+        if (len - pos < FRAME_HEADER_LEN || frame_decode_header((unsigned char *)buf + pos, &h) == -1 ||
+            h.type != FRAME_DATA || h.len > len - pos - FRAME_HEADER_LEN)
+        {
+            return -1;  // A frame split across messages, or a "rexec" the engine does not run
+        }
+        transform_upper(buf + pos + FRAME_HEADER_LEN, h.len);
+        pos += FRAME_HEADER_LEN + h.len;
+        frames++;
+    }
+    return frames;
+}
+
+// Stop reading a peer while its backlog drains, and resume once it did
+static int watch_peer(DgramLoop *lp, DgramPeer *p)
+{
+    struct epoll_event ev;
+    ev.events = p->backlog_len > 0 ? EPOLLOUT : EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = p;
+    return epoll_ctl(lp->epfd, EPOLL_CTL_MOD, p->fd, &ev);
+}
+
+// Keeps a reply the peer's socket did not take
+static int backlog_add(DgramPeer *p, const char *data, uint32_t len)
+{
+    if (p->backlog_len + sizeof(len) + len > p->backlog_cap)
+    {
+        size_t cap = p->backlog_cap ? p->backlog_cap : DGRAM_MSG_MAX;
+        while (cap < p->backlog_len + sizeof(len) + len)
+        {
+            cap *= 2;
+        }
+        char *grown = realloc(p->backlog, cap);
+        if (!grown)
+        {
+            perror("realloc");
+            return -1;
+        }
+        p->backlog = grown;
+        p->backlog_cap = cap;
+    }
+    memcpy(p->backlog + p->backlog_len, &len, sizeof(len));
+    memcpy(p->backlog + p->backlog_len + sizeof(len), data, len);
+    p->backlog_len += sizeof(len) + len;
+    return 0;
+}
+
+// Sends the backlog one reply at a time (the slow path of a peer that stopped reading)
+// Returns 0 while the peer stays connected, -1 when it must be closed
+static int flush_backlog(DgramLoop *lp, DgramPeer *p)
+{
+    while (p->backlog_off < p->backlog_len)
+    {
+        uint32_t len;
+        memcpy(&len, p->backlog + p->backlog_off, sizeof(len));
+        ssize_t w = send(p->fd, p->backlog + p->backlog_off + sizeof(len), len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN ? 0 : -1;
+        }
+        p->backlog_off += sizeof(len) + len;
+    }
+    p->backlog_len = p->backlog_off = 0;
+    return watch_peer(lp, p);
+}
+
+// Sends 'count' replies of the batch back to the datagram senders
+// A reply that cannot leave (sender gone, its queue full) is lost, like any datagram
+static void send_datagrams(DgramLoop *lp, int fd, int count)
+{
+    int done = 0;
+    while (done < count)
+    {
+        int r = sendmmsg(fd, lp->out + done, count - done, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (r == -1)
+        {
+            if (errno != EINTR)
+            {
+                done++;  // Skip the reply that failed, the rest may still go out
+            }
+            continue;
+        }
+        done += r;
+    }
+}
+
+// Sends 'count' replies of the batch to a seqpacket peer; what its socket does not take waits in
+// the backlog, and the peer is not read from until that drained
+// Returns 0 while the peer stays connected, -1 when it must be closed
+static int send_to_peer(DgramLoop *lp, DgramPeer *p, int count)
+{
+    int done = 0;
+    while (done < count)
+    {
+        int r = sendmmsg(p->fd, lp->out + done, count - done, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (r == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                break;
+            }
+            return -1;
+        }
+        done += r;
+    }
+    if (done == count)
+    {
+        return 0;
+    }
+
+    for (int i = done; i < count; i++)
+    {
+        struct iovec *iov = lp->out[i].msg_hdr.msg_iov;
+        if (backlog_add(p, iov->iov_base, iov->iov_len) == -1)
+        {
+            return -1;
+        }
+    }
+    return watch_peer(lp, p);
+}
+
+// Receives up to DGRAM_BATCH messages with one recvmmsg(), answers them in place and sends the
+// replies with one sendmmsg(); 'p' is the seqpacket peer, NULL for the datagram socket
+// Returns 0, or -1 when the peer must be closed
+static int serve_batch(DgramLoop *lp, int fd, DgramPeer *p)
+{
+    for (int i = 0; i < DGRAM_BATCH; i++)
+    {
+        lp->iov[i].iov_len = DGRAM_MSG_MAX;
+        lp->in[i].msg_hdr.msg_name = p ? NULL : &lp->addrs[i];
+        lp->in[i].msg_hdr.msg_namelen = p ? 0 : sizeof(lp->addrs[i]);
+    }
+
+    int n = recvmmsg(fd, lp->in, DGRAM_BATCH, MSG_DONTWAIT, NULL);
+    if (n == -1)
+    {
+        // On the datagram socket an error is about an earlier reply (e.g. ICMP unreachable), not fatal
+        return errno == EAGAIN || errno == EINTR || !p ? 0 : -1;
+    }
+
+    uint64_t start = stats_now();
+    size_t bytes_in = 0, bytes_out = 0;
+    int messages = 0;
+    int count = 0;
+    int eof = p && n == 0;
+    for (int i = 0; i < n; i++)
+    {
+        size_t len = lp->in[i].msg_len;
+        int answered = len == 0 || (lp->in[i].msg_hdr.msg_flags & MSG_TRUNC) ? -1 :
+                       answer_message(lp, lp->iov[i].iov_base, len);
+        int bad = answered == -1;
+        bytes_in += len;
+        if (bad && p)
+        {
+            eof = 1;  // End of the connection, or a peer that does not speak our protocol
+            break;
+        }
+        if (bad)
+        {
+            continue;  // The datagram is dropped
+        }
+
+        // The reply leaves from the receive buffer, to the address it came from
+        lp->iov[i].iov_len = len;
+        lp->out[count].msg_hdr = lp->in[i].msg_hdr;
+        count++;
+        messages += answered;
+        bytes_out += len;
+    }
+
+    // One batch is booked like one read of the stream engines
+    WorkerStats *stats = lp->worker->stats;
+    uint64_t busy = stats_now() - start;
+    int rc = 0;
+    if (p)
+    {
+        // Requests before the end of the connection are still answered
+        rc = send_to_peer(lp, p, count);
+        rc = eof ? -1 : rc;
+    }
+    else
+    {
+        send_datagrams(lp, fd, count);
+    }
+    if (n > 0)
+    {
+        stats_add(&stats->bytes_out, bytes_out);
+        stats_read_done(stats, bytes_in, messages, busy, stats_now() - start);
+    }
+    return rc;
+}
+
+// Closes a seqpacket peer, it is freed once the current batch of events is handled
+static void close_peer(DgramLoop *lp, DgramPeer *p)
+{
+    close(p->fd);  // Closing the descriptor also removes it from the epoll set
+    p->closed = 1;
+    stats_add(&lp->worker->stats->closed, 1);
+    lp->active_clients--;
+    atomic_fetch_sub(lp->worker->connected, 1);
+}
+
+// Accept pending seqpacket connections, their first message is the banner
+// An own listener is drained until EAGAIN; one shared with other workers is exclusive and
+// hands out one connection per wakeup
+static void accept_peers(DgramLoop *lp)
+{
+    const char *banner = SERVER_BANNER;
+
+    do
+    {
+        int fd = accept4(lp->worker->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN)
+            {
+                perror("accept");
+            }
+            return;
+        }
+
+        DgramPeer *p = calloc(1, sizeof(DgramPeer));
+        if (!p)
+        {
+            perror("calloc");
+            close(fd);
+            continue;
+        }
+        p->fd = fd;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = p;
+        if (epoll_ctl(lp->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            perror("epoll_ctl");
+            close(fd);
+            free(p);
+            continue;
+        }
+        lp->active_clients++;
+        atomic_fetch_add(lp->worker->connected, 1);
+        stats_add(&lp->worker->stats->accepted, 1);
+
+        // Framed clients get the banner as frame 0, header and text in one message
+        unsigned char hdr[FRAME_HEADER_LEN];
+        struct iovec iov[2] = { { hdr, sizeof(hdr) }, { (void *)banner, strlen(banner) } };
+        struct msghdr mh = { 0 };
+        frame_encode_header(hdr, FRAME_DATA, 0, strlen(banner));
+        mh.msg_iov = lp->worker->server->framed ? iov : iov + 1;
+        mh.msg_iovlen = lp->worker->server->framed ? 2 : 1;
+        ssize_t sent = sendmsg(fd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent == -1)
+        {
+            close_peer(lp, p);
+            free(p);
+            continue;
+        }
+        stats_add(&lp->worker->stats->bytes_out, sent);
+    } while (!lp->worker->shared_listener);
+}
+
+// Event loop of one worker: the datagram socket, or the seqpacket listener and its peers
+// Returns 0 once nothing arrived for the time limit, -1 on a fatal error
+static int dgram_loop(ServerWorker *worker)
+{
+    ServerConnection *server = worker->server;
+    struct epoll_event events[DGRAM_MAX_EVENTS];
+    DgramLoop *lp = calloc(1, sizeof(DgramLoop));
+    int result = -1;
+
+    if (!lp || !(lp->bufs = malloc((size_t)DGRAM_BATCH * DGRAM_MSG_MAX)))
+    {
+        perror("malloc");
+        free(lp);
+        return -1;
+    }
+    lp->worker = worker;
+    for (int i = 0; i < DGRAM_BATCH; i++)
+    {
+        lp->iov[i].iov_base = lp->bufs + (size_t)i * DGRAM_MSG_MAX;
+        lp->in[i].msg_hdr.msg_iov = &lp->iov[i];
+        lp->in[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    lp->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (lp->epfd == -1)
+    {
+        perror("epoll_create1");
+        goto out;
+    }
+
+    // Level-triggered: a batch takes at most DGRAM_BATCH messages, the rest wakes us again
+    struct epoll_event ev;
+    ev.events = worker->shared_listener ? EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN;
+    ev.data.ptr = NULL;
+    if (fcntl(worker->listen_fd, F_SETFL, fcntl(worker->listen_fd, F_GETFL, 0) | O_NONBLOCK) == -1 ||
+        epoll_ctl(lp->epfd, EPOLL_CTL_ADD, worker->listen_fd, &ev) == -1)
+    {
+        perror("epoll_ctl");
+        close(lp->epfd);
+        goto out;
+    }
+
+    while (1)
+    {
+        // Datagrams keep no connection, so the time limit counts from the last message
+        int timeout = lp->active_clients > 0 ? -1 : server->time_limit * 1000;
+        int n = epoll_wait(lp->epfd, events, DGRAM_MAX_EVENTS, timeout);
+
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        if (n == 0)
+        {
+            // Idle here, but other workers may still serve peers
+            if (atomic_load(worker->connected) == 0)
+            {
+                result = 0;
+                break;
+            }
+            continue;
+        }
+
+        DgramPeer *closed = NULL;
+        for (int i = 0; i < n; i++)
+        {
+            DgramPeer *p = events[i].data.ptr;
+            if (p == NULL)
+            {
+                if (server->sock_type == SOCK_DGRAM)
+                {
+                    serve_batch(lp, worker->listen_fd, NULL);
+                }
+                else
+                {
+                    accept_peers(lp);
+                }
+                continue;
+            }
+
+            int failed = (events[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+            if (!failed && (events[i].events & EPOLLOUT))
+            {
+                failed = flush_backlog(lp, p) == -1;
+            }
+            if (!failed && p->backlog_len == 0 && (events[i].events & (EPOLLIN | EPOLLRDHUP)))
+            {
+                failed = serve_batch(lp, p->fd, p) == -1;
+            }
+            if (failed)
+            {
+                close_peer(lp, p);
+                p->next_closed = closed;
+                closed = p;
+            }
+        }
+
+        // Nothing in this batch refers to the closed peers any more
+        while (closed)
+        {
+            DgramPeer *next = closed->next_closed;
+            free(closed->backlog);
+            free(closed);
+            closed = next;
+        }
+    }
+
+    close(lp->epfd);
+out:
+    free(lp->bufs);
+    free(lp);
+    return result;
+}
+
+// Function to run the datagram engine
+// The event loop runs in a child process while the parent keeps the interactive shell,
+// the same split as the epoll engine
+// Arguments:
+//  - server: The server connection object with a bound datagram socket or seqpacket listener
+void handle_server_dgram(ServerConnection *server)
+{
+    pid_t pid = fork();
+
+    if (pid == -1)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0)
+    {
+        // Child process: stop serving once the shell that owns us goes away
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+        run_server_workers(server, dgram_loop);
+        cleanup(server);
+        exit(0);
+    }
+
+    // Parent process: run the shell for additional commands
+    run_shell(-1, 0);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    cleanup(server);
+}
@@ -0,0 +1,609 @@
+#include "server_utils.h"
+#include "shell.h"
+#include "transform.h"
+#include "protocol.h"
+#include "rexec.h"
+#include "out_ring.h"
+#include "shm_channel.h"
+
+#include <errno.h>          // errno, EAGAIN, EINTR
+#include <signal.h>         // SIGTERM for the parent-death signal, SIGPIPE
+#include <sys/epoll.h>      // epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/prctl.h>      // prctl(PR_SET_PDEATHSIG)
+
+// Maximum number of events handled per epoll_wait() call
+#define EPOLL_MAX_EVENTS 256
+
+// Size of the buffer used to drain a readable client socket
+#define EPOLL_READ_CHUNK 65536
+
+// Per-connection state of the epoll engine
+// Every client owns its socket and the bytes the kernel has not accepted yet
+typedef struct ClientState {
+    int fd;             // Connected client socket (non-blocking)
+    OutRing out;        // Output the socket did not take yet (bounded)
+    ShmChannel *shm;    // Shared-memory rings replacing the socket's data path ("-m"), or NULL
+    int throttled;      // Reading paused until the ring has room for another reply
+    int framed;         // Connection speaks the length-prefixed protocol
+    FrameDecoder dec;   // Reassembly state of the framed protocol
+    FrameExecRequest req;   // Command line of a "rexec" request
+    RemoteExec exec;    // Command streaming its output, valid while 'exec_running'
+    int exec_running;   // Reading stops while a command runs, so replies keep their order
+    char *pending;      // Input that arrived behind the running command
+    size_t pending_len; // Number of bytes in 'pending'
+    size_t pending_cap; // Allocated size of 'pending'
+    int closed;         // Closed during this epoll_wait() batch, freed after it
+    struct ClientState *next_closed;    // Link in the batch's list of closed clients
+    WorkerStats *stats; // Counters of the loop serving this client
+    uint64_t write_ns;  // Time spent writing replies for the current read
+} ClientState;
+
+// State of one event loop (one per worker thread with "-w")
+// The listening socket is registered with a NULL data pointer, clients store their ClientState
+typedef struct {
+    ServerWorker *worker;   // Listener and settings of this loop
+    int epfd;               // epoll instance of this loop
+    int active_clients;     // Clients served by this loop
+} EpollLoop;
+
+// Switch a descriptor to non-blocking mode
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1)
+    {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Emit callback of frame_serve(): one writev() for the replies, the unsent rest is queued
+// A shared-memory client's ring is its output queue; backpressure keeps room for every reply
+static int emit_to_client(void *ctx, struct iovec *iov, int iovcnt)
+{
+    ClientState *c = ctx;
+    uint64_t start = stats_now();
+    size_t len = 0;
+    int rc;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        len += iov[i].iov_len;
+    }
+    if (c->shm)
+    {
+        rc = shm_channel_writev(c->shm, iov, iovcnt) == len ? 0 : -1;
+    }
+    else
+    {
+        rc = out_ring_writev(&c->out, c->fd, iov, iovcnt);
+    }
+    stats_add(&c->stats->bytes_out, len);
+    c->write_ns += stats_now() - start;
+    return rc;
+}
+
+// Send bytes to a client, writing directly when nothing is queued and buffering the rest
+static int send_to_client(ClientState *c, const char *data, size_t len)
+{
+    struct iovec iov = { (void *)data, len };
+    return emit_to_client(c, &iov, 1);
+}
+
+// Bytes the client's output can still take
+static size_t output_space(ClientState *c)
+{
+    return c->shm ? shm_channel_space(c->shm) : out_ring_space(&c->out);
+}
+
+// Whether the output lacks room for 'need' more bytes; a shared-memory client is then asked to
+// wake us once it consumed some (a socket client raises EPOLLOUT by itself)
+static int output_full(ClientState *c, size_t need)
+{
+    if (output_space(c) >= need)
+    {
+        return 0;
+    }
+    return !c->shm || shm_channel_want_space(c->shm, need) == 0;
+}
+
+// Read a client's next requests from its socket or its ring
+static ssize_t read_client(ClientState *c, char *buf, size_t len)
+{
+    return c->shm ? shm_channel_read(c->shm, buf, len) : read(c->fd, buf, len);
+}
+
+// Stop watching the pipes of the client's command and release it (killed if still running)
+static void finish_exec(ClientState *c, EpollLoop *lp)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        // Unregister explicitly: a command forked for another client may still hold a copy
+        epoll_ctl(lp->epfd, EPOLL_CTL_DEL, c->exec.fds[i], NULL);
+    }
+    rexec_release(&c->exec);
+    c->exec_running = 0;
+}
+
+// Remove a client from the loop; its memory is freed after the current batch of events,
+// which may still name it (its socket and its command's pipes share the ClientState)
+static void close_client(ClientState *c, EpollLoop *lp)
+{
+    if (c->exec_running)
+    {
+        finish_exec(c, lp);
+    }
+    if (c->shm)
+    {
+        // The client holds the same eventfd, so closing ours would not unregister it
+        epoll_ctl(lp->epfd, EPOLL_CTL_DEL, c->shm->wake_fd, NULL);
+        shm_channel_close(c->shm);
+    }
+    close(c->fd);  // Closing the descriptor also removes it from the epoll set
+    c->closed = 1;
+    stats_add(&c->stats->closed, 1);
+    lp->active_clients--;
+    atomic_fetch_sub(lp->worker->connected, 1);
+}
+
+// Free a closed client
+static void free_client(ClientState *c)
+{
+    out_ring_free(&c->out);
+    free(c->shm);
+    free(c->req.cmd);
+    free(c->pending);
+    free(c);
+}
+
+// Start the command of a "rexec" request, its pipes wake the client like its socket does
+// Returns 0 when it runs, -1 when it could not be started
+static int start_exec(ClientState *c, EpollLoop *lp)
+{
+    if (rexec_start(&c->exec, c->req.id, c->req.cmd) == -1)
+    {
+        return -1;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = c;
+        if (epoll_ctl(lp->epfd, EPOLL_CTL_ADD, c->exec.fds[i], &ev) == -1)
+        {
+            perror("epoll_ctl");
+            c->exec_running = 1;
+            finish_exec(c, lp);
+            return -1;
+        }
+    }
+    c->exec_running = 1;
+    return 0;
+}
+
+// Keep input that arrived behind a command until the command finished
+static int stash_input(ClientState *c, const char *data, size_t len)
+{
+    if (len > c->pending_cap)
+    {
+        char *grown = realloc(c->pending, len);
+        if (!grown)
+        {
+            perror("realloc");
+            return -1;
+        }
+        c->pending = grown;
+        c->pending_cap = len;
+    }
+    memmove(c->pending, data, len);  // 'data' may point into 'pending' itself
+    c->pending_len = len;
+    return 0;
+}
+
+// Answer one buffer of requests
+// Returns 0 when the client stays connected, -1 when it must be closed
+static int handle_input(ClientState *c, EpollLoop *lp, char *buf, size_t len)
+{
+    if (!c->framed)
+    {
+        // Convert the message to uppercase (vectorized kernel picked for this CPU)
+        transform_upper(buf, len);
+        return send_to_client(c, buf, len);
+    }
+
+    // Payloads are upper-cased in place and echoed with their headers, so pipelined
+    // requests in this buffer are answered with a single writev
+    while (len > 0)
+    {
+        ssize_t used = frame_serve(&c->dec, &c->req, buf, len, emit_to_client, c);
+        if (used == -1)
+        {
+            return -1;  // Not our protocol, drop the client
+        }
+        buf += used;
+        len -= used;
+
+        if (c->req.ready)
+        {
+            c->req.ready = 0;
+            if (c->shm)
+            {
+                // The command's output is spliced into a socket, there is none to splice into
+                static const char reason[] = "rexec: not available over shared memory\n";
+                unsigned char hdr[FRAME_HEADER_LEN];
+                struct iovec iov[2] = { { hdr, sizeof(hdr) }, { (void *)reason, sizeof(reason) - 1 } };
+                frame_encode_header(hdr, FRAME_STDERR, c->req.id, sizeof(reason) - 1);
+                if (emit_to_client(c, iov, 2) == -1)
+                {
+                    return -1;
+                }
+            }
+            else if (start_exec(c, lp) == 0)
+            {
+                return stash_input(c, buf, len);
+            }
+
+            // Report it like a command that cannot be executed
+            unsigned char frame[FRAME_HEADER_LEN + 4];
+            uint32_t status = htonl(126);
+            frame_encode_header(frame, FRAME_EXIT, c->req.id, sizeof(status));
+            memcpy(frame + FRAME_HEADER_LEN, &status, sizeof(status));
+            if (send_to_client(c, (const char *)frame, sizeof(frame)) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Answer one buffer of requests and book it in the loop's counters
+// 'fresh' bytes of it were just read, the rest was held back behind a command
+// Returns 0 when the client stays connected, -1 when it must be closed
+static int handle_counted(ClientState *c, EpollLoop *lp, char *buf, size_t len, size_t fresh)
+{
+    uint64_t start = stats_now();
+    uint64_t frames = c->dec.frames;
+    c->write_ns = 0;
+    int rc = handle_input(c, lp, buf, len);
+    uint64_t elapsed = stats_now() - start;
+    stats_read_done(c->stats, fresh, c->framed ? c->dec.frames - frames : 1, elapsed - c->write_ns, elapsed);
+    return rc;
+}
+
+// Hand a new client its shared-memory rings; its socket then only tells when it went away
+// Returns 0 on success, -1 when the client must be closed
+static int attach_shm(ClientState *c, EpollLoop *lp)
+{
+    c->shm = malloc(sizeof(ShmChannel));
+    if (!c->shm || shm_channel_accept(c->shm, c->fd) == -1)
+    {
+        perror("shm");
+        free(c->shm);
+        c->shm = NULL;
+        return -1;
+    }
+
+    // The client writes our eventfd after producing into (or consuming from) an empty (full) ring
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(lp->epfd, EPOLL_CTL_ADD, c->shm->wake_fd, &ev) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+// Accept pending connections
+// An own listener is edge-triggered and drained until EAGAIN; a listener shared with other
+// workers is level-triggered and exclusive, taking one connection per wakeup spreads them out
+static void accept_clients(EpollLoop *lp)
+{
+    const char *banner = SERVER_BANNER;
+
+    do
+    {
+        // Non-blocking and close-on-exec in the same call, so commands run by "rexec" do not inherit it
+        int fd = accept4(lp->worker->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN)
+            {
+                perror("accept");
+            }
+            return;
+        }
+
+        ClientState *c = calloc(1, sizeof(ClientState));
+        if (!c)
+        {
+            perror("calloc");
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->framed = lp->worker->server->framed;
+        c->stats = lp->worker->stats;
+
+        // Register for both directions once, edge-triggered, so no epoll_ctl is needed per write
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = c;
+        if (epoll_ctl(lp->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            perror("epoll_ctl");
+            close(fd);
+            free(c);
+            continue;
+        }
+        lp->active_clients++;
+        atomic_fetch_add(lp->worker->connected, 1);
+        stats_add(&c->stats->accepted, 1);
+
+        if (lp->worker->server->shm && attach_shm(c, lp) == -1)
+        {
+            close_client(c, lp);
+            free_client(c);
+            continue;
+        }
+
+        // Framed clients get the banner as frame 0
+        unsigned char hdr[FRAME_HEADER_LEN];
+        int failed = 0;
+        if (c->framed)
+        {
+            frame_encode_header(hdr, FRAME_DATA, 0, strlen(banner));
+            failed = send_to_client(c, (const char *)hdr, sizeof(hdr)) == -1;
+        }
+        if (failed || send_to_client(c, banner, strlen(banner)) == -1)
+        {
+            close_client(c, lp);
+            free_client(c);
+        }
+    } while (!lp->worker->shared_listener);
+}
+
+// Drain a readable client, transform every chunk and queue the replies
+// Returns 0 when the client stays connected, -1 when it must be closed
+static int serve_client(ClientState *c, EpollLoop *lp)
+{
+    char buff[EPOLL_READ_CHUNK];
+
+    // Requests that arrived behind a finished command are answered first
+    if (c->pending_len > 0)
+    {
+        if (output_full(c, c->pending_len + OUT_RING_SLACK))
+        {
+            c->throttled = 1;
+            return 0;
+        }
+        size_t len = c->pending_len;
+        c->pending_len = 0;
+        if (handle_counted(c, lp, c->pending, len, 0) == -1)
+        {
+            return -1;
+        }
+    }
+
+    // No reading while a command runs: the kernel buffers the requests meanwhile
+    while (!c->exec_running)
+    {
+        // Backpressure: a client that does not read its replies is not read from either,
+        // its requests wait in the kernel until the ring has room for the answer
+        if (output_full(c, sizeof(buff) + OUT_RING_SLACK))
+        {
+            c->throttled = 1;
+            return 0;
+        }
+
+        ssize_t r = read_client(c, buff, sizeof(buff));
+        if (r == 0)
+        {
+            return -1;  // Client closed the connection
+        }
+        if (r == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN ? 0 : -1;
+        }
+
+        if (handle_counted(c, lp, buff, r, r) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Move the running command's output once the queued replies are out
+// Returns 1 when the command finished, 0 while it runs, -1 when the client must be closed
+static int pump_exec(ClientState *c, EpollLoop *lp)
+{
+    if (c->out.len > 0)
+    {
+        return 0;  // Its frames go out behind the queue, EPOLLOUT resumes
+    }
+
+    int rc = rexec_pump(&c->exec, c->fd);
+    if (rc == 1)
+    {
+        finish_exec(c, lp);
+    }
+    return rc;
+}
+
+// Event loop of the epoll engine: serves every client of this worker's listener
+// Returns 0 once nobody was connected for the time limit, -1 on a fatal error
+static int epoll_loop(ServerWorker *worker)
+{
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    ServerConnection *server = worker->server;
+    EpollLoop loop = { worker, -1, 0 };
+    EpollLoop *lp = &loop;
+    int result = -1;
+
+    // A client that disconnects mid-reply must not take down every other connection
+    // (splice() has no MSG_NOSIGNAL); failed writes surface as EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+
+    lp->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (lp->epfd == -1)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    if (set_nonblocking(worker->listen_fd) == -1)
+    {
+        perror("fcntl");
+        close(lp->epfd);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = worker->shared_listener ? EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(lp->epfd, EPOLL_CTL_ADD, worker->listen_fd, &ev) == -1)
+    {
+        perror("epoll_ctl");
+        close(lp->epfd);
+        return -1;
+    }
+
+    while (1)
+    {
+        // The time limit only applies while nobody is connected, like the select engine
+        int timeout = lp->active_clients > 0 ? -1 : server->time_limit * 1000;
+        int n = epoll_wait(lp->epfd, events, EPOLL_MAX_EVENTS, timeout);
+
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        if (n == 0)
+        {
+            // Idle here, but other workers may still serve clients
+            if (atomic_load(worker->connected) == 0)
+            {
+                result = 0;
+                break;
+            }
+            continue;
+        }
+
+        ClientState *closed = NULL;
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                accept_clients(lp);
+                continue;
+            }
+            ClientState *c = events[i].data.ptr;
+            int failed = 0;
+            int resume = 0;
+
+            // Also woken by its command's pipes, which carry no socket events
+            if (c->closed)
+            {
+                continue;
+            }
+
+            // A shared-memory client's eventfd says its rings moved, its socket only reports hangup
+            if (c->shm)
+            {
+                shm_channel_ack(c->shm);
+                failed = (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+                resume = 1;
+            }
+
+            // Flush first so replies produced below are not reordered behind stale output
+            if (!failed && (events[i].events & EPOLLOUT))
+            {
+                failed = out_ring_flush(&c->out, c->fd) == -1;
+
+                // Edge-triggered: requests that waited during backpressure raise no new
+                // EPOLLIN, so reading resumes by hand once the ring drained
+                if (!failed && c->throttled && c->out.len == 0)
+                {
+                    c->throttled = 0;
+                    resume = 1;
+                }
+            }
+            if (!failed && c->exec_running)
+            {
+                int rc = pump_exec(c, lp);
+                failed = rc == -1;
+                resume = rc == 1;  // Requests held back behind the command are due now
+            }
+            if (!failed && !c->exec_running &&
+                (resume || (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))))
+            {
+                failed = serve_client(c, lp) == -1;
+            }
+            if (failed)
+            {
+                close_client(c, lp);
+                c->next_closed = closed;
+                closed = c;
+            }
+        }
+
+        // Nothing in this batch refers to the closed clients any more
+        while (closed)
+        {
+            ClientState *next = closed->next_closed;
+            free_client(closed);
+            closed = next;
+        }
+    }
+
+    close(lp->epfd);
+    return result;
+}
+
+// Function to run the epoll engine
+// The event loop runs in a child process while the parent keeps the interactive shell,
+// mirroring the select engine where the shell and the client handling run side by side
+// Arguments:
+//  - server: The server connection object with a bound, listening socket
+void handle_server_epoll(ServerConnection *server)
+{
+    pid_t pid = fork();
+
+    if (pid == -1)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0)
+    {
+        // Child process: stop serving once the shell that owns us goes away
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+        run_server_workers(server, epoll_loop);
+        cleanup(server);
+        exit(0);
+    }
+
+    // Parent process: run the shell for additional commands
+    run_shell(-1, 0);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    cleanup(server);
+}
@@ -0,0 +1,399 @@
+#include "server_stats.h"
+
+#include <errno.h>          // errno, EINTR
+#include <stdlib.h>         // calloc(), free()
+#include <string.h>         // strncpy(), strcpy(), strcmp(), strcspn(), memchr()
+#include <sys/mman.h>       // mmap() of the shared counters
+#include <sys/socket.h>     // socket(), bind(), listen(), accept4(), send()
+#include <sys/un.h>         // struct sockaddr_un
+#include <unistd.h>         // read(), write(), close(), unlink(), getpid()
+
+#include "shell.h"          // shell_watch_fd() serves the control socket from the input loop
+
+// Upper bounds of the Prometheus latency buckets, in nanoseconds (1 µs .. 1 s)
+static const uint64_t prom_bounds[] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000, 1000000000,
+};
+#define PROM_BOUNDS (sizeof(prom_bounds) / sizeof(prom_bounds[0]))
+
+// Request lines accepted on the control socket
+#define STATS_REQUEST_MAX 64
+
+// Counters seen by the control socket handler
+typedef struct {
+    const WorkerStats *stats;
+    int workers;
+    int fd;                         // Control socket, -1 when not listening
+    pid_t owner;                    // Process serving it (the engines fork copies of this state)
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+} StatsSource;
+
+static StatsSource source = { .fd = -1 };
+
+// One consistent-enough copy of a worker's counters
+// Each value is read on its own; a request finishing meanwhile may show up in one counter and
+// not yet in another, which a monitoring scrape does not care about
+typedef struct {
+    uint64_t accepted;
+    uint64_t closed;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t messages;
+    uint64_t transform_ns;
+    Histogram latency;
+} StatsSnapshot;
+
+// Books one handled read
+void stats_read_done(WorkerStats *s, size_t len, uint64_t messages, uint64_t busy_ns, uint64_t latency_ns)
+{
+    stats_add(&s->bytes_in, len);
+    stats_add(&s->messages, messages);
+    stats_add(&s->transform_ns, busy_ns);
+    stats_add(&s->latency_sum_ns, latency_ns);
+    stats_add(&s->latency[hist_bucket_index(latency_ns)], 1);
+}
+
+// Maps zeroed counters, shared with the processes forked later
+WorkerStats *stats_create(int workers)
+{
+    WorkerStats *stats = mmap(NULL, workers * sizeof(WorkerStats), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return stats == MAP_FAILED ? NULL : stats;
+}
+
+// Copies the counters of one worker
+// The latency buckets become a regular Histogram; min and max are only known up to their buckets
+static void snapshot(StatsSnapshot *snap, const WorkerStats *s)
+{
+    snap->accepted = atomic_load_explicit(&s->accepted, memory_order_relaxed);
+    snap->closed = atomic_load_explicit(&s->closed, memory_order_relaxed);
+    snap->bytes_in = atomic_load_explicit(&s->bytes_in, memory_order_relaxed);
+    snap->bytes_out = atomic_load_explicit(&s->bytes_out, memory_order_relaxed);
+    snap->messages = atomic_load_explicit(&s->messages, memory_order_relaxed);
+    snap->transform_ns = atomic_load_explicit(&s->transform_ns, memory_order_relaxed);
+
+    Histogram *h = &snap->latency;
+    hist_init(h);
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        uint64_t n = atomic_load_explicit(&s->latency[i], memory_order_relaxed);
+        if (n == 0)
+        {
+            continue;
+        }
+        h->counts[i] = n;
+        h->total += n;
+        if (h->min == UINT64_MAX)
+        {
+            h->min = hist_bucket_upper(i);
+        }
+        h->max = hist_bucket_upper(i);
+    }
+    h->sum = atomic_load_explicit(&s->latency_sum_ns, memory_order_relaxed);
+}
+
+// Adds the counters of one worker to the totals
+static void snapshot_merge(StatsSnapshot *dst, const StatsSnapshot *src)
+{
+    dst->accepted += src->accepted;
+    dst->closed += src->closed;
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+    dst->messages += src->messages;
+    dst->transform_ns += src->transform_ns;
+    hist_merge(&dst->latency, &src->latency);
+}
+
+// One row of the text table
+static void report_row(FILE *out, const char *name, const StatsSnapshot *s)
+{
+    fprintf(out, "%-8s %10llu %8llu %12llu %14llu %14llu %14.3f %9.1f %9.1f\n", name,
+            (unsigned long long)s->accepted, (unsigned long long)(s->accepted - s->closed),
+            (unsigned long long)s->messages, (unsigned long long)s->bytes_in,
+            (unsigned long long)s->bytes_out, s->transform_ns / 1e6,
+            hist_percentile(&s->latency, 50) / 1e3, hist_percentile(&s->latency, 99) / 1e3);
+}
+
+// Writes one metric of every worker in the Prometheus exposition format
+static void report_metric(FILE *out, const char *name, const char *type, const char *help,
+                          const double *values, int workers)
+{
+    fprintf(out, "# HELP shellnet_%s %s\n# TYPE shellnet_%s %s\n", name, help, name, type);
+    for (int i = 0; i < workers; i++)
+    {
+        fprintf(out, "shellnet_%s{worker=\"%d\"} %.9g\n", name, i, values[i]);
+    }
+}
+
+// Writes the counters of every worker and their totals
+void stats_report(FILE *out, const WorkerStats *stats, int workers, int prometheus)
+{
+    // A snapshot carries a whole histogram, too big to keep one per worker on the stack
+    StatsSnapshot *snaps = calloc(workers + 1, sizeof(StatsSnapshot));
+    if (!snaps)
+    {
+        perror("calloc");
+        return;
+    }
+    StatsSnapshot *total = &snaps[workers];
+    hist_init(&total->latency);
+    for (int i = 0; i < workers; i++)
+    {
+        snapshot(&snaps[i], &stats[i]);
+        snapshot_merge(total, &snaps[i]);
+    }
+
+    if (!prometheus)
+    {
+        fprintf(out, "%-8s %10s %8s %12s %14s %14s %14s %9s %9s\n", "worker", "accepted", "active",
+                "messages", "bytes_in", "bytes_out", "transform_ms", "p50_us", "p99_us");
+        for (int i = 0; i < workers; i++)
+        {
+            char name[16];
+            snprintf(name, sizeof(name), "%d", i);
+            report_row(out, name, &snaps[i]);
+        }
+        if (workers > 1)
+        {
+            report_row(out, "total", total);
+        }
+        free(snaps);
+        return;
+    }
+
+    double values[workers];
+#define METRIC(name, type, help, expr)              \
+    for (int i = 0; i < workers; i++)               \
+    {                                               \
+        const StatsSnapshot *s = &snaps[i];         \
+        values[i] = (expr);                         \
+    }                                               \
+    report_metric(out, name, type, help, values, workers)
+
+    METRIC("connections_accepted_total", "counter", "Connections accepted.", s->accepted);
+    METRIC("connections_active", "gauge", "Connections currently open.", s->accepted - s->closed);
+    METRIC("bytes_received_total", "counter", "Request bytes received.", s->bytes_in);
+    METRIC("bytes_sent_total", "counter", "Reply bytes produced.", s->bytes_out);
+    METRIC("messages_total", "counter", "Requests handled (frames with -F, reads otherwise).", s->messages);
+    METRIC("transform_seconds_total", "counter", "Time spent parsing and transforming requests.",
+           s->transform_ns / 1e9);
+#undef METRIC
+
+    // Bucket bounds fall inside histogram buckets, so each count is exact to ~1.6% of the bound
+    fprintf(out, "# HELP shellnet_request_latency_seconds Time from a read to its replies being written.\n"
+                 "# TYPE shellnet_request_latency_seconds histogram\n");
+    for (int w = 0; w < workers; w++)
+    {
+        const Histogram *h = &snaps[w].latency;
+        uint64_t seen = 0;
+        int i = 0;
+        for (size_t b = 0; b < PROM_BOUNDS; b++)
+        {
+            for (; i < HIST_BUCKETS && hist_bucket_upper(i) <= prom_bounds[b]; i++)
+            {
+                seen += h->counts[i];
+            }
+            fprintf(out, "shellnet_request_latency_seconds_bucket{worker=\"%d\",le=\"%g\"} %llu\n",
+                    w, prom_bounds[b] / 1e9, (unsigned long long)seen);
+        }
+        fprintf(out, "shellnet_request_latency_seconds_bucket{worker=\"%d\",le=\"+Inf\"} %llu\n",
+                w, (unsigned long long)h->total);
+        fprintf(out, "shellnet_request_latency_seconds_sum{worker=\"%d\"} %.9g\n", w, h->sum / 1e9);
+        fprintf(out, "shellnet_request_latency_seconds_count{worker=\"%d\"} %llu\n",
+                w, (unsigned long long)h->total);
+    }
+    free(snaps);
+}
+
+// Writes the whole buffer to a blocking socket; a peer that left is an error, not a SIGPIPE
+static int send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t w = send(fd, buf, len, MSG_NOSIGNAL);
+        if (w == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+// Answers one control connection
+// The shell waits for it, so both directions get a short timeout: a peer that connects and
+// never asks cannot hold the prompt for long
+static void serve_request(int fd)
+{
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[STATS_REQUEST_MAX];
+    size_t used = 0;
+    while (used < sizeof(request) - 1 && memchr(request, '\n', used) == NULL)
+    {
+        ssize_t r = read(fd, request + used, sizeof(request) - 1 - used);
+        if (r == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (r <= 0)
+        {
+            break;
+        }
+        used += r;
+    }
+    request[used] = '\0';
+    request[strcspn(request, "\r\n")] = '\0';
+
+    char *reply = NULL;
+    size_t reply_len = 0;
+    FILE *out = open_memstream(&reply, &reply_len);
+    if (!out)
+    {
+        perror("open_memstream");
+        return;
+    }
+    if (strcmp(request, "stats") == 0 || strcmp(request, "stats text") == 0)
+    {
+        stats_report(out, source.stats, source.workers, 0);
+    }
+    else if (strcmp(request, "stats prometheus") == 0)
+    {
+        stats_report(out, source.stats, source.workers, 1);
+    }
+    else
+    {
+        fprintf(out, "error: unknown request \"%s\" (expected \"stats\" or \"stats prometheus\")\n", request);
+    }
+    fclose(out);
+
+    send_all(fd, reply, reply_len);  // A reader that went away is not the shell's problem
+    free(reply);
+}
+
+// Accepts the waiting control connections and answers each of them
+static void on_control(int fd, void *ctx)
+{
+    (void)ctx;
+    int conn;
+    while ((conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC)) != -1)
+    {
+        serve_request(conn);
+        close(conn);
+    }
+}
+
+// Opens the control socket
+int stats_listen(const char *path, const WorkerStats *stats, int workers)
+{
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Control socket path too long: %s\n", path);
+        return -1;
+    }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);  // A socket left behind by an earlier server
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 16) == -1)
+    {
+        perror("bind control socket");
+        close(fd);
+        return -1;
+    }
+
+    if (shell_watch_fd(fd, on_control, NULL) == -1)
+    {
+        fprintf(stderr, "Control socket: too many watched descriptors\n");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    source.stats = stats;
+    source.workers = workers;
+    source.fd = fd;
+    source.owner = getpid();
+    strcpy(source.path, path);
+    return fd;
+}
+
+// Closes the control socket and removes its file, in the process that opened it
+void stats_unlisten(void)
+{
+    if (source.fd == -1)
+    {
+        return;
+    }
+    close(source.fd);
+    if (source.owner == getpid())
+    {
+        shell_unwatch_fd(source.fd);
+        unlink(source.path);
+    }
+    source.fd = -1;
+}
+
+// Sends a request to the control socket and copies the answer to stdout
+int stats_query(const char *path, int prometheus)
+{
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        perror("socket");
+        return 1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror("connect");
+        close(fd);
+        return 1;
+    }
+
+    const char *request = prometheus ? "stats prometheus\n" : "stats\n";
+    if (send_all(fd, request, strlen(request)) == -1)
+    {
+        perror("write");
+        close(fd);
+        return 1;
+    }
+
+    char buf[4096];
+    ssize_t r;
+    while ((r = read(fd, buf, sizeof(buf))) != 0)
+    {
+        if (r == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("read");
+            close(fd);
+            return 1;
+        }
+        fwrite(buf, 1, r, stdout);
+    }
+    close(fd);
+    fflush(stdout);
+    return 0;
+}
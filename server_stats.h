@@ -0,0 +1,68 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <stdatomic.h>      // Counters read by another process while the workers update them
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint64_t
+#include <stdio.h>          // FILE
+#include <time.h>           // clock_gettime()
+
+#include "histogram.h"      // Bucket layout of the latency histogram
+
+// Metrics of the server engines, reported through a UNIX control socket ("-S path")
+//
+// Every event loop owns one WorkerStats block and is its only writer, so a counter is bumped with
+// a plain load and store (no locked instruction) and no two workers share a cache line. The
+// blocks live in a shared mapping made before the engine forks: the shell process answers the
+// control socket by reading them and never stops, signals or waits for a worker.
+
+// Counters of one event loop
+typedef struct {
+    _Alignas(64) _Atomic uint64_t accepted;     // Connections accepted
+    _Atomic uint64_t closed;                    // Connections closed again (active = accepted - closed)
+    _Atomic uint64_t bytes_in;                  // Request bytes received
+    _Atomic uint64_t bytes_out;                 // Reply bytes produced
+    _Atomic uint64_t messages;                  // Requests: frames with -F, reads (or datagrams) otherwise
+    _Atomic uint64_t transform_ns;              // Time spent parsing and transforming, writes excluded
+    _Atomic uint64_t latency_sum_ns;            // Sum of the recorded latencies
+    _Atomic uint64_t latency[HIST_BUCKETS];     // Time from a read to its replies being written, in ns
+} WorkerStats;
+
+// Adds to a counter of the calling worker (single writer: no read-modify-write instruction needed)
+static inline void stats_add(_Atomic uint64_t *counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Nanoseconds on the monotonic clock
+static inline uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Books one handled read of 'len' bytes holding 'messages' requests: 'busy_ns' of it went to
+// parsing and transforming, 'latency_ns' passed until its replies were written
+void stats_read_done(WorkerStats *s, size_t len, uint64_t messages, uint64_t busy_ns, uint64_t latency_ns);
+
+// Maps zeroed counters for 'workers' event loops, shared with the processes forked later
+// Returns NULL on an error
+WorkerStats *stats_create(int workers);
+
+// Writes the counters of every worker and their totals, as text or in the Prometheus exposition format
+void stats_report(FILE *out, const WorkerStats *stats, int workers, int prometheus);
+
+// Opens the control socket at 'path' and answers it from the shell's input loop, one request
+// line per connection: "stats" (text) or "stats prometheus"
+// Returns the listening socket, or -1 on an error
+int stats_listen(const char *path, const WorkerStats *stats, int workers);
+
+// Closes the control socket; the process that opened it also removes the socket file
+void stats_unlisten(void);
+
+// Sends a request to the control socket at 'path' and copies the answer to stdout ("stats" builtin)
+// Returns 0 on success, 1 on an error
+int stats_query(const char *path, int prometheus);
+
+#endif // SERVER_STATS_H
@@ -0,0 +1,957 @@
+#include "server_utils.h"
+#include "shell.h"
+#include "transform.h"
+#include "protocol.h"
+#include "rexec.h"
+
+#include <errno.h>          // errno, EINTR, ETIME, ENOBUFS
+#include <poll.h>           // POLLIN / POLLOUT masks for IORING_OP_POLL_ADD
+#include <signal.h>         // SIGTERM for the parent-death signal, SIGPIPE
+#include <stdint.h>         // uintptr_t, uint64_t
+#include <sys/mman.h>       // mmap() of the rings and of the buffer pool
+#include <sys/prctl.h>      // prctl(PR_SET_PDEATHSIG)
+#include <sys/syscall.h>    // io_uring_setup / io_uring_enter / io_uring_register (no liburing)
+#include <sys/wait.h>       // waitpid()
+#include <linux/io_uring.h> // Ring layout, opcodes and flags
+
+// Submission queue entries (the kernel sizes the completion queue at twice this)
+#define URING_ENTRIES 1024
+
+// Provided buffer pool: multishot reads pick a buffer from it, the reply is sent from the same
+// buffer and the buffer goes back to the pool once that send completed
+#define URING_BUF_COUNT 1024        // Number of buffers, a power of two (size of the buffer ring)
+#define URING_BUF_SIZE  16384       // Bytes per buffer
+#define URING_BUF_GROUP 0           // Buffer group id of the pool
+
+// Backpressure: reading a client pauses while this many of its bytes or buffers wait to be sent
+#define URING_CONN_BACKLOG (256 * 1024)
+#define URING_CONN_BUFS    16
+
+// Operation kind in the low bits of user_data, the rest is the UringClient it belongs to
+#define OP_ACCEPT   0               // Multishot accept on the listening socket (no client)
+#define OP_RECV     1               // Multishot recv with buffer selection
+#define OP_SEND     2               // Send of the first queued reply
+#define OP_STDOUT   3               // Multishot poll on the stdout pipe of a running command
+#define OP_STDERR   4               // Multishot poll on its stderr pipe
+#define OP_WRITABLE 5               // One-shot POLLOUT while a command's frame is half written
+#define OP_CANCEL   6               // Cancellation of one of the above
+#define OP_MASK     7
+
+// A reply waiting to be sent, either a slice of a provided buffer or a private copy
+typedef struct TxChunk {
+    struct TxChunk *next;   // Next reply of the same client
+    char *data;             // First byte of the reply
+    size_t len;             // Size of the reply
+    size_t off;             // Bytes already sent
+    int bid;                // Provided buffer 'data' points into, -1 when it points to 'copy'
+    char copy[];            // Private bytes (only allocated when bid is -1)
+} TxChunk;
+
+struct UringServer;
+
+// Per-connection state of the io_uring engine
+// The memory stays until no operation naming it is in flight any more ('refs')
+typedef struct UringClient {
+    struct UringServer *srv;    // Engine owning the connection
+    int fd;                     // Connected client socket (non-blocking, for rexec_pump())
+    int framed;                 // Connection speaks the length-prefixed protocol
+    FrameDecoder dec;           // Reassembly state of the framed protocol
+    FrameExecRequest req;       // Command line of a "rexec" request
+    RemoteExec exec;            // Command streaming its output, valid while 'exec_running'
+    int exec_running;           // Input is held back while a command runs
+    char *pending;              // Input that arrived behind the running command
+    size_t pending_len;         // Number of bytes in 'pending'
+    size_t pending_cap;         // Allocated size of 'pending'
+    TxChunk *tx_head;           // Replies in send order, the first one may be in flight
+    TxChunk *tx_tail;           // Last queued reply
+    size_t tx_bytes;            // Unsent bytes in the queue
+    int tx_bufs;                // Provided buffers the queue holds on to
+    int sending;                // A send of 'tx_head' is in flight
+    int recv_armed;             // The multishot recv is in flight (or being cancelled)
+    int throttled;              // Backlog too large, the recv stays disarmed until it shrinks
+    int starved;                // The recv ended on an empty buffer pool, waiting for buffers
+    int writable_armed;         // The POLLOUT poll is in flight
+    int refs;                   // Operations in flight naming this client, plus the starved list
+    int closed;                 // Connection is gone, freed once 'refs' drops to zero
+    struct UringClient *next_starved;   // Link in the list of starved clients
+} UringClient;
+
+// The ring, the buffer pool and the engine state
+typedef struct UringServer {
+    ServerWorker *worker;       // Listener and settings of this loop
+    int ring_fd;                // io_uring instance
+    unsigned *sq_khead;         // Shared submission queue head (advanced by the kernel)
+    unsigned *sq_ktail;         // Shared submission queue tail (advanced by us)
+    unsigned sq_mask;           // Index mask of the submission queue
+    unsigned sq_entries;        // Size of the submission queue
+    unsigned sq_tail;           // Local tail, published before every io_uring_enter()
+    struct io_uring_sqe *sqes;  // Submission queue entries
+    unsigned *cq_khead;         // Shared completion queue head (advanced by us)
+    unsigned *cq_ktail;         // Shared completion queue tail (advanced by the kernel)
+    unsigned cq_mask;           // Index mask of the completion queue
+    struct io_uring_cqe *cqes;  // Completion queue entries
+    struct io_uring_buf_ring *br;   // Ring the kernel takes provided buffers from
+    unsigned short br_tail;     // Local tail of the buffer ring
+    char *bufs;                 // URING_BUF_COUNT buffers of URING_BUF_SIZE bytes
+    int buf_refs[URING_BUF_COUNT];  // Replies (and the reader) still using each buffer
+    int bufs_free;              // Buffers currently in the buffer ring
+    int cur_bid;                // Buffer being served, its slices are sent without a copy
+    UringClient *starved;       // Clients whose recv waits for buffers
+    int active_clients;         // Clients served by this loop
+} UringServer;
+
+// Thin wrappers, the engine talks to the kernel directly
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Address of a provided buffer
+static char *buf_addr(UringServer *u, int bid)
+{
+    return u->bufs + (size_t)bid * URING_BUF_SIZE;
+}
+
+// Hand a buffer back to the kernel once nothing uses it any more
+static void buf_unref(UringServer *u, int bid)
+{
+    if (--u->buf_refs[bid] > 0)
+    {
+        return;
+    }
+    struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUF_COUNT - 1)];
+    b->addr = (uintptr_t)buf_addr(u, bid);
+    b->len = URING_BUF_SIZE;
+    b->bid = bid;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+    u->bufs_free++;
+}
+
+// Submit everything queued so far, optionally waiting for one completion
+// With a timeout (milliseconds, -1 for none) the wait may end with ETIME
+static int uring_submit(UringServer *u, int wait, int timeout)
+{
+    __atomic_store_n(u->sq_ktail, u->sq_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = u->sq_tail - __atomic_load_n(u->sq_khead, __ATOMIC_ACQUIRE);
+
+    if (!wait)
+    {
+        return sys_io_uring_enter(u->ring_fd, to_submit, 0, 0, NULL, 0);
+    }
+    if (timeout < 0)
+    {
+        return sys_io_uring_enter(u->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    }
+
+    struct __kernel_timespec ts = { timeout / 1000, (timeout % 1000) * 1000000L };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uintptr_t)&ts;
+    return sys_io_uring_enter(u->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+// Next free submission entry, zeroed; a full queue is submitted first
+static struct io_uring_sqe *get_sqe(UringServer *u)
+{
+    while (u->sq_tail - __atomic_load_n(u->sq_khead, __ATOMIC_ACQUIRE) >= u->sq_entries)
+    {
+        if (uring_submit(u, 0, -1) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct io_uring_sqe *sqe = &u->sqes[u->sq_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_tail++;
+    return sqe;
+}
+
+// user_data of an operation of client 'c'
+static uint64_t op_data(UringClient *c, int op)
+{
+    return (uint64_t)(uintptr_t)c | op;
+}
+
+// Keep one multishot accept in flight on the listening socket
+static void arm_accept(UringServer *u)
+{
+    struct io_uring_sqe *sqe = get_sqe(u);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = u->worker->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    // Non-blocking for the splice() of "rexec", close-on-exec so its commands do not inherit it
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = OP_ACCEPT;
+}
+
+// Keep one multishot recv in flight, every completion brings a buffer from the pool
+static void arm_recv(UringServer *u, UringClient *c)
+{
+    struct io_uring_sqe *sqe = get_sqe(u);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = op_data(c, OP_RECV);
+    c->recv_armed = 1;
+    c->refs++;
+}
+
+// Poll a descriptor of client 'c': multishot for a command's pipes, one-shot for the socket
+static void arm_poll(UringServer *u, UringClient *c, int fd, int op, unsigned events, int multishot)
+{
+    struct io_uring_sqe *sqe = get_sqe(u);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = op_data(c, op);
+    c->refs++;
+}
+
+// Cancel every in-flight operation of kind 'op' of client 'c'
+static void cancel_op(UringServer *u, UringClient *c, int op)
+{
+    struct io_uring_sqe *sqe = get_sqe(u);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = op_data(c, op);
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = op_data(c, OP_CANCEL);
+    c->refs++;
+}
+
+// Send the first queued reply unless a send is already in flight (one at a time keeps the order)
+static void start_send(UringServer *u, UringClient *c)
+{
+    TxChunk *t = c->tx_head;
+    if (c->sending || !t)
+    {
+        return;
+    }
+    struct io_uring_sqe *sqe = get_sqe(u);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = c->fd;
+    sqe->addr = (uintptr_t)(t->data + t->off);
+    sqe->len = t->len - t->off;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = op_data(c, OP_SEND);
+    c->sending = 1;
+    c->refs++;
+}
+
+// Append a reply to the client's queue and get it going
+static void push_chunk(UringServer *u, UringClient *c, TxChunk *t)
+{
+    t->next = NULL;
+    t->off = 0;
+    if (c->tx_tail)
+    {
+        c->tx_tail->next = t;
+    }
+    else
+    {
+        c->tx_head = t;
+    }
+    c->tx_tail = t;
+    c->tx_bytes += t->len;
+    stats_add(&u->worker->stats->bytes_out, t->len);
+    start_send(u, c);
+}
+
+// Queue a slice of a provided buffer: the kernel sends it straight from the pool
+static int queue_slice(UringServer *u, UringClient *c, int bid, char *data, size_t len)
+{
+    TxChunk *t = malloc(sizeof(TxChunk));
+    if (!t)
+    {
+        perror("malloc");
+        return -1;
+    }
+    t->data = data;
+    t->len = len;
+    t->bid = bid;
+    u->buf_refs[bid]++;
+    c->tx_bufs++;
+    push_chunk(u, c, t);
+    return 0;
+}
+
+// Queue a private copy of bytes that do not live in a provided buffer
+static int queue_copy(UringServer *u, UringClient *c, const struct iovec *iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        len += iov[i].iov_len;
+    }
+    TxChunk *t = malloc(sizeof(TxChunk) + len);
+    if (!t)
+    {
+        perror("malloc");
+        return -1;
+    }
+    t->data = t->copy;
+    t->len = 0;
+    t->bid = -1;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        memcpy(t->copy + t->len, iov[i].iov_base, iov[i].iov_len);
+        t->len += iov[i].iov_len;
+    }
+    push_chunk(u, c, t);
+    return 0;
+}
+
+// Drop a sent (or abandoned) reply
+static void free_chunk(UringServer *u, UringClient *c, TxChunk *t)
+{
+    if (t->bid != -1)
+    {
+        c->tx_bufs--;
+        buf_unref(u, t->bid);
+    }
+    free(t);
+}
+
+// Emit callback of frame_serve(): replies that lie in the buffer being served are sent from it,
+// anything else (a header that was split across two reads) is copied
+static int emit_to_client(void *ctx, struct iovec *iov, int iovcnt)
+{
+    UringClient *c = ctx;
+    UringServer *u = c->srv;
+
+    if (u->cur_bid != -1)
+    {
+        char *lo = buf_addr(u, u->cur_bid);
+        int inside = 1;
+        for (int i = 0; i < iovcnt && inside; i++)
+        {
+            char *p = iov[i].iov_base;
+            inside = p >= lo && p + iov[i].iov_len <= lo + URING_BUF_SIZE;
+        }
+        if (inside)
+        {
+            // In-place echo: consecutive pieces are contiguous, so this is usually one slice
+            for (int i = 0; i < iovcnt; )
+            {
+                char *p = iov[i].iov_base;
+                size_t len = iov[i++].iov_len;
+                while (i < iovcnt && (char *)iov[i].iov_base == p + len)
+                {
+                    len += iov[i++].iov_len;
+                }
+                if (queue_slice(u, c, u->cur_bid, p, len) == -1)
+                {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+    }
+    return queue_copy(u, c, iov, iovcnt);
+}
+
+// Keep input that arrived behind a command until the command finished
+// 'replace' starts the stash over (the rest of a buffer), otherwise the bytes are appended
+static int stash_input(UringClient *c, const char *data, size_t len, int replace)
+{
+    size_t keep = replace ? 0 : c->pending_len;
+    if (keep + len > c->pending_cap)
+    {
+        char *grown = realloc(c->pending, keep + len);
+        if (!grown)
+        {
+            perror("realloc");
+            return -1;
+        }
+        c->pending = grown;
+        c->pending_cap = keep + len;
+    }
+    memmove(c->pending + keep, data, len);  // 'data' may point into 'pending' itself
+    c->pending_len = keep + len;
+    return 0;
+}
+
+// Pause or resume the client's reads depending on how much of its data waits to be sent
+static void update_reads(UringServer *u, UringClient *c)
+{
+    if (c->closed)
+    {
+        return;
+    }
+
+    size_t backlog = c->tx_bytes + c->pending_len;
+    if (backlog > URING_CONN_BACKLOG || c->tx_bufs > URING_CONN_BUFS)
+    {
+        // A client that does not read its replies is not read from either
+        if (c->recv_armed && !c->throttled)
+        {
+            cancel_op(u, c, OP_RECV);
+        }
+        c->throttled = 1;
+        return;
+    }
+    if (c->throttled && (backlog > URING_CONN_BACKLOG / 2 || c->tx_bufs > URING_CONN_BUFS / 2))
+    {
+        return;  // Resume only once the backlog clearly shrank
+    }
+    c->throttled = 0;
+    if (!c->recv_armed && !c->starved)
+    {
+        arm_recv(u, c);
+    }
+}
+
+// Stop polling the command's pipes and release it (killed if still running)
+static void finish_exec(UringServer *u, UringClient *c)
+{
+    cancel_op(u, c, OP_STDOUT);
+    cancel_op(u, c, OP_STDERR);
+    rexec_release(&c->exec);
+    c->exec_running = 0;
+}
+
+// Take a client out of service; its memory goes once its last operation completed
+static void close_client(UringServer *u, UringClient *c)
+{
+    if (c->closed)
+    {
+        return;
+    }
+    c->closed = 1;
+    stats_add(&u->worker->stats->closed, 1);
+    u->active_clients--;
+    atomic_fetch_sub(u->worker->connected, 1);
+    if (c->exec_running)
+    {
+        finish_exec(u, c);
+    }
+    if (c->recv_armed)
+    {
+        cancel_op(u, c, OP_RECV);
+    }
+    // Fails an in-flight send and wakes a pending POLLOUT, so every operation completes soon
+    shutdown(c->fd, SHUT_RDWR);
+}
+
+// Free a closed client once nothing refers to it
+static void free_client(UringServer *u, UringClient *c)
+{
+    while (c->tx_head)
+    {
+        TxChunk *t = c->tx_head;
+        c->tx_head = t->next;
+        free_chunk(u, c, t);
+    }
+    close(c->fd);
+    free(c->req.cmd);
+    free(c->pending);
+    free(c);
+}
+
+// Start the command of a "rexec" request, its pipes are polled through the ring
+// Returns 0 when it runs, -1 when it could not be started
+static int start_exec(UringServer *u, UringClient *c)
+{
+    if (rexec_start(&c->exec, c->req.id, c->req.cmd) == -1)
+    {
+        return -1;
+    }
+    arm_poll(u, c, c->exec.fds[0], OP_STDOUT, POLLIN, 1);
+    arm_poll(u, c, c->exec.fds[1], OP_STDERR, POLLIN, 1);
+    c->exec_running = 1;
+    return 0;
+}
+
+// Answer one buffer of requests
+// Returns 0 when the client stays connected, -1 when it must be closed
+static int handle_input(UringServer *u, UringClient *c, char *buf, size_t len)
+{
+    if (!c->framed)
+    {
+        // Convert the message to uppercase in place and send it from where it landed
+        transform_upper(buf, len);
+        return queue_slice(u, c, u->cur_bid, buf, len);
+    }
+
+    while (len > 0)
+    {
+        ssize_t used = frame_serve(&c->dec, &c->req, buf, len, emit_to_client, c);
+        if (used == -1)
+        {
+            return -1;  // Not our protocol, drop the client
+        }
+        buf += used;
+        len -= used;
+
+        if (c->req.ready)
+        {
+            c->req.ready = 0;
+            if (start_exec(u, c) == 0)
+            {
+                return stash_input(c, buf, len, 1);
+            }
+
+            // Report it like a command that cannot be executed
+            unsigned char frame[FRAME_HEADER_LEN + 4];
+            uint32_t status = htonl(126);
+            struct iovec iov = { frame, sizeof(frame) };
+            frame_encode_header(frame, FRAME_EXIT, c->req.id, sizeof(status));
+            memcpy(frame + FRAME_HEADER_LEN, &status, sizeof(status));
+            if (queue_copy(u, c, &iov, 1) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Answer one buffer of requests and book it in the loop's counters
+// Replies are only queued here, their sends complete later, so all of the time counts as work
+// Returns 0 when the client stays connected, -1 when it must be closed
+static int handle_counted(UringServer *u, UringClient *c, char *buf, size_t len)
+{
+    uint64_t start = stats_now();
+    uint64_t frames = c->dec.frames;
+    int rc = handle_input(u, c, buf, len);
+    uint64_t elapsed = stats_now() - start;
+    stats_read_done(u->worker->stats, 0, c->framed ? c->dec.frames - frames : 1, elapsed, elapsed);
+    return rc;
+}
+
+// Answer the input held back behind a command that just finished
+static void serve_pending(UringServer *u, UringClient *c)
+{
+    if (c->pending_len > 0)
+    {
+        size_t len = c->pending_len;
+        c->pending_len = 0;
+        u->cur_bid = -1;  // Private memory, replies from it are copied
+        if (handle_counted(u, c, c->pending, len) == -1)
+        {
+            close_client(u, c);
+            return;
+        }
+    }
+    update_reads(u, c);
+}
+
+// Move the running command's output once the queued replies are out
+static void pump_exec(UringServer *u, UringClient *c)
+{
+    if (!c->exec_running || c->closed || c->tx_head || c->writable_armed)
+    {
+        return;  // A send completion or the POLLOUT poll calls again
+    }
+
+    int rc = rexec_pump(&c->exec, c->fd);
+    if (rc == -1)
+    {
+        close_client(u, c);
+    }
+    else if (rc == 1)
+    {
+        finish_exec(u, c);
+        serve_pending(u, c);
+    }
+    else if (c->exec.pending_off < c->exec.pending_len || c->exec.splice_left > 0)
+    {
+        // The socket is full in the middle of a frame
+        arm_poll(u, c, c->fd, OP_WRITABLE, POLLOUT, 0);
+        c->writable_armed = 1;
+    }
+}
+
+// A connection arrived (or the multishot accept ended)
+static void on_accept(UringServer *u, int res, int more)
+{
+    if (!more)
+    {
+        arm_accept(u);
+    }
+    if (res < 0)
+    {
+        if (res != -ECANCELED)
+        {
+            fprintf(stderr, "accept: %s\n", strerror(-res));
+        }
+        return;
+    }
+
+    UringClient *c = calloc(1, sizeof(UringClient));
+    if (!c)
+    {
+        perror("calloc");
+        close(res);
+        return;
+    }
+    c->srv = u;
+    c->fd = res;
+    c->framed = u->worker->server->framed;
+    u->active_clients++;
+    atomic_fetch_add(u->worker->connected, 1);
+    stats_add(&u->worker->stats->accepted, 1);
+
+    // Framed clients get the banner as frame 0
+    const char *banner = SERVER_BANNER;
+    unsigned char hdr[FRAME_HEADER_LEN];
+    struct iovec greeting[2] = { { hdr, sizeof(hdr) }, { (void *)banner, strlen(banner) } };
+    frame_encode_header(hdr, FRAME_DATA, 0, strlen(banner));
+    if (queue_copy(u, c, c->framed ? greeting : greeting + 1, c->framed ? 2 : 1) == -1)
+    {
+        close_client(u, c);
+        return;
+    }
+    arm_recv(u, c);
+}
+
+// Data (or the end of the multishot recv) of a client
+static void on_recv(UringServer *u, UringClient *c, int res, unsigned flags, int more)
+{
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        u->bufs_free--;
+        u->buf_refs[bid] = 1;  // Held while it is being served
+
+        if (res > 0 && !c->closed)
+        {
+            char *data = buf_addr(u, bid);
+            int failed;
+            stats_add(&u->worker->stats->bytes_in, res);
+            if (c->exec_running)
+            {
+                failed = stash_input(c, data, res, 0);
+            }
+            else
+            {
+                u->cur_bid = bid;
+                failed = handle_counted(u, c, data, res);
+                u->cur_bid = -1;
+            }
+            if (failed)
+            {
+                close_client(u, c);
+            }
+        }
+        buf_unref(u, bid);
+    }
+
+    if (!more)
+    {
+        c->recv_armed = 0;
+        if (res == 0 || (res < 0 && res != -ENOBUFS && res != -ECANCELED))
+        {
+            close_client(u, c);  // Closed by the client, or a failed read
+        }
+        else if (res == -ENOBUFS && !c->closed)
+        {
+            // Every buffer is in use: retry once replies returned some to the pool
+            c->starved = 1;
+            c->refs++;
+            c->next_starved = u->starved;
+            u->starved = c;
+        }
+    }
+    update_reads(u, c);
+}
+
+// A send completed, the next reply (or the command's output) goes out
+static void on_send(UringServer *u, UringClient *c, int res)
+{
+    c->sending = 0;
+    if (c->closed)
+    {
+        return;
+    }
+    if (res < 0)
+    {
+        close_client(u, c);
+        return;
+    }
+
+    TxChunk *t = c->tx_head;
+    t->off += res;
+    c->tx_bytes -= res;
+    if (t->off == t->len)
+    {
+        c->tx_head = t->next;
+        if (!c->tx_head)
+        {
+            c->tx_tail = NULL;
+        }
+        free_chunk(u, c, t);
+    }
+    start_send(u, c);  // A short send continues where it stopped
+    pump_exec(u, c);
+    update_reads(u, c);
+}
+
+// Dispatch one completion
+static void handle_cqe(UringServer *u, struct io_uring_cqe *cqe)
+{
+    int op = cqe->user_data & OP_MASK;
+    UringClient *c = (UringClient *)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    if (op == OP_ACCEPT)
+    {
+        on_accept(u, cqe->res, more);
+        return;
+    }
+    if (!more)
+    {
+        c->refs--;  // Final completion of this operation
+    }
+
+    switch (op)
+    {
+        case OP_RECV:
+            on_recv(u, c, cqe->res, cqe->flags, more);
+            break;
+        case OP_SEND:
+            on_send(u, c, cqe->res);
+            break;
+        case OP_STDOUT:
+        case OP_STDERR:
+            // A multishot poll that stopped by itself (not cancelled) is renewed
+            if (c->exec_running && !c->closed && !more && cqe->res >= 0)
+            {
+                int i = op == OP_STDOUT ? 0 : 1;
+                if (!c->exec.eof[i])
+                {
+                    arm_poll(u, c, c->exec.fds[i], op, POLLIN, 1);
+                }
+            }
+            pump_exec(u, c);
+            break;
+        case OP_WRITABLE:
+            c->writable_armed = 0;
+            pump_exec(u, c);
+            break;
+        default:
+            break;  // OP_CANCEL
+    }
+
+    if (c->closed && c->refs == 0)
+    {
+        free_client(u, c);
+    }
+}
+
+// Give clients whose recv ran out of buffers another go
+static void retry_starved(UringServer *u)
+{
+    while (u->starved && u->bufs_free > 0)
+    {
+        UringClient *c = u->starved;
+        u->starved = c->next_starved;
+        c->starved = 0;
+        c->refs--;
+        if (c->closed && c->refs == 0)
+        {
+            free_client(u, c);
+            continue;
+        }
+        update_reads(u, c);
+    }
+}
+
+// Create the ring, map its queues and register the provided buffer pool
+static void uring_init(UringServer *u)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // Completions are only reaped by this thread inside io_uring_enter(), no IPIs needed
+    p.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    u->ring_fd = sys_io_uring_setup(URING_ENTRIES, &p);
+    if (u->ring_fd == -1 && errno == EINVAL)
+    {
+        memset(&p, 0, sizeof(p));  // Older kernel: no optional setup flags
+        u->ring_fd = sys_io_uring_setup(URING_ENTRIES, &p);
+    }
+    if (u->ring_fd == -1)
+    {
+        perror("io_uring_setup");
+        exit(EXIT_FAILURE);
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG))
+    {
+        fprintf(stderr, "io_uring: kernel too old for the uring engine\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Submission and completion rings share one mapping, the entries have their own
+    size_t ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > ring_size)
+    {
+        ring_size = cq_size;
+    }
+    char *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+    if (ring == MAP_FAILED || u->sqes == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    u->sq_khead = (unsigned *)(ring + p.sq_off.head);
+    u->sq_ktail = (unsigned *)(ring + p.sq_off.tail);
+    u->sq_mask = *(unsigned *)(ring + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->sq_tail = *u->sq_ktail;
+    u->cq_khead = (unsigned *)(ring + p.cq_off.head);
+    u->cq_ktail = (unsigned *)(ring + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    // Entry i always lives in slot i, so the indirection array is filled once
+    unsigned *array = (unsigned *)(ring + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++)
+    {
+        array[i] = i;
+    }
+
+    // The buffer ring must be page aligned, mmap() provides that
+    u->br = mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->bufs = mmap(NULL, (size_t)URING_BUF_COUNT * URING_BUF_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED || u->bufs == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)u->br;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        perror("io_uring_register");
+        exit(EXIT_FAILURE);
+    }
+    for (int bid = 0; bid < URING_BUF_COUNT; bid++)
+    {
+        u->buf_refs[bid] = 1;
+        buf_unref(u, bid);
+    }
+    u->cur_bid = -1;
+}
+
+// Event loop of the io_uring engine: serves every client of this worker's listener
+// All operations queued while handling a batch of completions go to the kernel in the single
+// io_uring_enter() that also waits for the next batch
+// Returns 0 once nobody was connected for the time limit, -1 on a fatal error
+static int uring_loop(ServerWorker *worker)
+{
+    UringServer *u = calloc(1, sizeof(UringServer));
+    if (!u)
+    {
+        perror("calloc");
+        return -1;
+    }
+    u->worker = worker;
+    int result = -1;
+
+    // A client that disconnects mid-reply must not take down every other connection
+    // (the splice() of "rexec" has no MSG_NOSIGNAL); failed writes surface as EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+
+    // Created by the thread that uses it, as IORING_SETUP_SINGLE_ISSUER demands
+    uring_init(u);
+    arm_accept(u);
+
+    while (1)
+    {
+        // The time limit only applies while nobody is connected, like the other engines
+        int timeout = u->active_clients > 0 ? -1 : worker->server->time_limit * 1000;
+        if (uring_submit(u, 1, timeout) == -1)
+        {
+            if (errno == ETIME)
+            {
+                // Idle here, but other workers may still serve clients
+                if (u->active_clients == 0 && atomic_load(worker->connected) == 0 &&
+                    *u->cq_khead == __atomic_load_n(u->cq_ktail, __ATOMIC_ACQUIRE))
+                {
+                    result = 0;
+                    break;
+                }
+            }
+            else if (errno != EINTR && errno != EBUSY)
+            {
+                perror("io_uring_enter");
+                break;
+            }
+        }
+
+        unsigned head = *u->cq_khead;
+        unsigned tail = __atomic_load_n(u->cq_ktail, __ATOMIC_ACQUIRE);
+        while (head != tail)
+        {
+            handle_cqe(u, &u->cqes[head & u->cq_mask]);
+            head++;
+            // Release each entry before handling the next, so a long batch cannot overflow
+            __atomic_store_n(u->cq_khead, head, __ATOMIC_RELEASE);
+            if (head == tail)
+            {
+                tail = __atomic_load_n(u->cq_ktail, __ATOMIC_ACQUIRE);
+            }
+        }
+        retry_starved(u);
+    }
+
+    // Closing the ring cancels whatever is still in flight
+    close(u->ring_fd);
+    return result;
+}
+
+// Function to run the io_uring engine
+// The event loop runs in a child process while the parent keeps the interactive shell,
+// the same split as the epoll engine
+// Arguments:
+//  - server: The server connection object with a bound, listening socket
+void handle_server_uring(ServerConnection *server)
+{
+    pid_t pid = fork();
+
+    if (pid == -1)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0)
+    {
+        // Child process: stop serving once the shell that owns us goes away
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+        run_server_workers(server, uring_loop);
+        cleanup(server);
+        exit(0);
+    }
+
+    // Parent process: run the shell for additional commands
+    run_shell(-1, 0);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    cleanup(server);
+}
@@ -1,5 +1,14 @@
 #include "server_utils.h"
 #include "shell.h"
+#include "transform.h"
+#include "protocol.h"
+#include "rexec.h"
+#include "out_ring.h"
+
+#include <errno.h>          // errno, EINTR, EAGAIN
+#include <poll.h>           // poll() while queued replies drain
+#include <signal.h>         // signal(SIGPIPE)
+#include <stddef.h>         // offsetof() for abstract socket addresses
 
 // Function to create a server connection based on arguments passed by the user
 // Arguments:
@@ -20,6 +29,8 @@ ServerConnection *create_server(char **args)
     memset(server, 0, sizeof(ServerConnection));  // Initialize the server structure to zero
 
     server->time_limit = 60;  // Set default time limit to 60 seconds for connection timeout
+    server->workers = 1;  // One event loop unless "-w" asks for more
+    server->sock_type = SOCK_STREAM;  // Connections unless "-k" asks for messages
 
     // Parse the arguments to set server settings
     while (args[i] != NULL) 
@@ -45,103 +56,274 @@ ServerConnection *create_server(char **args)
             server->ip[0] = '\0';  // No IP for UNIX socket
             strncpy(server->unix_path, args[++i], MAX_UNIX_PATH - 1);  // Set the UNIX socket path
         } 
+        else if (strcmp(args[i], "-m") == 0 && args[i + 1] != NULL)
+        {
+            server->use_tcp = 0;  // The handshake runs over an abstract UNIX socket
+            server->shm = 1;  // Data then moves through shared-memory rings
+            server->port = -1;
+            server->ip[0] = '\0';
+            strncpy(server->unix_path, args[++i], MAX_UNIX_PATH - 2);  // Name of the channel
+        }
         else if (strcmp(args[i], "-t") == 0 && args[i + 1] != NULL)
         {
             server->time_limit = atoi(args[++i]);  // Set the time limit for client connections
         }
+        else if (strcmp(args[i], "-S") == 0 && args[i + 1] != NULL)
+        {
+            strncpy(server->control_path, args[++i], MAX_UNIX_PATH - 1);  // Where "stats" is answered
+        }
+        else if (strcmp(args[i], "-F") == 0)
+        {
+            server->framed = 1;  // Speak the length-prefixed protocol from protocol.h
+        }
+        else if (strcmp(args[i], "-w") == 0 && args[i + 1] != NULL)
+        {
+            server->workers = atoi(args[++i]);  // Event loop threads, 0 means one per online CPU
+            if (server->workers == 0)
+            {
+                server->workers = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        }
+        else if (strcmp(args[i], "-pin") == 0)
+        {
+            server->pin_workers = 1;  // Keep every worker thread on its own CPU
+        }
+        else if (strcmp(args[i], "-k") == 0 && args[i + 1] != NULL)
+        {
+            i++;
+            if (strcmp(args[i], "dgram") == 0)
+            {
+                server->sock_type = SOCK_DGRAM;  // UDP with -p/-ip, a UNIX datagram socket with -u
+            }
+            else if (strcmp(args[i], "seqpacket") == 0)
+            {
+                server->sock_type = SOCK_SEQPACKET;  // UNIX connections that keep message boundaries
+            }
+            else if (strcmp(args[i], "stream") == 0)
+            {
+                server->sock_type = SOCK_STREAM;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown socket kind: %s\n", args[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(args[i], "-e") == 0 && args[i + 1] != NULL)
+        {
+            i++;
+            if (strcmp(args[i], "epoll") == 0)
+            {
+                server->engine = SERVER_ENGINE_EPOLL;  // Multiplex all clients in one event loop
+            }
+            else if (strcmp(args[i], "uring") == 0)
+            {
+                server->engine = SERVER_ENGINE_URING;  // Batched submissions, replies sent from the receive buffers
+            }
+            else if (strcmp(args[i], "select") == 0)
+            {
+                server->engine = SERVER_ENGINE_SELECT;  // Classic one-client-at-a-time engine
+            }
+            else
+            {
+                fprintf(stderr, "Unknown server engine: %s\n", args[i]);
+                exit(1);
+            }
+        }
         i++;
     }
 
+    if (server->workers < 1)
+    {
+        fprintf(stderr, "Invalid number of workers\n");
+        exit(1);
+    }
+    if (server->shm)
+    {
+        // The rings are served next to sockets by the epoll loop
+        if (server->engine == SERVER_ENGINE_URING)
+        {
+            fprintf(stderr, "The shared-memory transport (-m) runs on the epoll engine\n");
+            exit(1);
+        }
+        server->engine = SERVER_ENGINE_EPOLL;
+    }
+    if (server->sock_type != SOCK_STREAM)
+    {
+        // Every message is answered on its own, which is what the datagram engine batches
+        if (server->shm || (server->use_tcp && server->sock_type == SOCK_SEQPACKET))
+        {
+            fprintf(stderr, "Seqpacket sockets (-k seqpacket) need -u, datagrams -p/-ip or -u\n");
+            exit(1);
+        }
+        if (server->engine == SERVER_ENGINE_URING)
+        {
+            fprintf(stderr, "Datagram and seqpacket sockets (-k) run on their own engine\n");
+            exit(1);
+        }
+        server->engine = SERVER_ENGINE_DGRAM;
+    }
+    if (server->workers > 1 && server->engine == SERVER_ENGINE_SELECT)
+    {
+        fprintf(stderr, "Workers (-w) need the epoll or uring engine\n");
+        exit(1);
+    }
+
     return server;  // Return the configured server structure
 }
 
-// Function to bind the server socket based on the configuration in the server structure
+// Function to create a TCP socket bound to the server's address and listening on it (a bound UDP
+// socket with "-k dgram")
+// With several workers every one gets such a socket: SO_REUSEPORT lets them share the port and
+// the kernel spreads new connections over them
 // Arguments:
-//  - server: The server connection object containing the socket configuration
-void bind_server_socket(ServerConnection *server) 
+//  - server: The server connection object containing the address
+int open_ip_listener(ServerConnection *server)
 {
-    int s;
+    struct sockaddr_in addr;
+    int s = socket(AF_INET, server->sock_type | SOCK_CLOEXEC, 0);  // Create the socket (TCP or UDP)
+    if (s == -1) 
+    {
+        perror("socket");
+        exit(1);
+    }
 
-    if (server->use_tcp)  // If using TCP, create a TCP socket
+    int one = 1;
+    if (server->workers > 1 && setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1)
     {
-        struct sockaddr_in addr;
-        s = socket(AF_INET, SOCK_STREAM, 0);  // Create the socket (TCP)
-        if (s == -1) 
+        perror("setsockopt(SO_REUSEPORT)");
+        exit(1);
+    }
+
+    memset(&addr, 0, sizeof(addr));  // Zero out the sockaddr_in structure
+    addr.sin_family = AF_INET;
+    
+    // If IP address is provided, use it; otherwise, bind to INADDR_ANY
+    if (server->ip[0] != '\0') 
+    {
+        if (inet_pton(AF_INET, server->ip, &addr.sin_addr) <= 0) 
         {
-            perror("socket");
+            perror("Invalid IP address");
             exit(1);
         }
+    } 
+    else 
+    {
+        addr.sin_addr.s_addr = INADDR_ANY;  // Bind to any available interface
+    }
 
-        memset(&addr, 0, sizeof(addr));  // Zero out the sockaddr_in structure
-        addr.sin_family = AF_INET;
-        
-        // If IP address is provided, use it; otherwise, bind to INADDR_ANY
-        if (server->ip[0] != '\0') 
-        {
-            if (inet_pton(AF_INET, server->ip, &addr.sin_addr) <= 0) 
-            {
-                perror("Invalid IP address");
-                exit(1);
-            }
-        } 
-        else 
-        {
-            addr.sin_addr.s_addr = INADDR_ANY;  // Bind to any available interface
-        }
+    addr.sin_port = htons(server->port);  // Set the server's port
 
-        addr.sin_port = htons(server->port);  // Set the server's port
+    // Bind the socket to the specified address
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) == -1) 
+    {
+        perror("bind");
+        exit(1);
+    }
 
-        // Bind the socket to the specified address
-        if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) == -1) 
-        {
-            perror("bind");
-            exit(1);
-        }
+    // Start listening for incoming connections
+    if (server->sock_type != SOCK_DGRAM && listen(s, SOMAXCONN) == -1) 
+    {
+        perror("listen");
+        exit(1);
+    }
+    return s;
+}
 
-        // Start listening for incoming connections
-        if (listen(s, 5) == -1) 
-        {
-            perror("listen");
-            exit(1);
-        }
+// Function to bind the server socket based on the configuration in the server structure
+// Arguments:
+//  - server: The server connection object containing the socket configuration
+void bind_server_socket(ServerConnection *server) 
+{
+    int s;
 
-        printf("Server is listening on IP %s, port %d...\n", server->ip[0] ? server->ip : "ANY", server->port);
+    if (server->use_tcp)  // If using TCP, create a TCP socket
+    {
+        s = open_ip_listener(server);
+
+        printf("Server is listening on %sIP %s, port %d...\n", server->sock_type == SOCK_DGRAM ? "UDP " : "",
+               server->ip[0] ? server->ip : "ANY", server->port);
     } 
     else  // If using UNIX socket, create and bind a UNIX socket
     {
         struct sockaddr_un addr;
-        s = socket(AF_UNIX, SOCK_STREAM, 0);  // Create the socket (UNIX)
+        s = socket(AF_UNIX, server->sock_type | SOCK_CLOEXEC, 0);  // Create the socket (UNIX)
         if (s == -1) 
         {
             perror("socket");
             exit(1);
         }
 
-        unlink(server->unix_path);  // Remove any existing socket file
+        socklen_t addr_len = sizeof(addr);
         memset(&addr, 0, sizeof(addr));  // Zero out the sockaddr_un structure
         addr.sun_family = AF_UNIX;
-        strncpy(addr.sun_path, server->unix_path, sizeof(addr.sun_path) - 1);  // Set UNIX socket path
+        if (server->shm)
+        {
+            // Abstract name (leading NUL): no file to clean up, gone with the last listener
+            strncpy(addr.sun_path + 1, server->unix_path, sizeof(addr.sun_path) - 2);
+            addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(server->unix_path);
+        }
+        else
+        {
+            unlink(server->unix_path);  // Remove any existing socket file
+            strncpy(addr.sun_path, server->unix_path, sizeof(addr.sun_path) - 1);  // Set UNIX socket path
+        }
 
         // Bind the socket to the specified UNIX path
-        if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) == -1) 
+        if (bind(s, (struct sockaddr*)&addr, addr_len) == -1) 
         {
             perror("bind");
             exit(1);
         }
 
-        // Start listening for incoming connections
-        if (listen(s, 5) == -1) 
+        // Start listening for incoming connections (a datagram socket just receives)
+        if (server->sock_type != SOCK_DGRAM && listen(s, SOMAXCONN) == -1) 
         {
             perror("listen");
             exit(1);
         }
 
-        printf("Server is listening on UNIX socket %s...\n", server->unix_path);
+        if (server->shm)
+        {
+            printf("Server is listening for shared-memory clients on %s...\n", server->unix_path);
+        }
+        else
+        {
+            printf("Server is listening on UNIX %ssocket %s...\n",
+                   server->sock_type == SOCK_DGRAM ? "datagram " : server->sock_type == SOCK_SEQPACKET ? "seqpacket " : "",
+                   server->unix_path);
+        }
     }
 
     server->listening_socket = s;  // Store the socket descriptor for later use
 }
 
+// Function to set up the server's metrics before the engine starts
+// The counters are mapped shared here, so the engine's forked loop process updates the same
+// memory the shell process reads when the control socket is asked for them
+// Arguments:
+//  - server: The server connection object containing the socket configuration
+void start_server_stats(ServerConnection *server)
+{
+    server->stats = stats_create(server->workers);
+    if (!server->stats)
+    {
+        perror("mmap");
+        cleanup(server);
+        exit(1);
+    }
+
+    if (server->control_path[0] != '\0')
+    {
+        if (stats_listen(server->control_path, server->stats, server->workers) == -1)
+        {
+            cleanup(server);
+            exit(1);
+        }
+        printf("Server statistics are served on %s...\n", server->control_path);
+    }
+}
+
 // Function to handle the server's background operations, such as accepting connections
 // Arguments:
 //  - server: The server connection object containing the socket configuration
@@ -176,13 +358,14 @@ void handle_server_background(ServerConnection *server, int console)
         return;
     }
 
-    // If a connection attempt is detected, accept the connection
-    server->connecting_socket = accept(server->listening_socket, NULL, NULL);
+    // If a connection attempt is detected, accept the connection (commands run by "rexec" must not inherit it)
+    server->connecting_socket = accept4(server->listening_socket, NULL, NULL, SOCK_CLOEXEC);
     if (server->connecting_socket == -1) 
     {
         perror("accept");
         exit(EXIT_FAILURE);
     }
+    stats_add(&server->stats[0].accepted, 1);
 
     // Handle communication in the foreground if console flag is set
     if (console == 1)
@@ -217,48 +400,229 @@ void handle_server_background(ServerConnection *server, int console)
     }
 }
 
+// A client of the select engine: its socket and the replies it has not taken yet
+typedef struct {
+    int sock;           // Connected client socket (non-blocking)
+    OutRing out;        // Bounded output ring, reading pauses while it is nearly full
+    WorkerStats *stats; // Counters of the engine's only loop
+    uint64_t write_ns;  // Time spent writing replies for the current read
+} SelectClient;
+
+// Emit callback of frame_serve(): replies go to the socket, the rest into the ring
+static int write_reply(void *ctx, struct iovec *iov, int iovcnt)
+{
+    SelectClient *c = ctx;
+    uint64_t start = stats_now();
+    for (int i = 0; i < iovcnt; i++)
+    {
+        stats_add(&c->stats->bytes_out, iov[i].iov_len);
+    }
+    int rc = out_ring_writev(&c->out, c->sock, iov, iovcnt);
+    c->write_ns += stats_now() - start;
+    return rc;
+}
+
+// Waits until every queued reply left, so a command's output frames follow them in order
+static int drain_output(SelectClient *c)
+{
+    while (c->out.len > 0)
+    {
+        struct pollfd p = { c->sock, POLLOUT, 0 };
+        if (poll(&p, 1, -1) == -1 && errno != EINTR)
+        {
+            return -1;
+        }
+        if (out_ring_flush(&c->out, c->sock) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Answers one buffer of the framed protocol
+// DATA replies are queued as they are produced, EXEC commands run to completion in between,
+// so every reply keeps the order of its request
+// Returns 0 on success, -1 on a malformed stream or a failed write
+static int serve_framed(SelectClient *c, FrameDecoder *decoder, FrameExecRequest *req, char *buff, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t used = frame_serve(decoder, req, buff, len, write_reply, c);
+        if (used == -1)
+        {
+            return -1;
+        }
+        buff += used;
+        len -= used;
+
+        if (req->ready)
+        {
+            RemoteExec exec;
+            req->ready = 0;
+            printf("\nRunning for client: %s\n", req->cmd);
+            fflush(stdout);
+
+            if (rexec_start(&exec, req->id, req->cmd) == -1)
+            {
+                // Like a command that cannot be executed
+                unsigned char frame[FRAME_HEADER_LEN + 4];
+                uint32_t status = htonl(126);
+                struct iovec iov = { frame, sizeof(frame) };
+                frame_encode_header(frame, FRAME_EXIT, req->id, sizeof(status));
+                memcpy(frame + FRAME_HEADER_LEN, &status, sizeof(status));
+                if (out_ring_writev(&c->out, c->sock, &iov, 1) == -1)
+                {
+                    return -1;
+                }
+                continue;
+            }
+            int rc = drain_output(c) == -1 ? -1 : rexec_run(&exec, c->sock);
+            rexec_release(&exec);
+            if (rc == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
 // Function to handle communication with a connected client
+// The socket is non-blocking: replies the client does not take right away wait in a bounded
+// ring, and while that ring could not hold another reply the client is not read from
 // Arguments:
 //  - server: The server connection object containing the socket configuration
 void handle_server_communication(ServerConnection* server) 
 {
     int r;
     char buff[MAX_BUFF_LEN];  // Buffer for reading data from the client
+    FrameDecoder decoder = {0};  // Framing state of this connection (used with -F)
+    FrameExecRequest exec_req = {0};  // Command line of a "rexec" request (used with -F)
+    SelectClient client = { server->connecting_socket, { 0 }, &server->stats[0], 0 };
 
-    const char *banner = "Hello from server\nSend a string and I'll send you back the upper case...\n";
+    const char *banner = SERVER_BANNER;
+
+    // A client that vanishes mid-reply is a failed write of its connection, not a SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    int flags = fcntl(client.sock, F_GETFL, 0);
+    if (flags == -1 || fcntl(client.sock, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        perror("fcntl");
+        close(client.sock);
+        stats_add(&client.stats->closed, 1);
+        return;
+    }
 
-    // Send a welcome message to the client
-    if (write(server->connecting_socket, banner, strlen(banner)) == -1) 
+    // Send a welcome message to the client (as frame 0 when the framed protocol is used)
+    unsigned char hdr[FRAME_HEADER_LEN];
+    struct iovec greeting[2] = { { hdr, sizeof(hdr) }, { (void *)banner, strlen(banner) } };
+    frame_encode_header(hdr, FRAME_DATA, 0, strlen(banner));
+    if (write_reply(&client, server->framed ? greeting : greeting + 1, server->framed ? 2 : 1) == -1)
     {
         perror("\nError sending banner to client");
-        close(server->connecting_socket);  // Close socket on error
+        close(client.sock);  // Close socket on error
+        stats_add(&client.stats->closed, 1);
         return;
     }
 
     // Communication loop: read data from the client and send back in uppercase
-    while ((r = read(server->connecting_socket, buff, sizeof(buff) - 1)) > 0) 
+    while (1)
     {
-        buff[r] = '\0';  // Null-terminate the received data
-        printf("\nReceived message: %s", buff);  // Print the received message
-        printf("\nReceived (%d bytes): %s\n", r, buff);
+        fd_set read_fds, write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
 
-        // Convert the message to uppercase
-        for (int i = 0; i < r; i++) 
+        // Backpressure: read only while the ring could take the reply to a full read
+        if (out_ring_space(&client.out) >= sizeof(buff) + OUT_RING_SLACK)
+        {
+            FD_SET(client.sock, &read_fds);
+        }
+        if (client.out.len > 0)
         {
-            buff[i] = toupper(buff[i]);
+            FD_SET(client.sock, &write_fds);
         }
 
-        printf("Sending back: %s\n", buff);
+        if (select(client.sock + 1, &read_fds, &write_fds, NULL, NULL) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("select");
+            r = -2;
+            break;
+        }
 
-        // Send the converted uppercase message back to the client
-        if (write(server->connecting_socket, buff, r) == -1) 
+        // Queued replies go out in one writev per wakeup
+        if (FD_ISSET(client.sock, &write_fds) && out_ring_flush(&client.out, client.sock) == -1)
         {
             perror("\nError sending back data to client");
-            break;  // Stop if the write failed (client may have disconnected)
+            r = -2;
+            break;
+        }
+        if (!FD_ISSET(client.sock, &read_fds))
+        {
+            continue;
+        }
+
+        r = read(client.sock, buff, sizeof(buff) - 1);
+        if (r == -1 && (errno == EINTR || errno == EAGAIN))
+        {
+            continue;
+        }
+        if (r <= 0)
+        {
+            break;
+        }
+
+        if (server->framed)
+        {
+            // Payload bytes are upper-cased in place, headers stay, so the buffer is the reply
+            printf("\nReceived (%d bytes of framed data)\n", r);
+            uint64_t start = stats_now();
+            uint64_t frames = decoder.frames;
+            client.write_ns = 0;
+            if (serve_framed(&client, &decoder, &exec_req, buff, r) == -1)
+            {
+                fprintf(stderr, "\nMalformed frame or send error, closing connection\n");
+                r = -2;
+                break;
+            }
+            uint64_t elapsed = stats_now() - start;
+            stats_read_done(client.stats, r, decoder.frames - frames, elapsed - client.write_ns, elapsed);
+        }
+        else
+        {
+            buff[r] = '\0';  // Null-terminate the received data
+            printf("\nReceived message: %s", buff);  // Print the received message
+            printf("\nReceived (%d bytes): %s\n", r, buff);
+
+            // Convert the message to uppercase (vectorized kernel picked for this CPU)
+            uint64_t start = stats_now();
+            transform_upper(buff, r);
+            uint64_t busy = stats_now() - start;
+
+            printf("Sending back: %s\n", buff);
+
+            // Send the converted uppercase message back to the client
+            struct iovec iov = { buff, r };
+            client.write_ns = 0;
+            if (write_reply(&client, &iov, 1) == -1)
+            {
+                perror("\nError sending back data to client");
+                r = -2;
+                break;  // Stop if the write failed (client may have disconnected)
+            }
+            stats_read_done(client.stats, r, 1, busy, busy + client.write_ns);
         }
         display_shell_prompt();  // Display the shell prompt
         fflush(stdout);
     }
+    out_ring_free(&client.out);
+    free(exec_req.cmd);
+    stats_add(&client.stats->closed, 1);
 
     // Handle client disconnection or read error
     if (r == 0) 
@@ -266,13 +630,15 @@ void handle_server_communication(ServerConnection* server)
         printf("\nClient closed the connection.\n");
         fflush(stdout);
         display_shell_prompt();
+        close(client.sock);
         handle_server_background(server, 1);  // Continue accepting new connections
+        return;
     } 
-    else 
+    if (r == -1)
     {
         perror("read");
     }
-    close(server->connecting_socket);  // Close the client connection
+    close(client.sock);  // Close the client connection
 }
 
 // Function to clean up the server resources, including closing the listening socket
@@ -281,8 +647,9 @@ void handle_server_communication(ServerConnection* server)
 void cleanup(ServerConnection *server) 
 {
     close(server->listening_socket);  // Close the server's listening socket
-    if (!server->use_tcp) 
+    if (!server->use_tcp && !server->shm) 
     {
         unlink(server->unix_path);  // Remove the UNIX socket file if necessary
     }
+    stats_unlisten();  // Remove the control socket (only in the shell process that serves it)
 }
@@ -18,6 +18,9 @@
 #include <netinet/in.h>    // IP socket address structure and protocols
 #include <arpa/inet.h>     // Functions for IP address conversion
 #include <fcntl.h>         // File control options (e.g., non-blocking mode)
+#include <stdatomic.h>     // Client count shared by the worker threads
+
+#include "server_stats.h"  // Per-worker counters behind the control socket
 
 // Constant defining the maximum length of an IP address string (e.g., "255.255.255.255" + null)
 #define MAX_IP_LEN 16
@@ -26,7 +29,16 @@
 #define MAX_UNIX_PATH 108
 
 // Maximum length for input/output buffers (e.g., read/write operations)
-#define MAX_BUFF_LEN 64
+#define MAX_BUFF_LEN 4096
+
+// Greeting sent to every client right after it connects
+#define SERVER_BANNER "Hello from server\nSend a string and I'll send you back the upper case...\n"
+
+// Server engines selectable with "-e <name>"
+#define SERVER_ENGINE_SELECT 0      // One client at a time, select() + fork (default)
+#define SERVER_ENGINE_EPOLL  1      // Single edge-triggered epoll loop multiplexing all clients
+#define SERVER_ENGINE_URING  2      // io_uring loop: multishot accept/recv into a provided buffer ring
+#define SERVER_ENGINE_DGRAM  3      // recvmmsg/sendmmsg batches for datagram and seqpacket sockets ("-k")
 
 // Definition of the ServerConnection struct, which holds the configuration and state of the server
 typedef struct {
@@ -37,20 +49,61 @@ typedef struct {
     int listening_socket;           // Socket descriptor used by server to listen for new connections
     int connecting_socket;          // Socket descriptor representing an active connection with a client
     int time_limit;                 // Optional timeout value (in seconds) for inactivity or session management
+    int engine;                     // Which server engine runs the connections (SERVER_ENGINE_*)
+    int framed;                     // Use the length-prefixed protocol (1) or raw text (0)
+    int shm;                        // Shared-memory transport ("-m name"), unix_path holds the name
+    int sock_type;                  // SOCK_STREAM, or SOCK_DGRAM / SOCK_SEQPACKET with "-k"
+    int workers;                    // Event loop threads of the epoll/uring engine ("-w N")
+    int pin_workers;                // Pin worker i to the i-th usable CPU ("-pin")
+    WorkerStats *stats;             // Counters of every worker, mapped shared before the engine forks
+    char control_path[MAX_UNIX_PATH]; // Control socket answering "stats" requests ("-S path"), empty when off
 } ServerConnection;
 
+// One event loop of the epoll or uring engine
+// With "-w N" every worker thread runs its own loop on its own listener, the workers share
+// nothing but the settings and a client count that is touched on connect and disconnect only
+typedef struct {
+    ServerConnection *server;       // Settings of the server (read-only in the loops)
+    int listen_fd;                  // Listener of this loop
+    int shared_listener;            // 'listen_fd' is shared with the other workers (UNIX sockets)
+    int index;                      // Worker number, 0 for the single-threaded engine
+    atomic_int *connected;          // Clients connected to any worker, for the idle shutdown
+    WorkerStats *stats;             // Counters of this loop, written by it alone
+} ServerWorker;
+
+// Event loop of an engine, returns 0 after the idle time limit and -1 on a fatal error
+typedef int (*server_loop_fn)(ServerWorker *worker);
+
 // Function prototype: Creates and initializes a ServerConnection struct using provided arguments
 ServerConnection* create_server(char **args);
 
 // Function prototype: Binds the server socket based on TCP or UNIX socket settings
 void bind_server_socket(ServerConnection *server);
 
+// Function prototype: Maps the worker counters and opens the "-S" control socket in the shell process
+void start_server_stats(ServerConnection *server);
+
 // Function prototype: Manages background server behavior (e.g., accepting connections)
 void handle_server_background(ServerConnection *server, int console);
 
 // Function prototype: Handles client-server communication (data transmission and reception)
 void handle_server_communication(ServerConnection *server);
 
+// Function prototype: Runs the epoll engine, serving every client from one event loop (server_epoll.c)
+void handle_server_epoll(ServerConnection *server);
+
+// Function prototype: Runs the io_uring engine, completions of every client in one ring (server_uring.c)
+void handle_server_uring(ServerConnection *server);
+
+// Function prototype: Runs the datagram engine, messages handled in recvmmsg/sendmmsg batches (server_dgram.c)
+void handle_server_dgram(ServerConnection *server);
+
+// Function prototype: Opens a listener (a UDP socket with "-k dgram") on the server's IP address (SO_REUSEPORT with workers)
+int open_ip_listener(ServerConnection *server);
+
+// Function prototype: Runs an engine's loop once, or on "-w N" threads and waits for them (server_workers.c)
+void run_server_workers(ServerConnection *server, server_loop_fn loop);
+
 // Function prototype: Performs resource cleanup (e.g., closing sockets, removing UNIX socket file)
 void cleanup(ServerConnection *server);
 
@@ -0,0 +1,126 @@
+#include "server_utils.h"
+#include "transform.h"
+
+#include <pthread.h>        // pthread_create(), pthread_join(), pthread_setaffinity_np()
+#include <sched.h>          // cpu_set_t, sched_getaffinity()
+
+// A worker thread and the loop it runs
+typedef struct {
+    ServerWorker worker;    // What the loop gets to see
+    server_loop_fn loop;    // Engine loop to run
+    int cpu;                // CPU the thread is pinned to, -1 to leave it to the scheduler
+    int result;             // Return value of the loop
+    pthread_t thread;       // The thread itself
+} WorkerThread;
+
+// Picks the n-th CPU this process may run on (wrapping around), -1 when that cannot be told
+static int nth_usable_cpu(int n)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == -1 || CPU_COUNT(&set) == 0)
+    {
+        return -1;
+    }
+    n %= CPU_COUNT(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &set) && n-- == 0)
+        {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+// Body of a worker thread: pin it when asked, then run its loop until the server goes idle
+static void *worker_main(void *arg)
+{
+    WorkerThread *t = arg;
+
+    if (t->cpu != -1)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(t->cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+        {
+            fprintf(stderr, "worker %d: cannot pin to CPU %d: %s\n", t->worker.index, t->cpu, strerror(err));
+        }
+    }
+
+    t->result = t->loop(&t->worker);
+
+    // A finished worker's own listener must not be handed connections any more
+    if (t->worker.listen_fd != t->worker.server->listening_socket)
+    {
+        close(t->worker.listen_fd);
+    }
+    return NULL;
+}
+
+// Function to run an engine's event loop, on "-w N" threads when asked
+// Over TCP every worker owns an SO_REUSEPORT listener, so the kernel balances new connections
+// across them; a UNIX socket cannot be shared that way, there the workers wait on the one
+// listener and the engines let only one of them wake up per connection
+// Arguments:
+//  - server: The server connection object with a bound, listening socket
+//  - loop: The engine's event loop
+void run_server_workers(ServerConnection *server, server_loop_fn loop)
+{
+    atomic_int connected = 0;
+    int idle = 1;
+
+    if (server->workers == 1 && !server->pin_workers)
+    {
+        // The plain engine: its loop runs right here
+        ServerWorker worker = { server, server->listening_socket, 0, 0, &connected, &server->stats[0] };
+        idle = loop(&worker) == 0;
+    }
+    else
+    {
+        WorkerThread *threads = calloc(server->workers, sizeof(WorkerThread));
+        if (!threads)
+        {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+
+        // The kernel is picked on first use, do it once instead of racing in every thread
+        transform_variant();
+
+        for (int i = 0; i < server->workers; i++)
+        {
+            WorkerThread *t = &threads[i];
+            t->worker.server = server;
+            t->worker.listen_fd = i == 0 || !server->use_tcp ? server->listening_socket : open_ip_listener(server);
+            t->worker.shared_listener = !server->use_tcp && server->workers > 1;
+            t->worker.index = i;
+            t->worker.connected = &connected;
+            t->worker.stats = &server->stats[i];
+            t->loop = loop;
+            t->cpu = server->pin_workers ? nth_usable_cpu(i) : -1;
+        }
+        for (int i = 0; i < server->workers; i++)
+        {
+            int err = pthread_create(&threads[i].thread, NULL, worker_main, &threads[i]);
+            if (err != 0)
+            {
+                fprintf(stderr, "pthread_create: %s\n", strerror(err));
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int i = 0; i < server->workers; i++)
+        {
+            pthread_join(threads[i].thread, NULL);
+            idle = idle && threads[i].result == 0;
+        }
+        free(threads);
+    }
+
+    if (idle)
+    {
+        printf("\nNo incoming connection. Shutting down.\n");
+        fflush(stdout);
+    }
+}
@@ -1,5 +1,149 @@
 #include "shell.h"
 #include "client_utils.h"
+#include "cmd_hash.h"
+#include "prompt.h"
+#include "builtins.h"
+#include "jobs.h"
+
+#include <errno.h>
+#include <poll.h>           // poll() on stdin, the SIGCHLD signalfd and watched descriptors
+
+// Input read by read_line(): stdin is read in large blocks instead of through stdio
+static char input_buffer[INPUT_BUFFER_SIZE];
+static size_t input_start = 0;
+static size_t input_end = 0;
+
+// Descriptors polled by read_line() next to stdin, e.g. the client's socket and timer
+typedef struct {
+    int fd;
+    shell_fd_handler fn;
+    void *ctx;
+} WatchedFd;
+
+static WatchedFd watched[MAX_WATCHED_FDS];
+static int watched_count = 0;
+
+// Calls 'fn' whenever 'fd' is readable while the shell waits for input
+int shell_watch_fd(int fd, shell_fd_handler fn, void *ctx)
+{
+    if (watched_count == MAX_WATCHED_FDS)
+    {
+        return -1;
+    }
+    watched[watched_count].fd = fd;
+    watched[watched_count].fn = fn;
+    watched[watched_count].ctx = ctx;
+    watched_count++;
+    return 0;
+}
+
+// Stops polling 'fd' (safe from inside its handler)
+void shell_unwatch_fd(int fd)
+{
+    for (int i = 0; i < watched_count; i++)
+    {
+        if (watched[i].fd == fd)
+        {
+            watched[i] = watched[--watched_count];
+            return;
+        }
+    }
+}
+
+// Reads one line (with its '\n') into 'line', like fgets() but waiting in poll() on stdin, on
+// the SIGCHLD signalfd and on the watched descriptors, so background jobs are reaped and server
+// replies are handled while the shell sits at the prompt
+// Returns 0 at the end of input
+static int read_line(char *line, size_t cap)
+{
+    size_t used = 0;
+
+    while (1)
+    {
+        // Hand out buffered input up to the next newline
+        if (input_start < input_end)
+        {
+            size_t avail = input_end - input_start;
+            size_t room = cap - 1 - used;
+            char *nl = memchr(input_buffer + input_start, '\n', avail);
+            size_t take = nl ? (size_t)(nl - (input_buffer + input_start)) + 1 : avail;
+            if (take > room)
+            {
+                take = room;
+            }
+            memcpy(line + used, input_buffer + input_start, take);
+            input_start += take;
+            used += take;
+            if (used == cap - 1 || line[used - 1] == '\n')
+            {
+                line[used] = '\0';
+                return 1;
+            }
+        }
+
+        struct pollfd fds[2 + MAX_WATCHED_FDS] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { jobs_signal_fd(), POLLIN, 0 },
+        };
+        int nfds = 2;
+        for (int i = 0; i < watched_count; i++)
+        {
+            fds[nfds].fd = watched[i].fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            nfds++;
+        }
+        if (poll(fds, nfds, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            return 0;
+        }
+
+        // A child changed state: collect it now, the user is told before the next prompt
+        if (fds[1].revents & POLLIN)
+        {
+            jobs_reap();
+        }
+
+        // Handlers may unwatch descriptors, so look each one up again before calling it
+        for (int i = 2; i < nfds; i++)
+        {
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+            for (int w = 0; w < watched_count; w++)
+            {
+                if (watched[w].fd == fds[i].fd)
+                {
+                    watched[w].fn(fds[i].fd, watched[w].ctx);
+                    break;
+                }
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            ssize_t r = read(STDIN_FILENO, input_buffer, sizeof(input_buffer));
+            if (r == -1 && (errno == EINTR || errno == EAGAIN))
+            {
+                continue;
+            }
+            if (r <= 0)
+            {
+                // End of input: a last line without newline still counts
+                line[used] = '\0';
+                return used > 0;
+            }
+            input_start = 0;
+            input_end = r;
+        }
+    }
+}
 
 void run_shell(int socket, int isClient)
 {
@@ -7,17 +151,29 @@ void run_shell(int socket, int isClient)
      char line[MAX_LINE];
 
      // Enter an infinite loop to keep the shell running until the user exits (e.g., with Ctrl+D or a built-in command)
+     // Prompts only make sense when somebody is typing, not when stdin is a file or a pipe
+     int interactive = isatty(STDIN_FILENO);
+
+     // SIGCHLD goes to a signalfd that is polled next to stdin
+     jobs_init();
+
+     // Keyboard signals are for the foreground job, never for the shell itself
+     jobs_claim_terminal();
+
      while (1) {
-         display_shell_prompt();
+         if (interactive) {
+             jobs_notify();  // Report background jobs that finished meanwhile
+             display_shell_prompt();
+         }
  
          // Read a line of input from standard input (stdin)
-         // fgets reads up to MAX_LINE characters or until newline
+         // read_line reads up to MAX_LINE characters or until newline
  
-         // If fgets returns NULL (e.g., Ctrl+D / EOF), break the loop to exit the shell
-         if (!fgets(line, MAX_LINE, stdin)) break;
+         // If read_line returns 0 (e.g., Ctrl+D / EOF), break the loop to exit the shell
+         if (!read_line(line, MAX_LINE)) break;
  
          // --- Handle multi-line input ---
-         // If the line contains a backslash ('\') and it is at the end of the line (before the newline),
+         // If the line contains a backslash ('\\') and it is at the end of the line (before the newline),
          // this means the user wants to continue the command on the next line
          // For example:
          //    echo hello \ world
@@ -28,11 +184,12 @@ void run_shell(int socket, int isClient)
              // Remove the backslash and newline character ('\n') at the end of the line
              // This is done by replacing the backslash with a null terminator, effectively shortening the string
              line[strlen(line) - 2] = '\0'; 
-             printf("> "); 
+             if (interactive) printf("> "); 
+             fflush(stdout);
              
              char next_line[MAX_LINE];
              // Read the next line of input into a temporary buffer.
-             if (!fgets(next_line, MAX_LINE, stdin)) break;
+             if (!read_line(next_line, MAX_LINE)) break;
  
              // Check if there's enough space in 'line' to concatenate 'next_line'
              if (strlen(line) + strlen(next_line) < MAX_LINE) 
@@ -50,303 +207,673 @@ void run_shell(int socket, int isClient)
      }
 }
 
-// Display the shell prompt with current time, username, and hostname
-void display_shell_prompt() {
-    char hostname[256];
-    gethostname(hostname, sizeof(hostname));
 
-    struct passwd *pw = getpwuid(getuid());
-    char *username = pw->pw_name;
+// One arena per nesting level: "source" runs a script while the caller's AST is still in use
+static Arena arenas[MAX_SOURCE_DEPTH + 1];
+static int source_depth = 0;
 
-    time_t rawtime;
-    struct tm *timeinfo;
-    char time_str[6];
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    strftime(time_str, sizeof(time_str), "%H:%M", timeinfo);
+// Exit status of the last command or pipeline (like $? in sh)
+static int last_status = 0;
 
-    printf("%s %s@%s# ", time_str, username, hostname);
+// Returns the exit status of the last command or pipeline
+int shell_last_status(void)
+{
+    return last_status;
 }
 
-// Handle line with multiple commands separated by ';' (semicolon)
-void process_line(char *line, int socket, int isClient) 
+// Parse a piece of text (one line, or several joined by '\' continuations) and run its pipelines
+// The text is only read, so it may point straight into a memory-mapped script
+static void process_text(const char *text, size_t len, int socket, int isClient)
 {
-    char *command;  // Pointer to store each individual command extracted from the line
-    char *rest = line;  // Pointer to keep track of the remaining part of the line after extracting each command
+    Arena *arena = &arenas[source_depth];
+    Pipeline *pipeline;
 
-    // Loop through the line, extracting commands that are separated by semicolons (';')
-    while ((command = strsep(&rest, ";")) != NULL) 
+    source_depth++;
+    if (parse_line(arena, text, len, &pipeline) == 0)
     {
-        // For each extracted command, execute the command (via run_command function)
-        run_command(command,socket, isClient);
+        for (; pipeline != NULL; pipeline = pipeline->next)
+        {
+            const Builtin *b = builtin_find(pipeline->commands->argv[0], isClient);
+            if (pipeline->count == 1 && !pipeline->background && !(b && (b->flags & BUILTIN_JOB)))
+            {
+                last_status = run_command(pipeline->commands, socket, isClient);  // A single command needs no pipes
+            }
+            else
+            {
+                last_status = handle_pipeline(pipeline, socket, isClient);
+            }
+        }
     }
+    source_depth--;
+
+    // Every node and word of the line is dropped in one step
+    arena_reset(arena);
 }
 
+// Parse a whole line once and run its pipelines one after another (separated by ';')
+void process_line(char *line, int socket, int isClient) 
+{
+    process_text(line, strlen(line), socket, isClient);
+}
+
+
+// Counts the backslashes right before 'nl', not looking further back than 'start'
+static size_t trailing_backslashes(const char *start, const char *nl)
+{
+    size_t n = 0;
+    while (nl - n > start && *(nl - n - 1) == '\\')
+    {
+        n++;
+    }
+    return n;
+}
 
-// Execute a single command with checks for built-ins, pipes, redirection, and external commands
-void run_command(char *command, int socket, int isClient) 
+// Run a script file without prompts (the "-f" mode and the "source" builtin)
+// The file is memory-mapped and parsed in place, so no line is ever copied into a buffer;
+// stdout is fully buffered meanwhile and only flushed before a program is started
+int run_script(const char *path, int socket, int isClient)
 {
-    // Trim newline and any leading/trailing whitespace characters from the command
-    command[strcspn(command, "\n")] = '\0';  // Remove newline character
-    while (*command == ' ') command++;  // Remove leading spaces
-
-    // Remove comments from the command (anything after '#' is ignored)
-    char *comment = strchr(command, '#');
-    if (comment) *comment = '\0';  // Null-terminate the command at the comment character
-
-    // If the command is empty after trimming and removing comments, return
-    if (strlen(command) == 0) return;
-
-    // Pipeline Handling
-    // Find '|' in command
-    char *pipe_pos = strchr(command, '|');
-    if (pipe_pos) {
-        *pipe_pos = '\0';  // Null-terminate the command before the pipe
-        pipe_pos++;  // Point to the part after the pipe
-        handle_pipeline(command, pipe_pos, socket, isClient);  // Handle the pipe logic
-        return;  // Return after handling the pipeline
-    }
-
-    // Redirection Handling
-    if (strchr(command, '<') || strchr(command, '>')) {
-        handle_redirection(command);  // Handle input/output redirection
-        return;
-    }
-
-    // Command Parsing (if no pipe or redirection, parse the command normally)
-    char *argv[MAX_ARGS];  // Array to store parsed arguments
-    int argc = 0;  // Argument count
-    char *token = strtok(command, " \t");  // Tokenize command based on spaces or tabs
-    while (token) {
-        argv[argc++] = token;  // Store token as an argument
-        token = strtok(NULL, " \t");  // Get the next token
-    }
-    argv[argc] = NULL;  // Null-terminate the argument array
-
-    // Handle Built-in Commands
-    
-    // "help" command: Display help message
-    if (strcmp(argv[0], "help") == 0) {
-        printf("Simple Shell Help:\n");
-        printf("  cd [dir]     - change directory\n");
-        printf("  exit         - exit shell\n");
-        printf("  help         - show this help message\n");
-        printf("  quit           - Gracefully quit the shell\n");
-        printf("  halt           - Immediately quit the shell\n");
-        if (isClient)
-        {
-            printf("  send [msg]     - Send a message to the server\n");
-        }
-        
-        printf("Supports:\n  Piping (|), Redirection (<, >), Multiple cmds (;), Comments (#)\n");
-        return;
-    }
-
-    // "exit" command: Exit the shell
-    if (strcmp(argv[0], "exit") == 0) exit(0);
-
-    // "cd" command: Change the current directory
-    if (strcmp(argv[0], "cd") == 0) {
-        if (argv[1]) chdir(argv[1]);  // Change directory if argument is provided
-        else fprintf(stderr, "cd: missing argument\n");  // Print error if no argument
-        return;
-    }
-    // "send" && client != NULL
-    if (strcmp(argv[0], "send") == 0 && isClient) {
-        if (argv[1] != NULL) {
-            // Concatenate all arguments (excluding "send")
-            char msg[MAX_MSG_LEN] = {0}; // Make sure to initialize the message buffer
-            
-            // Start concatenating from argv[1] onward
-            for (int i = 1; i < argc; i++) {
-                strcat(msg, argv[i]);
-                if (i < argc - 1) {
-                    strcat(msg, " ");  // Add a space between words
+    if (source_depth >= MAX_SOURCE_DEPTH)
+    {
+        fprintf(stderr, "source: %s: nesting too deep\n", path);
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    char *data = NULL;
+    int mapped = 0;
+
+    if (S_ISREG(st.st_mode) && size > 0)
+    {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            data = NULL;
+        }
+        else
+        {
+            mapped = 1;
+            madvise(data, size, MADV_SEQUENTIAL);  // Read-ahead, the script is scanned once
+        }
+    }
+
+    // Pipes, empty-looking /proc files and anything mmap() refused are read into memory instead
+    if (!mapped)
+    {
+        size_t cap = 65536;
+        ssize_t r = 0;
+        size = 0;
+        data = malloc(cap);
+        while (data && (r = read(fd, data + size, cap - size)) != 0)
+        {
+            if (r == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
                 }
+                break;
             }
-    
-            // Send the concatenated message
-            handle_user_input(socket, msg);
-        } else {
-            printf("Error: No message provided to send.\n");
+            size += r;
+            if (size == cap)
+            {
+                char *grown = realloc(data, cap * 2);
+                if (!grown)
+                {
+                    r = -1;
+                    break;
+                }
+                data = grown;
+                cap *= 2;
+            }
+        }
+        if (!data || r == -1)
+        {
+            perror(path);
+            free(data);
+            close(fd);
+            return -1;
         }
-        return;
+    }
+    close(fd);
+
+    // Batch builtin output, a script's output is not watched line by line; a nested script (or
+    // one sourced from the prompt, already at depth 1) switches only when nobody else did
+    static char out_buffer[SCRIPT_OUTPUT_BUFFER];
+    static int buffering = 0;
+    int started_buffering = !buffering;
+    if (started_buffering)
+    {
+        fflush(stdout);
+        setvbuf(stdout, out_buffer, _IOFBF, sizeof(out_buffer));
+        buffering = 1;
     }
 
-    if (strcmp(argv[0], "quit") == 0) 
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end)
     {
-        write(socket, "disconnecting ...\n", 19);
-        close(socket);
-    
-        const char *exit_command = "exit\n";
-        
-        // Write to stdin (File descriptor 0)
-        if (write(STDIN_FILENO, exit_command, strlen(exit_command)) == -1) 
+        // Find the end of the statement, following '\' line continuations (an odd run of
+        // backslashes before the newline; "\\" is an escaped backslash that ends the line)
+        const char *nl = memchr(p, '\n', end - p);
+        while (nl && nl + 1 < end && trailing_backslashes(p, nl) % 2 == 1)
         {
-            perror("Error writing to stdin");
-            exit(1);
+            nl = memchr(nl + 1, '\n', end - nl - 1);
         }
+        const char *stop = nl ? nl : end;
+
+        process_text(p, stop - p, socket, isClient);
+        p = stop + 1;
 
-        // Optionally, you can also trigger the shell to process the exit by explicitly calling exit
-        exit(0);  // Exit the shell or program
+        // Reap finished background jobs, a script has no prompt to do it at
+        if (jobs_count() > 0)
+        {
+            jobs_reap();
+        }
     }
-    
 
-    if (strcmp(argv[0], "halt") == 0) 
+    if (started_buffering)
     {
-        kill(0, SIGTERM); // Terminate the whole process group (optional)
-        exit(1); // Final quit
+        fflush(stdout);
+        setvbuf(stdout, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, BUFSIZ);
+        buffering = 0;
     }
-    
 
-    // Execute External Command (non-built-in)
-    pid_t pid = fork();  // Create a new process
-    if (pid == 0) {  // Child process
-        execvp(argv[0], argv);  // Execute the external command
-        perror("execvp");  // Print error if execvp fails
-        exit(EXIT_FAILURE);  // Exit child process if command execution fails
-    } else {  // Parent process
-        waitpid(pid, NULL, 0);  // Wait for the child process to finish
+    if (mapped)
+    {
+        munmap(data, size);
+    }
+    else
+    {
+        free(data);
     }
+    return 0;
 }
 
 
+// Run a builtin inside the shell, with its redirections applied by swapping descriptors
+// 'stdin_fd' / 'stdout_fd' (pipe ends, or -1) become fd 0 / fd 1 first, then '<' and '>' files replace them,
+// exactly like spawn_command() wires up a program; the shell's own fds are restored afterwards
+static int run_builtin(const Builtin *b, Command *cmd, int stdin_fd, int stdout_fd, int socket, int isClient)
+{
+    int saved_in = -1, saved_out = -1;
+    int in_fd = stdin_fd, out_fd = stdout_fd;
+    void (*old_pipe)(int) = SIG_DFL;
+
+    if (cmd->input_file)
+    {
+        in_fd = open(cmd->input_file, O_RDONLY | O_CLOEXEC);
+        if (in_fd == -1)
+        {
+            perror(cmd->input_file);
+            return 1;
+        }
+    }
+    if (cmd->output_file)
+    {
+        out_fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out_fd == -1)
+        {
+            perror(cmd->output_file);
+            if (in_fd != -1) close(in_fd);
+            return 1;
+        }
+    }
+
+    // Whatever the shell printed so far belongs to the old stdout
+    fflush(stdout);
+
+    // Keep copies above the low descriptors, close-on-exec so spawned programs never see them
+    if (in_fd != -1)
+    {
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(in_fd, STDIN_FILENO);
+        if (in_fd != stdin_fd) close(in_fd);
+    }
+    if (out_fd != -1)
+    {
+        saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(out_fd, STDOUT_FILENO);
+        if (out_fd != stdout_fd) close(out_fd);
+
+        // A reader that already quit must not kill the shell, the builtin just sees EPIPE
+        old_pipe = signal(SIGPIPE, SIG_IGN);
+    }
+
+    int status = b->fn(cmd->argc, cmd->argv, socket, isClient);
 
-// Handle two commands connected with a pipe ('|'), redirecting output from the first command to the input of the second
-void handle_pipeline(char *left_cmd, char *right_cmd, int socket, int isClient) {
-    int pipefd[2];  // File descriptors for the pipe (pipefd[0] for reading, pipefd[1] for writing)
-    pipe(pipefd);  // Create a pipe for communication between the two commands
+    fflush(stdout);
+    if (saved_out != -1)
+    {
+        clearerr(stdout);
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+        signal(SIGPIPE, old_pipe);
+    }
+    if (saved_in != -1)
+    {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    return status;
+}
 
-    // Fork a new process for the first command (left_cmd)
-    pid_t pid1 = fork();
-    if (pid1 == 0) {
-        // In the child process (first command)
 
-        // Close the reading end of the pipe, as we only need to write to the pipe
-        close(pipefd[0]);
+// Execute a single parsed command: a built-in runs inside the shell, anything else is spawned
+// Returns the exit status of the command
+int run_command(Command *cmd, int socket, int isClient) 
+{
+    // Built-in commands come from the registry in builtins.c, one lookup instead of a strcmp chain
+    const Builtin *b = builtin_find(cmd->argv[0], isClient);
+    if (b)
+    {
+        return run_builtin(b, cmd, -1, -1, socket, isClient);
+    }
 
-        // Redirect stdout to the write-end of the pipe
-        dup2(pipefd[1], STDOUT_FILENO);
+    // Execute External Command (non-built-in), applying its redirections
+    return handle_redirection(cmd);
+}
 
-        // Close the write-end of the pipe after redirecting stdout
-        close(pipefd[1]);
 
-        // Run the left command (before the pipe)
-        run_command(left_cmd, socket, isClient);
+// glibc 2.35 added a spawn file action that hands the terminal to the child's process group;
+// without it the parent's tcsetpgrp() right after the spawn is all there is
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
 
-        // If run_command fails, exit the child process
-        exit(EXIT_FAILURE);
+// Returns the redirection file that made a spawn of the program at 'path' fail, or NULL when
+// the program is to blame (it is gone or not executable)
+static const char *redirection_failure(const char *path, const SpawnIO *io)
+{
+    if (!io || access(path, X_OK) != 0)
+    {
+        return NULL;
     }
+    if (io->input_file && access(io->input_file, R_OK) != 0)
+    {
+        return io->input_file;
+    }
+    return io->output_file;
+}
 
-    // Fork another process for the second command (right_cmd)
-    pid_t pid2 = fork();
-    if (pid2 == 0) {
-        // In the child process (second command)
+// Launch an external command with posix_spawn() instead of fork() + execvp()
+// glibc implements it with clone(CLONE_VM | CLONE_VFORK), so the shell's page tables are
+// never copied, which keeps launch latency flat no matter how large the shell has grown.
+// Pipe ends and redirections are applied in the child as spawn file actions (dup2/open).
+pid_t spawn_command(char **argv, const SpawnIO *io)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    pid_t pid;
 
-        // Close the write-end of the pipe, as we only need to read from the pipe
-        close(pipefd[1]);
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+    short flags = POSIX_SPAWN_SETSIGMASK;
 
-        // Redirect stdin to the read-end of the pipe
-        dup2(pipefd[0], STDIN_FILENO);
+    if (io)
+    {
+#ifdef HAVE_SPAWN_TCSETPGRP
+        // The first stage of a foreground job takes the terminal before exec, while fd 0 is still
+        // the shell's terminal, so it can never read it as a background group and get SIGTTIN
+        // (the child runs with every signal blocked, so its tcsetpgrp() raises no SIGTTOU)
+        if (io->foreground && io->pgid == 0)
+        {
+            posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+        }
+#endif
+
+        // Pipe ends first, so a file redirection on the same stream wins (like "a | b < file")
+        if (io->stdin_fd >= 0)
+        {
+            posix_spawn_file_actions_adddup2(&actions, io->stdin_fd, STDIN_FILENO);
+        }
+        if (io->stdout_fd >= 0)
+        {
+            posix_spawn_file_actions_adddup2(&actions, io->stdout_fd, STDOUT_FILENO);
+        }
+        if (io->stderr_fd >= 0)
+        {
+            posix_spawn_file_actions_adddup2(&actions, io->stderr_fd, STDERR_FILENO);
+        }
 
-        // Close the read-end of the pipe after redirecting stdin
-        close(pipefd[0]);
+        // Input redirection: the file replaces stdin of the new program
+        if (io->input_file)
+        {
+            posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, io->input_file, O_RDONLY, 0);
+        }
 
-        // Run the right command (after the pipe)
-        run_command(right_cmd,socket, isClient);
+        // Output redirection: create or truncate the file with 644 rights, it replaces stdout
+        if (io->output_file)
+        {
+            posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, io->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
 
-        // If run_command fails, exit the child process
-        exit(EXIT_FAILURE);
+        // Join (or start, with pgid 0) the process group of a pipeline
+        if (io->pgid >= 0)
+        {
+            posix_spawnattr_setpgroup(&attr, io->pgid);
+            flags |= POSIX_SPAWN_SETPGROUP;
+        }
     }
 
-    // In the parent process: close both ends of the pipe
-    close(pipefd[0]);
-    close(pipefd[1]);
+    // The shell blocks SIGCHLD for its signalfd, programs must start with nothing blocked
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
 
-    // Wait for both child processes to finish
-    waitpid(pid1, NULL, 0);
-    waitpid(pid2, NULL, 0);
+    // An interactive shell ignores Ctrl+C, Ctrl+Z and the terminal stops, its programs must not
+    sigset_t job_signals;
+    jobs_job_signals(&job_signals);
+    posix_spawnattr_setsigdefault(&attr, &job_signals);
+    flags |= POSIX_SPAWN_SETSIGDEF;
+    posix_spawnattr_setflags(&attr, flags);
+
+    // Buffered builtin output must reach the terminal/file before the program's own output
+    fflush(stdout);
+
+    // The command hash resolves argv[0] against $PATH once, later launches exec the cached path
+    const char *path = cmd_hash_lookup(argv[0]);
+    int err = path ? posix_spawn(&pid, path, &actions, &attr, argv, environ) : ENOENT;
+
+    // The cached binary disappeared: forget it and search $PATH again
+    // (ENOENT also comes from a missing "<" file, which must not flush a valid entry)
+    if (path && err == ENOENT && path != argv[0] && access(path, F_OK) != 0)
+    {
+        cmd_hash_forget(argv[0]);
+        path = cmd_hash_lookup(argv[0]);
+        err = path ? posix_spawn(&pid, path, &actions, &attr, argv, environ) : ENOENT;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (!path)
+    {
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        return -1;
+    }
+    if (err != 0)
+    {
+        // A failed open action fails the whole spawn: name the file when the program itself is fine
+        const char *file = redirection_failure(path, io);
+        fprintf(stderr, "%s: %s\n", file ? file : argv[0], strerror(err));
+        return -1;
+    }
+    return pid;
 }
 
 
-// Handle I/O redirection for input ('<') and output ('>') in shell commands
-void handle_redirection(char *command) 
+// Turn a waitpid() status into a shell exit status (128 + signal for killed programs)
+static int exit_status(int wstatus)
 {
-    char *input_file = NULL, *output_file = NULL;
+    return WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+}
 
-    // Output redirection: check if the command contains '>'
-    if ((output_file = strchr(command, '>'))) 
+// Register started processes as a foreground job and wait until they exit or get stopped
+// Returns the exit status of the last process
+static int wait_foreground(pid_t pgid, const pid_t *pids, int count, const Command *commands)
+{
+    int id = jobs_add(pgid, pids, count, commands, 0);
+    if (id != -1)
     {
-        // Split the command at '>'
-        *output_file = '\0';  // Null-terminate the command before '>'
-        output_file++;        // Move past the '>'
-        
-        // Skip any leading spaces after the '>'
-        while (*output_file == ' ') output_file++;
+        return jobs_wait_foreground(id);
     }
 
-    // Input redirection: check if the command contains '<'
-    if ((input_file = strchr(command, '<'))) 
+    // The job table is full: a plain blocking wait, without Ctrl+Z support
+    int wstatus = 0;
+    for (int i = 0; i < count; i++)
     {
-        // Split the command at '<'
-        *input_file = '\0';  // Null-terminate the command before '<'
-        input_file++;        // Move past the '<'
+        while (waitpid(pids[i], &wstatus, 0) == -1 && errno == EINTR)
+        {
+        }
+    }
+    return exit_status(wstatus);
+}
+
 
-        // Skip any leading spaces after the '<'
-        while (*input_file == ' ') input_file++;
+// Run a whole pipeline ("a | b | c ...") as sibling processes of the shell
+// The parser already split the stages, so the N-1 pipes are created at once, every stage is
+// started in one process group and the group becomes one job of the job table (jobs.c).
+// Builtins that neither read stdin nor change the shell (echo, printf, test, ...) run inside
+// the shell once the programs are started, from the last stage to the first, so the reader of
+// every builtin's pipe is already running (or already gone, then the builtin just gets EPIPE).
+// A sink builtin ("cmd | send") as the last stage also runs inside the shell, reading the last
+// pipe; every other builtin of that pipeline is forked then, since nobody would feed the sink
+// while it runs. A pipeline ending in '&' is not waited for; its builtins then run in forked
+// copies too.
+// Returns the exit status of the last stage (0 for a background pipeline)
+int handle_pipeline(Pipeline *pipeline, int socket, int isClient)
+{
+    int n = pipeline->count;
+    int background = pipeline->background;
+    int (*pipes)[2] = malloc((n > 1 ? n - 1 : 1) * sizeof(*pipes));
+    Command **stages = malloc(n * sizeof(*stages));
+    const Builtin **inline_builtins = calloc(n, sizeof(*inline_builtins));
+    pid_t *pids = malloc(n * sizeof(*pids));
+    if (!pipes || !stages || !inline_builtins || !pids)
+    {
+        perror("malloc");
+        free(pipes);
+        free(stages);
+        free(inline_builtins);
+        free(pids);
+        return 1;
     }
 
-    // Parse the command and arguments (after handling redirection)
-    char *argv[MAX_ARGS];
-    int argc = 0;
-    char *token = strtok(command, " \t");
-    while (token) 
+    // Create every pipe up front (close-on-exec, dup2 in the children clears the flag on 0/1)
+    for (int i = 0; i < n - 1; i++)
     {
-        argv[argc++] = token;
-        token = strtok(NULL, " \t");
+        if (pipe2(pipes[i], O_CLOEXEC) == -1)
+        {
+            perror("pipe");
+            for (int j = 0; j < i; j++)
+            {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            free(pipes);
+            free(stages);
+            free(inline_builtins);
+            free(pids);
+            return 1;
+        }
+    }
+
+    // A sink at the end must run in the shell, it needs the shell's state (the server connection)
+    Command *last = pipeline->commands;
+    while (last->next)
+    {
+        last = last->next;
+    }
+    const Builtin *sink = background ? NULL : builtin_find(last->argv[0], isClient);
+    if (sink && !(sink->flags & BUILTIN_SINK))
+    {
+        sink = NULL;
     }
-    argv[argc] = NULL;  // Null-terminate the argument list
 
-    // Fork a child process to execute the command
-    pid_t pid = fork();
-    if (pid == 0) 
+    int interactive = !background && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+    pid_t pgid = 0;  // 0 until the first stage is started, then the pid of the group leader
+    int started = 0;
+    int last_stage = -1;  // How the last stage ran: -1 not started, 0 as a process, 1 in the shell
+    int pipeline_status = 127;
+
+    Command *cmd = pipeline->commands;
+    for (int i = 0; i < n; i++, cmd = cmd->next)
     {
-        // In the child process
+        stages[i] = cmd;
+        const Builtin *b = builtin_find(cmd->argv[0], isClient);
+        if (sink ? i == n - 1 : (b && (b->flags & BUILTIN_INLINE) && !background))
+        {
+            inline_builtins[i] = b;  // Runs in the shell after the programs are started
+            continue;
+        }
 
-        // Handle input redirection (if any)
-        if (input_file) 
+        SpawnIO io = {
+            .stdin_fd = i > 0 ? pipes[i - 1][0] : -1,
+            .stdout_fd = i < n - 1 ? pipes[i][1] : -1,
+            .stderr_fd = -1,
+            .input_file = cmd->input_file,
+            .output_file = cmd->output_file,
+            .pgid = pgid,
+            .foreground = interactive,
+        };
+
+        pid_t pid;
+        if (b)
         {
-            int fd = open(input_file, O_RDONLY);  // Open the input file for reading
-            if (fd == -1) 
-            { 
-                perror("open input"); 
-                exit(EXIT_FAILURE);  // Exit if opening the input file fails
+            // Builtins that change the shell (cd, exit, ...) run in a forked copy, like a subshell
+            fflush(stdout);
+            pid = fork();
+            if (pid == 0)
+            {
+                // Join the job and take the terminal before anything could read it, then let
+                // the keyboard signals the shell ignores reach this copy again
+                setpgid(0, pgid);
+                if (interactive && pgid == 0)
+                {
+                    tcsetpgrp(STDIN_FILENO, getpid());
+                }
+                jobs_reset_signals();
+                if (io.stdin_fd >= 0) dup2(io.stdin_fd, STDIN_FILENO);
+                if (io.stdout_fd >= 0) dup2(io.stdout_fd, STDOUT_FILENO);
+
+                // Drop every pipe end, otherwise a builtin reading stdin would never see EOF
+                for (int j = 0; j < n - 1; j++)
+                {
+                    close(pipes[j][0]);
+                    close(pipes[j][1]);
+                }
+
+                int status = run_command(cmd, socket, isClient);
+                fflush(stdout);
+                exit(status);
+            }
+            if (pid > 0)
+            {
+                setpgid(pid, pgid ? pgid : pid);  // Also set from the parent to avoid racing the child
             }
-            dup2(fd, STDIN_FILENO);  // Redirect stdin to the input file
-            close(fd);  // Close the file descriptor
+        }
+        else
+        {
+            pid = spawn_command(cmd->argv, &io);
         }
 
-        // Handle output redirection (if any)
-        if (output_file) 
+        if (pid > 0)
         {
-            int fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);  // Open the output file for writing (create if doesn't exist, clear file before reading and set 644 rights {owner - group - others})
-            if (fd == -1) 
-            { 
-                perror("open output"); 
-                exit(EXIT_FAILURE);  // Exit if opening the output file fails
+            if (pgid == 0)
+            {
+                pgid = pid;
+                if (interactive)
+                {
+                    jobs_give_terminal(pgid);
+                }
+            }
+            pids[started++] = pid;
+            if (i == n - 1)
+            {
+                last_stage = 0;
             }
-            dup2(fd, STDOUT_FILENO);  // Redirect stdout to the output file
-            close(fd);  // Close the file descriptor
         }
+    }
 
-        // Execute the command with arguments
-        execvp(argv[0], argv);
-        perror("execvp");  // If execvp fails, print an error
-        exit(EXIT_FAILURE);  // Exit child process on failure
-    } 
-    else 
+    // The programs own their pipe ends now; the shell keeps only the write ends of its own builtins
+    // (and the read end of the last pipe for a sink)
+    for (int i = 0; i < n - 1; i++)
     {
-        // In the parent process: wait for the child to finish
-        waitpid(pid, NULL, 0);
+        if (!sink || i < n - 2)
+        {
+            close(pipes[i][0]);
+        }
+        if (!inline_builtins[i])
+        {
+            close(pipes[i][1]);
+        }
     }
+
+    // In-shell stages, last to first, each closing its pipe so the next stage sees EOF
+    for (int i = n - 1; i >= 0; i--)
+    {
+        if (!inline_builtins[i])
+        {
+            continue;
+        }
+        int stdin_fd = sink && i > 0 ? pipes[i - 1][0] : -1;
+        int stdout_fd = i < n - 1 ? pipes[i][1] : -1;
+        int status = run_builtin(inline_builtins[i], stages[i], stdin_fd, stdout_fd, socket, isClient);
+        if (stdin_fd != -1)
+        {
+            close(stdin_fd);
+        }
+        if (stdout_fd != -1)
+        {
+            close(stdout_fd);
+        }
+        if (i == n - 1)
+        {
+            last_stage = 1;
+            pipeline_status = status;
+        }
+    }
+
+    if (started > 0)
+    {
+        if (background)
+        {
+            jobs_add(pgid, pids, started, pipeline->commands, 1);
+            pipeline_status = 0;
+        }
+        else
+        {
+            // The whole group is one job, waited for (and reaped) in one place
+            int status = wait_foreground(pgid, pids, started, pipeline->commands);
+            if (last_stage == 0)
+            {
+                pipeline_status = status;
+            }
+        }
+    }
+    else if (interactive && pgid != 0)
+    {
+        jobs_give_terminal(getpgrp());
+    }
+
+    free(pipes);
+    free(stages);
+    free(inline_builtins);
+    free(pids);
+    return pipeline_status;
+}
+
+
+// Run an external command with its input ('<') and output ('>') redirections
+// An interactive shell starts it in its own process group, so Ctrl+Z can stop it as a job
+// Returns its exit status, 127 when it could not be started
+int handle_redirection(Command *cmd) 
+{
+    int interactive = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+
+    // Spawn the command with the redirections applied as file actions
+    SpawnIO io = { .stdin_fd = -1, .stdout_fd = -1, .stderr_fd = -1, .input_file = cmd->input_file, .output_file = cmd->output_file, .pgid = interactive ? 0 : -1, .foreground = interactive };
+    pid_t pid = spawn_command(cmd->argv, &io);
+    if (pid <= 0)
+    {
+        return 127;
+    }
+
+    // In the parent process: wait for the child to finish (or to be stopped)
+    return wait_foreground(interactive ? pid : -1, &pid, 1, cmd);
 }
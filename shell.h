@@ -4,7 +4,11 @@
 // Define constants for maximum input size and message length
 #define MAX_LINE 1024          // Maximum allowed length for a command line input
 #define MAX_ARGS 64            // Maximum number of arguments for a single command
-#define MAX_MSG_LEN 64         // Maximum length for server/client messages
+#define MAX_MSG_LEN 4096       // Maximum length for server/client messages
+#define MAX_SOURCE_DEPTH 16    // Maximum nesting of "source" scripts
+#define SCRIPT_OUTPUT_BUFFER 65536  // stdout buffer used while a script runs
+#define INPUT_BUFFER_SIZE 65536     // Block size the interactive loop reads stdin with
+#define MAX_WATCHED_FDS 4           // Extra descriptors polled while waiting for input (client socket, timer)
 
 // Include necessary standard libraries for various functionalities
 #include <stdio.h>             // Standard I/O functions (fgets, printf, fprintf, perror)
@@ -15,6 +19,15 @@
 #include <fcntl.h>             // File control (open)
 #include <time.h>              // Time-related functions (time, localtime, strftime)
 #include <pwd.h>               // Password database (getpwuid, struct passwd for user info)
+#include <signal.h>            // signal, kill (terminal hand-over, halt)
+#include <sys/mman.h>          // mmap, madvise (script files)
+#include <sys/stat.h>          // fstat (script files)
+
+#include "parser.h"            // Command / Pipeline AST produced by the single-pass parser
+#include <spawn.h>             // posix_spawn and spawn file actions for launching commands
+
+// Environment handed to spawned programs
+extern char **environ;
 
 
 // Function prototypes:
@@ -25,32 +38,73 @@
 //  - isClient: A flag indicating whether this instance is running as a client (1) or server (0)
 void run_shell(int socket, int isClient);
 
+// Runs every command of a script file without prompts ("-f" mode and the "source" builtin)
+// Arguments:
+//  - path: The script to run, it is memory-mapped and parsed in place
+//  - socket / isClient: Passed on to the commands, like for run_shell
+// Returns 0 when the file could be read, -1 otherwise
+int run_script(const char *path, int socket, int isClient);
+
+// Called when a watched descriptor is readable (or hung up) while the shell waits for input
+typedef void (*shell_fd_handler)(int fd, void *ctx);
+
+// Polls 'fd' next to stdin while the shell waits for a line, 'fn' handles it
+// Returns 0, or -1 when MAX_WATCHED_FDS descriptors are already watched
+int shell_watch_fd(int fd, shell_fd_handler fn, void *ctx);
+
+// Stops watching 'fd' (may be called from its handler)
+void shell_unwatch_fd(int fd);
+
 // Displays the shell prompt which may include time, username, and hostname
+// The prompt comes from a compiled template and a cached rendering (prompt.c)
 void display_shell_prompt();
 
-// Processes the input command line, splitting the command into arguments and handling special cases
+// Processes the input command line: parses it once into pipelines and runs them in order
 // Arguments:
-//  - line: The command line input from the user
+//  - line: The command line input from the user (not modified)
 //  - socket: The socket file descriptor used for communication
 //  - isClient: A flag indicating whether this is a client (1) or server (0)
 void process_line(char *line, int socket, int isClient);
 
-// Executes the given command using the appropriate system call or custom execution logic
+// Executes one parsed command: a built-in in the shell itself, anything else as a new process
 // Arguments:
-//  - command: The full command to execute
+//  - cmd: The parsed command (words and redirections)
 //  - socket: The socket file descriptor used for communication
 //  - isClient: A flag indicating whether this is a client (1) or server (0)
-void run_command(char *command, int socket, int isClient);
+// Returns the exit status of the command
+int run_command(Command *cmd, int socket, int isClient);
 
-// Handles pipeline execution (e.g., "cmd1 | cmd2"), running multiple commands in sequence
+// Handles pipeline execution (e.g., "cmd1 | cmd2 | cmd3"), running all stages side by side
 // Arguments:
-//  - left_cmd: The command on the left side of the pipe
-//  - right_cmd: The command on the right side of the pipe
+//  - pipeline: The parsed pipeline, one Command per stage
 //  - socket: The socket file descriptor used for communication
 //  - isClient: A flag indicating whether this is a client (1) or server (0)
-void handle_pipeline(char *left_cmd, char *right_cmd, int socket, int isClient);
+// Returns the exit status of the last stage
+int handle_pipeline(Pipeline *pipeline, int socket, int isClient);
+
+// Runs an external command with its I/O redirections (e.g., "cmd > file" or "cmd < file")
+// Returns its exit status (127 when it could not be started)
+int handle_redirection(Command *cmd);
+
+// Returns the exit status of the last command or pipeline (like $? in sh)
+int shell_last_status(void);
 
-// Handles I/O redirection in the shell (e.g., "cmd > file" or "cmd < file")
-void handle_redirection(char *command);
+// Describes how a spawned program is wired up
+typedef struct {
+    int stdin_fd;               // Descriptor to use as stdin (e.g. a pipe end), -1 to inherit
+    int stdout_fd;              // Descriptor to use as stdout, -1 to inherit
+    int stderr_fd;              // Descriptor to use as stderr, -1 to inherit
+    const char *input_file;     // File to open as stdin ('<'), NULL for none
+    const char *output_file;    // File to create/truncate as stdout ('>'), NULL for none
+    pid_t pgid;                 // Process group: -1 keep the shell's, 0 start a new one, >0 join it
+    int foreground;             // Hand the terminal to the new group inside the spawn (with pgid 0)
+} SpawnIO;
+
+// Launches an external program with posix_spawn (vfork-style, no page-table copy)
+// Arguments:
+//  - argv: NULL-terminated argument vector, argv[0] is looked up in $PATH
+//  - io: Descriptors, redirections and process group for the child, or NULL to inherit everything
+// Returns the child's pid, or -1 when the program could not be started
+pid_t spawn_command(char **argv, const SpawnIO *io);
 
 #endif  // End of SHELL_H header guard
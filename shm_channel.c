@@ -0,0 +1,275 @@
+#include "shm_channel.h"
+
+#include <errno.h>          // errno, EAGAIN
+#include <stdatomic.h>      // Ring positions and wakeup flags shared between the processes
+#include <stdint.h>         // uint64_t
+#include <string.h>         // memcpy(), memset()
+#include <sys/eventfd.h>    // eventfd() for the wakeups
+#include <sys/mman.h>       // memfd_create(), mmap()
+#include <sys/socket.h>     // sendmsg() / recvmsg() with SCM_RIGHTS
+#include <unistd.h>         // ftruncate(), close()
+
+// Layout of one direction in the shared mapping
+// Every field the two sides write sits on its own cache line, so the producer bumping 'tail'
+// does not keep stealing the line the consumer bumps 'head' in
+struct ShmRing {
+    _Alignas(64) _Atomic uint64_t head;         // Bytes consumed so far (written by the consumer)
+    _Alignas(64) _Atomic uint64_t tail;         // Bytes produced so far (written by the producer)
+    _Alignas(64) atomic_int reader_waiting;     // Consumer sleeps until 'tail' moves
+    _Alignas(64) atomic_int writer_waiting;     // Producer sleeps until 'head' moves
+    _Alignas(64) char data[SHM_RING_SIZE];      // The bytes, position p lives at p % SHM_RING_SIZE
+};
+
+// Descriptors passed in the handshake
+enum { SHM_FD_MEM, SHM_FD_SERVER, SHM_FD_CLIENT, SHM_FD_COUNT };
+
+// Wakes the peer if it announced that it sleeps on 'flag'
+// The seq_cst fence orders the position update before the flag check; the sleeper raises the
+// flag before re-checking the position, so one of the two always sees the other
+static void wake_if_waiting(atomic_int *flag, int fd)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(flag, memory_order_relaxed) &&
+        atomic_exchange_explicit(flag, 0, memory_order_relaxed))
+    {
+        uint64_t one = 1;
+        ssize_t w = write(fd, &one, sizeof(one));
+        (void)w;  // A full counter is still a pending wakeup
+    }
+}
+
+// Maps the two rings of a channel; 'server' picks the direction each side consumes
+static int map_rings(ShmChannel *ch, int memfd, int server)
+{
+    ch->map_len = 2 * sizeof(ShmRing);
+    ch->map = mmap(NULL, ch->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (ch->map == MAP_FAILED)
+    {
+        return -1;
+    }
+    ShmRing *to_server = ch->map;
+    ShmRing *to_client = to_server + 1;
+    ch->rx = server ? to_server : to_client;
+    ch->tx = server ? to_client : to_server;
+    return 0;
+}
+
+// Creates the rings and sends them to the client
+int shm_channel_accept(ShmChannel *ch, int sock)
+{
+    int fds[SHM_FD_COUNT] = { -1, -1, -1 };
+    int rc = -1;
+
+    memset(ch, 0, sizeof(*ch));
+    ch->wake_fd = ch->peer_fd = -1;
+
+    fds[SHM_FD_MEM] = memfd_create("shellnet-shm", MFD_CLOEXEC);
+    fds[SHM_FD_SERVER] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    fds[SHM_FD_CLIENT] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fds[SHM_FD_MEM] == -1 || fds[SHM_FD_SERVER] == -1 || fds[SHM_FD_CLIENT] == -1 ||
+        ftruncate(fds[SHM_FD_MEM], 2 * sizeof(ShmRing)) == -1 ||
+        map_rings(ch, fds[SHM_FD_MEM], 1) == -1)
+    {
+        goto out;
+    }
+
+    // Both readers start out asleep, so the first bytes in either direction wake them up
+    atomic_store(&ch->rx->reader_waiting, 1);
+    atomic_store(&ch->tx->reader_waiting, 1);
+
+    // One byte carries the descriptors, the client blocks on it in shm_channel_connect()
+    char byte = 'M';
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct msghdr mh = { 0 };
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    if (sendmsg(sock, &mh, MSG_NOSIGNAL) != 1)
+    {
+        goto out;
+    }
+
+    ch->wake_fd = fds[SHM_FD_SERVER];
+    ch->peer_fd = fds[SHM_FD_CLIENT];
+    fds[SHM_FD_SERVER] = fds[SHM_FD_CLIENT] = -1;
+    rc = 0;
+
+out:
+    for (int i = 0; i < SHM_FD_COUNT; i++)
+    {
+        if (fds[i] != -1)
+        {
+            close(fds[i]);  // The mapping keeps the memory alive
+        }
+    }
+    if (rc == -1)
+    {
+        shm_channel_close(ch);
+    }
+    return rc;
+}
+
+// Receives the rings from the server and maps them
+int shm_channel_connect(ShmChannel *ch, int sock)
+{
+    int fds[SHM_FD_COUNT];
+    char byte;
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct msghdr mh = { 0 };
+
+    memset(ch, 0, sizeof(*ch));
+    ch->wake_fd = ch->peer_fd = -1;
+
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+    ssize_t r;
+    while ((r = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+    {
+    }
+
+    struct cmsghdr *cm = r == 1 ? CMSG_FIRSTHDR(&mh) : NULL;
+    if (!cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS ||
+        cm->cmsg_len != CMSG_LEN(sizeof(fds)))
+    {
+        errno = EPROTO;  // Not a shared-memory server
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+
+    int rc = map_rings(ch, fds[SHM_FD_MEM], 0);
+    close(fds[SHM_FD_MEM]);
+    ch->wake_fd = fds[SHM_FD_CLIENT];
+    ch->peer_fd = fds[SHM_FD_SERVER];
+    if (rc == -1)
+    {
+        shm_channel_close(ch);
+    }
+    return rc;
+}
+
+// Unmaps the rings and closes the eventfds
+void shm_channel_close(ShmChannel *ch)
+{
+    if (ch->map && ch->map != MAP_FAILED)
+    {
+        munmap(ch->map, ch->map_len);
+    }
+    if (ch->wake_fd != -1)
+    {
+        close(ch->wake_fd);
+    }
+    if (ch->peer_fd != -1)
+    {
+        close(ch->peer_fd);
+    }
+    ch->map = NULL;
+    ch->wake_fd = ch->peer_fd = -1;
+}
+
+// Clears pending wakeups
+void shm_channel_ack(ShmChannel *ch)
+{
+    uint64_t count;
+    ssize_t r = read(ch->wake_fd, &count, sizeof(count));
+    (void)r;  // EAGAIN: nothing pending
+}
+
+// Copies received bytes out of the ring
+ssize_t shm_channel_read(ShmChannel *ch, void *buf, size_t len)
+{
+    ShmRing *r = ch->rx;
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if (tail == head)
+    {
+        // Announce the sleep, then look once more: a producer that missed the flag is seen here
+        atomic_store_explicit(&r->reader_waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (tail == head)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        atomic_store_explicit(&r->reader_waiting, 0, memory_order_relaxed);
+    }
+
+    size_t n = tail - head < len ? tail - head : len;
+    size_t at = head & (SHM_RING_SIZE - 1);
+    size_t first = SHM_RING_SIZE - at < n ? SHM_RING_SIZE - at : n;
+    memcpy(buf, r->data + at, first);
+    memcpy((char *)buf + first, r->data, n - first);
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+
+    wake_if_waiting(&r->writer_waiting, ch->peer_fd);
+    return n;
+}
+
+// Bytes that can be written right now
+size_t shm_channel_space(ShmChannel *ch)
+{
+    ShmRing *r = ch->tx;
+    return SHM_RING_SIZE - (atomic_load_explicit(&r->tail, memory_order_relaxed) -
+                            atomic_load_explicit(&r->head, memory_order_acquire));
+}
+
+// Asks the peer for a wakeup once enough space is free
+int shm_channel_want_space(ShmChannel *ch, size_t need)
+{
+    atomic_store_explicit(&ch->tx->writer_waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (shm_channel_space(ch) >= need)
+    {
+        atomic_store_explicit(&ch->tx->writer_waiting, 0, memory_order_relaxed);
+        return 1;
+    }
+    return 0;
+}
+
+// Copies as much of the iovecs into the ring as fits
+size_t shm_channel_writev(ShmChannel *ch, const struct iovec *iov, int iovcnt)
+{
+    ShmRing *r = ch->tx;
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t space = shm_channel_space(ch);
+    size_t done = 0;
+
+    if (space == 0 && shm_channel_want_space(ch, 1) == 0)
+    {
+        return 0;
+    }
+    space = shm_channel_space(ch);
+
+    for (int i = 0; i < iovcnt && done < space; i++)
+    {
+        size_t n = iov[i].iov_len < space - done ? iov[i].iov_len : space - done;
+        size_t at = (tail + done) & (SHM_RING_SIZE - 1);
+        size_t first = SHM_RING_SIZE - at < n ? SHM_RING_SIZE - at : n;
+        memcpy(r->data + at, iov[i].iov_base, first);
+        memcpy(r->data, (const char *)iov[i].iov_base + first, n - first);
+        done += n;
+    }
+    if (done > 0)
+    {
+        atomic_store_explicit(&r->tail, tail + done, memory_order_release);
+        wake_if_waiting(&r->reader_waiting, ch->peer_fd);
+    }
+    return done;
+}
@@ -0,0 +1,66 @@
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <stddef.h>         // size_t
+#include <sys/types.h>      // ssize_t
+#include <sys/uio.h>        // struct iovec
+
+// Shared-memory transport for clients on the same host ("-m name")
+//
+// The client still connects to a UNIX socket (in the abstract namespace), but only for the
+// handshake and to notice when the peer goes away: the server answers the connection with a
+// memfd holding two single-producer/single-consumer byte rings (one per direction) and two
+// eventfds, passed with SCM_RIGHTS. From then on every byte goes through the rings.
+//
+// Producer and consumer only share the ring positions, so neither side takes a lock. The
+// eventfds are wakeups only: a side that found its ring empty (or full) raises a flag before
+// going to sleep, and the peer writes the eventfd only when it sees that flag, so two busy peers
+// exchange messages without a single system call.
+
+// Capacity of each direction's ring (power of two)
+#define SHM_RING_SIZE (1024 * 1024)
+
+typedef struct ShmRing ShmRing;
+
+// One end of a channel
+typedef struct {
+    void *map;          // Mapping of both rings
+    size_t map_len;     // Size of the mapping
+    ShmRing *rx;        // Ring this side consumes
+    ShmRing *tx;        // Ring this side produces into
+    int wake_fd;        // eventfd this side sleeps on (readable when the peer produced or consumed)
+    int peer_fd;        // eventfd that wakes the peer
+} ShmChannel;
+
+// Server side of the handshake: creates the rings and the eventfds and sends them over 'sock'
+// Returns 0 on success, -1 on an error
+int shm_channel_accept(ShmChannel *ch, int sock);
+
+// Client side of the handshake: receives the rings and the eventfds from 'sock' and maps them
+// Returns 0 on success, -1 on an error
+int shm_channel_connect(ShmChannel *ch, int sock);
+
+// Unmaps the rings and closes the eventfds
+void shm_channel_close(ShmChannel *ch);
+
+// Clears pending wakeups, call before looking at the rings after 'wake_fd' became readable
+void shm_channel_ack(ShmChannel *ch);
+
+// Copies up to 'len' received bytes out of the ring
+// Returns the number of bytes, or -1 with errno EAGAIN when the ring is empty (the peer will
+// wake this side up once it produced more)
+ssize_t shm_channel_read(ShmChannel *ch, void *buf, size_t len);
+
+// Copies as much of the iovecs into the ring as fits
+// Returns the number of bytes taken; 0 when the ring is full (the peer will wake this side up
+// once it consumed something)
+size_t shm_channel_writev(ShmChannel *ch, const struct iovec *iov, int iovcnt);
+
+// Bytes that can be written right now
+size_t shm_channel_space(ShmChannel *ch);
+
+// Asks the peer for a wakeup once at least 'need' bytes are free
+// Returns 1 when they already are (no wakeup will come), 0 when the wakeup was requested
+int shm_channel_want_space(ShmChannel *ch, size_t need);
+
+#endif // SHM_CHANNEL_H
@@ -0,0 +1,146 @@
+#include "transform.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>      // SSE2 / AVX2 / AVX-512 intrinsics
+#endif
+
+// Kernel selected on the first call, until then every call goes through the resolver
+static void transform_upper_resolve(char *buf, size_t len);
+transform_fn transform_upper = transform_upper_resolve;
+
+static const char *selected_name = "unresolved";
+
+// Portable fallback: branch-free ASCII conversion, one byte at a time
+// Unlike toupper() this is not locale-aware, which matches the server's C locale behaviour
+void transform_upper_scalar(char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = buf[i];
+        // (c - 'a') < 26 only for lower-case letters, clearing bit 5 upper-cases them
+        buf[i] = c ^ (((unsigned char)(c - 'a') < 26) << 5);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// All vector kernels use the same trick: shift 'a'..'z' to the bottom of the signed byte range,
+// so a single signed compare against -128 + 26 selects exactly the lower-case letters,
+// then the 0x20 case bit is flipped under that mask
+
+void transform_upper_sse2(char *buf, size_t len)
+{
+    const __m128i shift = _mm_set1_epi8((char)('a' + 128));
+    const __m128i limit = _mm_set1_epi8(-128 + 26);
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i lower = _mm_cmplt_epi8(_mm_sub_epi8(v, shift), limit);
+        _mm_storeu_si128((__m128i *)(buf + i), _mm_xor_si128(v, _mm_and_si128(lower, flip)));
+    }
+
+    transform_upper_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+void transform_upper_avx2(char *buf, size_t len)
+{
+    const __m256i shift = _mm256_set1_epi8((char)('a' + 128));
+    const __m256i limit = _mm256_set1_epi8(-128 + 26);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i lower = _mm256_cmpgt_epi8(limit, _mm256_sub_epi8(v, shift));
+        _mm256_storeu_si256((__m256i *)(buf + i), _mm256_xor_si256(v, _mm256_and_si256(lower, flip)));
+    }
+
+    // Finish with the SSE2 kernel, it handles the last < 16 bytes itself
+    transform_upper_sse2(buf + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void transform_upper_avx512(char *buf, size_t len)
+{
+    const __m512i shift = _mm512_set1_epi8((char)('a' + 128));
+    const __m512i limit = _mm512_set1_epi8(-128 + 26);
+    const __m512i flip = _mm512_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64)
+    {
+        __m512i v = _mm512_loadu_si512((const void *)(buf + i));
+        __mmask64 lower = _mm512_cmplt_epi8_mask(_mm512_sub_epi8(v, shift), limit);
+        _mm512_storeu_si512((void *)(buf + i), _mm512_mask_blend_epi8(lower, v, _mm512_xor_si512(v, flip)));
+    }
+
+    // The tail is handled with a masked load/store, so no scalar loop is needed
+    if (i < len)
+    {
+        __mmask64 tail = (__mmask64)-1 >> (64 - (len - i));
+        __m512i v = _mm512_maskz_loadu_epi8(tail, buf + i);
+        __mmask64 lower = _mm512_cmplt_epi8_mask(_mm512_sub_epi8(v, shift), limit);
+        _mm512_mask_storeu_epi8(buf + i, tail, _mm512_mask_blend_epi8(lower, v, _mm512_xor_si512(v, flip)));
+    }
+}
+
+#endif
+
+// Fills 'out' with every kernel compiled into the binary
+int transform_list_variants(TransformVariant *out, int max)
+{
+    TransformVariant all[] = {
+        { "scalar", transform_upper_scalar, 1 },
+#if defined(__x86_64__) || defined(__i386__)
+        { "sse2", transform_upper_sse2, __builtin_cpu_supports("sse2") },
+        { "avx2", transform_upper_avx2, __builtin_cpu_supports("avx2") },
+        { "avx512", transform_upper_avx512,
+          __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") },
+#endif
+    };
+    int n = sizeof(all) / sizeof(all[0]);
+
+    if (n > max)
+    {
+        n = max;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = all[i];
+    }
+    return n;
+}
+
+// Picks the widest supported kernel, installs it and runs it for the pending call
+static void transform_upper_resolve(char *buf, size_t len)
+{
+    TransformVariant variants[8];
+    int n = transform_list_variants(variants, 8);
+
+    // Variants are listed from narrowest to widest, take the last supported one
+    for (int i = 0; i < n; i++)
+    {
+        if (variants[i].supported)
+        {
+            transform_upper = variants[i].fn;
+            selected_name = variants[i].name;
+        }
+    }
+
+    transform_upper(buf, len);
+}
+
+// Returns the name of the kernel behind transform_upper, resolving it if necessary
+const char *transform_variant(void)
+{
+    if (transform_upper == transform_upper_resolve)
+    {
+        transform_upper_resolve("", 0);
+    }
+    return selected_name;
+}
@@ -0,0 +1,35 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stddef.h>     // size_t
+
+// Signature shared by every case-conversion kernel
+// The buffer is converted in place, only ASCII 'a'..'z' are changed
+typedef void (*transform_fn)(char *buf, size_t len);
+
+// Converts a buffer to upper case with the fastest kernel this CPU supports
+// The kernel is picked on the first call (cpuid via __builtin_cpu_supports)
+extern transform_fn transform_upper;
+
+// Returns the name of the kernel selected for transform_upper ("scalar", "sse2", "avx2", "avx512")
+const char *transform_variant(void);
+
+// Description of one kernel, used by the benchmark to compare all variants
+typedef struct {
+    const char *name;       // Human readable kernel name
+    transform_fn fn;        // Kernel entry point
+    int supported;          // Non-zero when the running CPU can execute the kernel
+} TransformVariant;
+
+// Fills 'out' with every kernel compiled into the binary, returns how many were written
+int transform_list_variants(TransformVariant *out, int max);
+
+// Individual kernels (callers normally use transform_upper)
+void transform_upper_scalar(char *buf, size_t len);
+#if defined(__x86_64__) || defined(__i386__)
+void transform_upper_sse2(char *buf, size_t len);
+void transform_upper_avx2(char *buf, size_t len);
+void transform_upper_avx512(char *buf, size_t len);
+#endif
+
+#endif // TRANSFORM_H